@@ -0,0 +1,67 @@
+// Per-pixel accumulation shared by the megakernel and the wavefront kernels, and the active tile list
+// adaptive sampling dispatches them over (see adaptive.h). Needs the FrameUniforms from path_tracing.glsl.
+
+layout(rgba32f, binding = 0) uniform image2D img_output;
+
+// r: mean squared luminance, g: frames accumulated, b: mean luminance
+layout(rgba32f, binding = 1) uniform image2D img_moments;
+
+// Workgroup-sized tiles that still need samples, filled by adaptive_tiles.glsl.
+// u_tile_dispatch is the indirect dispatch over them, one workgroup per tile.
+layout (std430, binding = 16) buffer adaptive_tile_buffer
+{
+	uint u_active_tile_count;
+	uint u_tile_dispatch[3];
+	uint u_active_tiles[];
+};
+
+// Pixels darker than this get the same absolute error budget, rather than chasing relative precision they can't show
+const float ADAPTIVE_DARK_LUMINANCE = 0.05;
+
+// The pixel this invocation works on, (-1, -1) if its workgroup has no tile or it overhangs the image.
+// The workgroup size tuner dispatches over the whole image instead and defines FULL_DISPATCH.
+ivec2 tile_pixel()
+{
+	ivec2 dims = imageSize(img_output);
+#ifdef FULL_DISPATCH
+	ivec2 pix_coords = ivec2(gl_GlobalInvocationID.xy);
+#else
+	uint tile_index = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+	if (tile_index >= u_active_tile_count)
+		return ivec2(-1);
+
+	uint tile = u_active_tiles[tile_index];
+	uint tiles_x = (uint(dims.x) + gl_WorkGroupSize.x - 1u) / gl_WorkGroupSize.x;
+	ivec2 pix_coords = ivec2(uvec2(tile % tiles_x, tile / tiles_x) * gl_WorkGroupSize.xy + gl_LocalInvocationID.xy);
+#endif
+	if (pix_coords.x >= dims.x || pix_coords.y >= dims.y)
+		return ivec2(-1);
+	return pix_coords;
+}
+
+// Whether a pixel's mean is still too noisy: fewer than the minimum frames, or a standard error of its
+// luminance above the threshold, relative to the luminance itself
+bool needs_samples(vec4 moments)
+{
+	float n = moments.g;
+	if (n < float(max(u_adaptive_min_samples, 2)))
+		return true;
+
+	float mean = moments.b;
+	float variance = max(moments.r - mean * mean, 0.0) * n / (n - 1.0);
+	return sqrt(variance / n) > u_adaptive_threshold * max(mean, ADAPTIVE_DARK_LUMINANCE);
+}
+
+// Blends this frame's estimate into the pixel's running mean, with its own frame count since adaptive
+// sampling skips converged pixels
+void accumulate(ivec2 pix_coords, vec3 light)
+{
+	vec4 colour = u_camera_moved ? vec4(0.0, 0.0, 0.0, 1.0) : imageLoad(img_output, pix_coords);
+	vec4 moments = u_camera_moved ? vec4(0.0) : imageLoad(img_moments, pix_coords);
+
+	float n = moments.g + 1.0;
+	float weight = 1.0f / n;
+	float luminance = dot(light, vec3(0.2126, 0.7152, 0.0722));
+	imageStore(img_output, pix_coords, vec4(mix(colour.rgb, light, weight), 1.0));
+	imageStore(img_moments, pix_coords, vec4(mix(moments.r, luminance * luminance, weight), n, mix(moments.b, luminance, weight), 0.0));
+}
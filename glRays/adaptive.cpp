@@ -0,0 +1,85 @@
+#include "adaptive.h"
+
+// std430 layout of adaptive_tile_buffer in accumulation.glsl: the count, then the dispatch arguments, then the tiles
+const size_t TILE_LIST_HEADER_SIZE = sizeof(GLuint) * 4;
+const GLintptr TILE_DISPATCH_ARGS_OFFSET = sizeof(GLuint);
+
+AdaptiveSampler::AdaptiveSampler(int width, int height) : w(width), h(height)
+{
+	glGenTextures(1, &moments);
+	glBindTexture(GL_TEXTURE_2D, moments);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindImageTexture(ADAPTIVE_MOMENTS_IMAGE_UNIT, moments, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &max_groups_x);
+
+	// Just the header until set_workgroup(), the tuner's full image dispatches never read the tiles
+	tile_list.create_buffer();
+	tile_list.allocate(TILE_LIST_HEADER_SIZE);
+	tile_list.bind_base(ADAPTIVE_TILES_BINDING);
+	readback.create_buffer();
+	readback.allocate(sizeof(GLuint));
+}
+
+AdaptiveSampler::~AdaptiveSampler()
+{
+	glDeleteTextures(1, &moments);
+}
+
+void AdaptiveSampler::set_workgroup(WorkgroupSize size)
+{
+	workgroup = size;
+	tiles = ((w + size.x - 1) / size.x) * ((h + size.y - 1) / size.y);
+	last_active_tiles = tiles;
+	tile_list.allocate(TILE_LIST_HEADER_SIZE + sizeof(GLuint) * tiles);
+	tile_list.bind_base(ADAPTIVE_TILES_BINDING);
+
+	compact.attach("adaptive_tiles.glsl", GL_COMPUTE_SHADER, size.defines());
+	compact.link();
+	resolve.attach("adaptive_dispatch.glsl", GL_COMPUTE_SHADER);
+	resolve.link();
+	resolve.setInt("u_max_groups_x", max_groups_x);
+}
+
+void AdaptiveSampler::prepare(bool read_back)
+{
+	// Last frame's copy has long finished by now, this doesn't wait on the frame just submitted
+	if (counted && read_back) {
+		GLuint count = 0;
+		glBindBuffer(GL_COPY_READ_BUFFER, readback.get_id());
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &count);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		last_active_tiles = (int)count;
+	}
+
+	// Compaction reads the moments the previous frame wrote
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_list.get_id());
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	tile_list.bind_base(ADAPTIVE_TILES_BINDING);
+
+	compact.use();
+	workgroup.dispatch(w, h);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	resolve.use();
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, tile_list.get_id());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readback.get_id());
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	counted = true;
+}
+
+void AdaptiveSampler::dispatch() const
+{
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, tile_list.get_id());
+	glDispatchComputeIndirect(TILE_DISPATCH_ARGS_OFFSET);
+}
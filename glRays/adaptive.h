@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include "shader.h"
+#include "gl_buffer.h"
+#include "workgroup.h"
+
+const GLuint ADAPTIVE_MOMENTS_IMAGE_UNIT = 1;
+const GLuint ADAPTIVE_TILES_BINDING = 16;
+
+// Spends samples only where the image is still noisy. Every pixel keeps its frame count and the mean of
+// its luminance and squared luminance in a moments image next to img_output (accumulation.glsl). Each
+// frame a compaction kernel lists the workgroup-sized tiles with a pixel whose error is above the
+// threshold, and the path tracing kernels are dispatched indirectly over that list, one workgroup per
+// tile. Without adaptive sampling the list is every tile, so both paths share one set of kernels.
+class AdaptiveSampler
+{
+	int w;
+	int h;
+	WorkgroupSize workgroup;
+	int tiles = 0;
+	int last_active_tiles = 0;
+	bool counted = false;
+	GLint max_groups_x = 65535;
+
+	GLuint moments = 0;
+	ShaderProgram compact, resolve;
+	GLBuffer tile_list, readback;
+
+public:
+	// Creates and binds the moments image and tile list, the kernels built on accumulation.glsl need both
+	// bound before they run, the workgroup size tuner included
+	AdaptiveSampler(int width, int height);
+	~AdaptiveSampler();
+
+	AdaptiveSampler(const AdaptiveSampler&) = delete;
+	AdaptiveSampler& operator=(const AdaptiveSampler&) = delete;
+
+	// Tiles are the path tracing kernel's workgroups, so this has to match the size it was compiled with.
+	// Called once, after tuning, it builds the compaction kernels.
+	void set_workgroup(WorkgroupSize size);
+
+	// Builds this frame's tile list from the FrameUniforms already uploaded, before the path tracing dispatch.
+	// Frames dispatched back to back within one displayed frame pass read_back false, the count they'd read
+	// was only just copied and reading it would wait on the GPU.
+	void prepare(bool read_back = true);
+
+	// Indirect dispatch of the bound program over the active tiles, leaves GL_DISPATCH_INDIRECT_BUFFER bound to the list
+	void dispatch() const;
+
+	// Tiles that needed samples as of the previous prepare(), read back a frame late so it never stalls
+	int active_tiles() const { return last_active_tiles; }
+	int total_tiles() const { return tiles; }
+	bool converged() const { return last_active_tiles == 0; }
+};
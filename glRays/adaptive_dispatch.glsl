@@ -0,0 +1,17 @@
+#version 430 core
+
+layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+#include "path_tracing.glsl"
+#include "accumulation.glsl"
+
+uniform int u_max_groups_x;
+
+// Turns the active tile count into indirect dispatch arguments, folding into y past the device's x limit
+void main()
+{
+	uint groups_x = min(u_active_tile_count, uint(u_max_groups_x));
+	u_tile_dispatch[0] = groups_x;
+	u_tile_dispatch[1] = groups_x > 0u ? (u_active_tile_count + groups_x - 1u) / groups_x : 1u;
+	u_tile_dispatch[2] = 1u;
+}
@@ -0,0 +1,34 @@
+#version 430 core
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 8
+#endif
+#ifndef LOCAL_SIZE_Y
+#define LOCAL_SIZE_Y 8
+#endif
+layout(local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y, local_size_z = 1) in;
+
+#include "path_tracing.glsl"
+#include "accumulation.glsl"
+
+shared uint tile_active;
+
+// Dispatched over the whole image with the path tracing kernel's workgroup size, so every workgroup is
+// one tile. Lists the tiles where any pixel still needs samples, all of them without adaptive sampling.
+void main()
+{
+	if (gl_LocalInvocationIndex == 0u)
+		tile_active = 0u;
+	barrier();
+
+	ivec2 pix_coords = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 dims = imageSize(img_output);
+	if (pix_coords.x < dims.x && pix_coords.y < dims.y) {
+		if (!u_adaptive || u_camera_moved || needs_samples(imageLoad(img_moments, pix_coords)))
+			atomicOr(tile_active, 1u);
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0u && tile_active != 0u)
+		u_active_tiles[atomicAdd(u_active_tile_count, 1u)] = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
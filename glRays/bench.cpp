@@ -0,0 +1,311 @@
+#include <ctime>
+#include <vector>
+#include <string>
+#include <format>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <filesystem>
+
+#include <glm/glm.hpp>
+
+#include "cli.h"
+#include "headless.h"
+#include "image_io.h"
+#include "revision.h"
+
+// Reproducible renderer benchmark: every built-in scene, and any meshes given on the command line, at
+// fixed resolutions, bounce limits, sample counts and camera positions. Reports time to the sample count,
+// Mrays/s and the RMSE against stored references as JSON, so runs of different revisions can be compared.
+// Usage: glRays_bench [options] [mesh.obj ...]
+
+const int BENCH_WIDTH = 320;
+const int BENCH_HEIGHT = 180;
+const int BENCH_SPP = 64;
+// References are rendered by the same backend with this many times the samples
+const int REFERENCE_SPP_SCALE = 16;
+
+struct BenchScene
+{
+	const char* scene;
+	int max_bounces;
+};
+
+// Glass needs the extra bounces to get light through both sides of its objects
+const BenchScene BENCH_SCENES[] = {
+	{ "cornell_box_diffuse", 4 },
+	{ "cornell_box_metallic", 4 },
+	{ "cornell_box_glass", 8 },
+	{ "default", 4 },
+};
+
+// The camera path every scene is rendered along, each position is measured on its own
+const glm::vec3 BENCH_CAMERA_PATH[] = {
+	glm::vec3(0.0f, 0.0f, 0.0f),
+	glm::vec3(0.0f, 1.0f, -0.2f),
+	glm::vec3(0.5f, 0.6f, -0.3f),
+};
+
+struct BenchSettings
+{
+	bool use_cpu = false;
+	bool wavefront = false;
+	bool quick = false;
+	bool write_references = false;
+	bool count_rays = true;
+	std::string filter;
+	std::string references = "bench_references";
+	std::string output = "glRays_bench.json";
+	std::vector<std::string> meshes;
+};
+
+struct BenchCase
+{
+	std::string name;
+	CLIOptions opts;
+};
+
+struct BenchResult
+{
+	int frames = 0;
+	double seconds = 0.0;
+	uint64_t rays = 0;		// 0 when nothing counted them
+	double rmse = -1.0;		// negative without a reference
+};
+
+static void print_bench_usage(const char* program)
+{
+	std::clog << std::format("Usage: {} [options] [mesh.obj ...]\n", program)
+		<< "  --cpu               benchmark the CPU backend instead of the compute shader\n"
+		<< "  --wavefront         benchmark the wavefront pipeline instead of the megakernel\n"
+		<< "  --filter <text>     only run the cases whose name contains text\n"
+		<< "  --references <dir>  reference PFMs to measure RMSE against (default bench_references)\n"
+		<< "  --write-references  render the references first, at 16x the samples of each case\n"
+		<< "  --no-ray-count      skip the second, counting render of each GPU case, leaves Mrays/s out\n"
+		<< "  --quick             quarter resolution and an eighth of the samples, a smoke test only\n"
+		<< "  --output <path>     JSON results (default glRays_bench.json)\n"
+		<< "  --help              show this message" << std::endl;
+}
+
+static bool parse_bench_cli(int argc, char** argv, BenchSettings& settings, bool& show_help)
+{
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (std::strcmp(arg, "--cpu") == 0)
+			settings.use_cpu = true;
+		else if (std::strcmp(arg, "--wavefront") == 0)
+			settings.wavefront = true;
+		else if (std::strcmp(arg, "--quick") == 0)
+			settings.quick = true;
+		else if (std::strcmp(arg, "--write-references") == 0)
+			settings.write_references = true;
+		else if (std::strcmp(arg, "--no-ray-count") == 0)
+			settings.count_rays = false;
+		else if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0)
+			show_help = true;
+		else if (std::strcmp(arg, "--filter") == 0 && has_value)
+			settings.filter = argv[++i];
+		else if (std::strcmp(arg, "--references") == 0 && has_value)
+			settings.references = argv[++i];
+		else if (std::strcmp(arg, "--output") == 0 && has_value)
+			settings.output = argv[++i];
+		else if (arg[0] != '-')
+			settings.meshes.push_back(arg);
+		else {
+			std::cerr << std::format("ERROR::BENCH::UNKNOWN_ARGUMENT '{}'", arg) << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every scene along the camera path, then each mesh in the diffuse box along it
+static std::vector<BenchCase> bench_cases(const BenchSettings& settings)
+{
+	std::vector<BenchScene> scenes(std::begin(BENCH_SCENES), std::end(BENCH_SCENES));
+	std::vector<std::string> meshes(scenes.size());
+	for (const std::string& mesh : settings.meshes) {
+		scenes.push_back({ "cornell_box_diffuse", 4 });
+		meshes.push_back(mesh);
+	}
+
+	std::vector<BenchCase> cases;
+	for (size_t s = 0; s < scenes.size(); s++) {
+		std::string scene_name = scenes[s].scene;
+		if (!meshes[s].empty())
+			scene_name += "+" + std::filesystem::path(meshes[s]).stem().string();
+
+		for (int view = 0; view < (int)std::size(BENCH_CAMERA_PATH); view++) {
+			BenchCase c;
+			c.name = std::format("{}/{}", scene_name, view);
+			if (!settings.filter.empty() && c.name.find(settings.filter) == std::string::npos)
+				continue;
+			c.opts.headless = true;
+			c.opts.use_cpu = settings.use_cpu;
+			c.opts.wavefront = settings.wavefront;
+			c.opts.scene = scenes[s].scene;
+			c.opts.mesh = meshes[s];
+			c.opts.max_bounces = scenes[s].max_bounces;
+			c.opts.camera_position = BENCH_CAMERA_PATH[view];
+			c.opts.width = settings.quick ? BENCH_WIDTH / 4 : BENCH_WIDTH;
+			c.opts.height = settings.quick ? BENCH_HEIGHT / 4 : BENCH_HEIGHT;
+			c.opts.spp = settings.quick ? BENCH_SPP / 8 : BENCH_SPP;
+			cases.push_back(c);
+		}
+	}
+	return cases;
+}
+
+// Keyed by everything that changes the converged image, so a reference is never compared with another setup
+static std::string reference_path(const BenchSettings& settings, const BenchCase& c)
+{
+	std::string name = c.name;
+	for (char& ch : name)
+		if (ch == '/' || ch == '+')
+			ch = '_';
+	return (std::filesystem::path(settings.references) / std::format("{}_{}x{}_{}b.pfm", name, c.opts.width, c.opts.height, c.opts.max_bounces)).string();
+}
+
+static bool write_reference(const BenchSettings& settings, const BenchCase& c)
+{
+	CLIOptions opts = c.opts;
+	opts.spp *= REFERENCE_SPP_SCALE;
+	HeadlessResult render;
+	if (!render_headless(opts, render))
+		return false;
+
+	std::string path = reference_path(settings, c);
+	std::filesystem::create_directories(settings.references);
+	if (!write_pfm(path, opts.width, opts.height, render.pixels.data()))
+		return false;
+	std::clog << std::format("Wrote reference '{}' at {} spp", path, opts.spp) << std::endl;
+	return true;
+}
+
+static bool run_case(const BenchSettings& settings, const BenchCase& c, BenchResult& result, std::string& renderer)
+{
+	HeadlessResult render;
+	if (!render_headless(c.opts, render))
+		return false;
+	renderer = render.renderer;
+	result.frames = render.frames;
+	result.seconds = render.seconds;
+
+	// The counters cost throughput, so rays are counted by a second render with the same seeds, which
+	// traces exactly the same paths
+	if (render.used_gpu && settings.count_rays) {
+		CLIOptions opts = c.opts;
+		opts.ray_stats = true;
+		HeadlessResult counted;
+		if (render_headless(opts, counted))
+			result.rays = counted.rays.total_rays();
+	}
+
+	std::string path = reference_path(settings, c);
+	int width, height;
+	std::vector<float> reference;
+	if (!std::filesystem::exists(path))
+		std::clog << std::format("No reference '{}', run with --write-references to create it", path) << std::endl;
+	else if (read_pfm(path, width, height, reference) && width == c.opts.width && height == c.opts.height)
+		result.rmse = image_rmse(render.pixels.data(), reference.data(), (size_t)width * height);
+	return true;
+}
+
+static std::string json_string(const std::string& s)
+{
+	std::string out = "\"";
+	for (char ch : s) {
+		if (ch == '"' || ch == '\\')
+			out += '\\';
+		if ((unsigned char)ch < 0x20)
+			out += std::format("\\u{:04x}", (int)ch);
+		else
+			out += ch;
+	}
+	return out + "\"";
+}
+
+static std::string utc_timestamp()
+{
+	std::time_t now = std::time(nullptr);
+	char buffer[32];
+	std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+	return buffer;
+}
+
+static bool write_json(const BenchSettings& settings, const std::string& renderer, const std::vector<BenchCase>& cases, const std::vector<BenchResult>& results)
+{
+	std::ofstream file(settings.output);
+	if (!file) {
+		std::cerr << std::format("ERROR::BENCH::FILE_NOT_WRITABLE '{}'", settings.output) << std::endl;
+		return false;
+	}
+
+	file << "{\n";
+	file << std::format("  \"revision\": {},\n", json_string(GLRAYS_REVISION));
+	file << std::format("  \"date\": {},\n", json_string(utc_timestamp()));
+	file << std::format("  \"renderer\": {},\n", json_string(renderer));
+	file << std::format("  \"pipeline\": {},\n", json_string(settings.use_cpu ? "cpu" : settings.wavefront ? "wavefront" : "megakernel"));
+	file << std::format("  \"quick\": {},\n", settings.quick);
+	file << "  \"cases\": [\n";
+	for (size_t i = 0; i < cases.size(); i++) {
+		const CLIOptions& opts = cases[i].opts;
+		const BenchResult& r = results[i];
+		double samples = (double)opts.width * opts.height * r.frames;
+		file << "    {";
+		file << std::format("\"name\": {}, \"scene\": {}, \"mesh\": {}, ", json_string(cases[i].name), json_string(opts.scene), json_string(opts.mesh));
+		file << std::format("\"camera\": [{}, {}, {}], ", opts.camera_position.x, opts.camera_position.y, opts.camera_position.z);
+		file << std::format("\"width\": {}, \"height\": {}, \"spp\": {}, \"max_bounces\": {}, ", opts.width, opts.height, opts.spp, opts.max_bounces);
+		file << std::format("\"seconds\": {:.4f}, \"msamples_per_s\": {:.4f}, ", r.seconds, samples / r.seconds / 1e6);
+		if (r.rays > 0)
+			file << std::format("\"rays\": {}, \"mrays_per_s\": {:.4f}, ", r.rays, r.rays / r.seconds / 1e6);
+		else
+			file << "\"rays\": null, \"mrays_per_s\": null, ";
+		file << (r.rmse >= 0.0 ? std::format("\"rmse\": {:.8f}", r.rmse) : std::string("\"rmse\": null"));
+		file << (i + 1 < cases.size() ? "},\n" : "}\n");
+	}
+	file << "  ]\n}\n";
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	BenchSettings settings;
+	bool show_help = false;
+	if (!parse_bench_cli(argc, argv, settings, show_help) || show_help) {
+		print_bench_usage(argv[0]);
+		return show_help ? 0 : -1;
+	}
+
+	std::vector<BenchCase> cases = bench_cases(settings);
+	if (cases.empty()) {
+		std::cerr << std::format("ERROR::BENCH::NO_CASES matching '{}'", settings.filter) << std::endl;
+		return 1;
+	}
+
+	if (settings.write_references) {
+		for (const BenchCase& c : cases)
+			if (!write_reference(settings, c))
+				return 1;
+	}
+
+	std::string renderer;
+	std::vector<BenchResult> results(cases.size());
+	for (size_t i = 0; i < cases.size(); i++) {
+		std::clog << std::format("[{}/{}] {}", i + 1, cases.size(), cases[i].name) << std::endl;
+		if (!run_case(settings, cases[i], results[i], renderer))
+			return 1;
+		const BenchResult& r = results[i];
+		std::clog << std::format("{}: {} spp in {:.3f}s, {}, RMSE {}", cases[i].name, r.frames, r.seconds,
+			r.rays > 0 ? std::format("{:.2f} Mrays/s", r.rays / r.seconds / 1e6) : std::string("rays not counted"),
+			r.rmse >= 0.0 ? std::format("{:.6f}", r.rmse) : std::string("n/a")) << std::endl;
+	}
+
+	if (!write_json(settings, renderer, cases, results))
+		return 1;
+	std::clog << std::format("Wrote '{}'", settings.output) << std::endl;
+	return 0;
+}
@@ -0,0 +1,469 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <format>
+#include <iostream>
+
+#include "thread_pool.h"
+
+void BVHStats::print() const
+{
+	std::clog << std::format("BVH built in {:.2f}ms: {} prims, {} nodes, {} leaves, max depth {}",
+		build_ms, n_prims, n_nodes, n_leaves, max_depth) << std::endl;
+	std::clog << std::format("    SAH cost {:.2f}, leaf size min {} / avg {:.2f} / max {}",
+		sah_cost, min_leaf_size, avg_leaf_size, max_leaf_size) << std::endl;
+	if (n_instances > 0)
+		std::clog << std::format("    {} instances at the top level, {} nodes in the instanced meshes' trees", n_instances, n_instance_nodes) << std::endl;
+}
+
+void BVH::update_node_bounds(int node_idx, const std::vector<AABB>& prim_bounds)
+{
+	BVHNode& node = nodes[node_idx];
+	AABB bounds;
+	for (int i = node.left_first; i < node.left_first + node.count; i++)
+		bounds.grow(prim_bounds[prim_indices[i]]);
+	node.bounds_min = bounds.bounds_min;
+	node.bounds_max = bounds.bounds_max;
+}
+
+void BVH::subdivide(int node_idx, int depth, const std::vector<AABB>& prim_bounds)
+{
+	int first = nodes[node_idx].left_first;
+	int count = nodes[node_idx].count;
+
+	// Stop before the shader's traversal stack could overflow
+	if (count <= 1 || depth + 1 >= BVH_MAX_DEPTH)
+		return;
+
+	AABB centroid_bounds;
+	for (int i = first; i < first + count; i++)
+		centroid_bounds.grow(prim_bounds[prim_indices[i]].centroid());
+
+	// Bin primitive centroids along each axis and sweep the bins for the cheapest split
+	int best_axis = -1;
+	int best_split = 0;
+	float best_cost = INFINITY;
+	for (int axis = 0; axis < 3; axis++) {
+		float c_min = centroid_bounds.bounds_min[axis];
+		float c_max = centroid_bounds.bounds_max[axis];
+		if (c_max <= c_min)
+			continue;
+
+		BuildBin bins[BVH_BINS];
+		float scale = BVH_BINS / (c_max - c_min);
+		for (int i = first; i < first + count; i++) {
+			const AABB& b = prim_bounds[prim_indices[i]];
+			int bin = std::min(BVH_BINS - 1, (int)((b.centroid()[axis] - c_min) * scale));
+			bins[bin].count++;
+			bins[bin].bounds.grow(b);
+		}
+
+		float left_area[BVH_BINS - 1], right_area[BVH_BINS - 1];
+		int left_count[BVH_BINS - 1], right_count[BVH_BINS - 1];
+		AABB left_box, right_box;
+		int left_sum = 0, right_sum = 0;
+		for (int i = 0; i < BVH_BINS - 1; i++) {
+			left_sum += bins[i].count;
+			left_box.grow(bins[i].bounds);
+			left_count[i] = left_sum;
+			left_area[i] = left_box.area();
+
+			right_sum += bins[BVH_BINS - 1 - i].count;
+			right_box.grow(bins[BVH_BINS - 1 - i].bounds);
+			right_count[BVH_BINS - 2 - i] = right_sum;
+			right_area[BVH_BINS - 2 - i] = right_box.area();
+		}
+
+		for (int i = 0; i < BVH_BINS - 1; i++) {
+			if (left_count[i] == 0 || right_count[i] == 0)
+				continue;
+			float cost = left_count[i] * left_area[i] + right_count[i] * right_area[i];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = i;
+			}
+		}
+	}
+
+	// All centroids coincide, nothing left to split on
+	if (best_axis < 0)
+		return;
+
+	AABB node_bounds;
+	node_bounds.bounds_min = nodes[node_idx].bounds_min;
+	node_bounds.bounds_max = nodes[node_idx].bounds_max;
+	float parent_area = node_bounds.area();
+	float leaf_cost = BVH_INTERSECT_COST * count;
+	float split_cost = parent_area > 0.0f
+		? BVH_TRAVERSAL_COST + BVH_INTERSECT_COST * best_cost / parent_area
+		: leaf_cost;
+	if (split_cost >= leaf_cost && count <= BVH_MAX_LEAF_SIZE)
+		return;
+
+	// Partition the primitive references with the same binning used to evaluate the split
+	float c_min = centroid_bounds.bounds_min[best_axis];
+	float scale = BVH_BINS / (centroid_bounds.bounds_max[best_axis] - c_min);
+	auto begin = prim_indices.begin() + first;
+	auto mid = std::partition(begin, begin + count, [&](uint32_t prim) {
+		int bin = std::min(BVH_BINS - 1, (int)((prim_bounds[prim].centroid()[best_axis] - c_min) * scale));
+		return bin <= best_split;
+	});
+	int left_count = (int)(mid - begin);
+
+	int left_idx = (int)nodes.size();
+	BVHNode left, right;
+	left.left_first = first;
+	left.count = left_count;
+	right.left_first = first + left_count;
+	right.count = count - left_count;
+	nodes.push_back(left);
+	nodes.push_back(right);
+	update_node_bounds(left_idx, prim_bounds);
+	update_node_bounds(left_idx + 1, prim_bounds);
+
+	nodes[node_idx].left_first = left_idx;
+	nodes[node_idx].count = 0;
+
+	subdivide(left_idx, depth + 1, prim_bounds);
+	subdivide(left_idx + 1, depth + 1, prim_bounds);
+}
+
+void BVH::build(const std::vector<AABB>& prim_bounds)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	int n_prims = (int)prim_bounds.size();
+	prim_indices.resize(n_prims);
+	std::iota(prim_indices.begin(), prim_indices.end(), 0);
+
+	// An empty scene still gets a root. Its inverted bounds pass the slab test, traversals check is_empty_node() instead
+	nodes.clear();
+	nodes.reserve(std::max(1, 2 * n_prims - 1));
+	BVHNode root;
+	root.left_first = 0;
+	root.count = n_prims;
+	nodes.push_back(root);
+	update_node_bounds(0, prim_bounds);
+	subdivide(0, 0, prim_bounds);
+	top_level_nodes = (int)nodes.size();
+
+	auto end = std::chrono::steady_clock::now();
+	stats.build_ms = std::chrono::duration<double, std::milli>(end - start).count();
+	update_stats(prim_bounds);
+	build_sah_cost = stats.sah_cost;
+}
+
+void BVH::refit(const std::vector<AABB>& slot_bounds, int first, int end)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Children always have a higher index than their parent, so walking backwards sees them first
+	for (int i = end - 1; i >= first; i--) {
+		BVHNode& node = nodes[i];
+		if (node.count > 0 || is_empty_node(node, i)) {
+			AABB bounds;
+			for (int j = node.left_first; j < node.left_first + node.count; j++)
+				bounds.grow(slot_bounds[j]);
+			node.bounds_min = bounds.bounds_min;
+			node.bounds_max = bounds.bounds_max;
+			continue;
+		}
+		const BVHNode& left = nodes[node.left_first];
+		const BVHNode& right = nodes[node.left_first + 1];
+		node.bounds_min = glm::min(left.bounds_min, right.bounds_min);
+		node.bounds_max = glm::max(left.bounds_max, right.bounds_max);
+	}
+
+	stats.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	stats.sah_cost = sah_cost();
+}
+
+int BVH::append(const BVH& other)
+{
+	int node_offset = (int)nodes.size();
+	int prim_offset = (int)prim_indices.size();
+	for (BVHNode node : other.nodes) {
+		node.left_first += node.count > 0 || other.nodes.size() == 1 ? prim_offset : node_offset;
+		nodes.push_back(node);
+	}
+	prim_indices.insert(prim_indices.end(), other.prim_indices.begin(), other.prim_indices.end());
+	return node_offset;
+}
+
+float BVH::sah_cost() const
+{
+	AABB root_bounds;
+	root_bounds.bounds_min = nodes[0].bounds_min;
+	root_bounds.bounds_max = nodes[0].bounds_max;
+	float root_area = root_bounds.area();
+	if (root_area <= 0.0f)
+		return 0.0f;
+
+	float cost = 0.0f;
+	for (int i = 0; i < top_level_nodes; i++) {
+		const BVHNode& node = nodes[i];
+		AABB b;
+		b.bounds_min = node.bounds_min;
+		b.bounds_max = node.bounds_max;
+		float rel_area = b.area() / root_area;
+		if (node.count > 0)
+			cost += BVH_INTERSECT_COST * node.count * rel_area;
+		else
+			cost += BVH_TRAVERSAL_COST * rel_area;
+	}
+	return cost;
+}
+
+void BVH::update_stats(const std::vector<AABB>& prim_bounds)
+{
+	stats.n_prims = (int)prim_bounds.size();
+	stats.n_nodes = (int)nodes.size();
+	stats.n_leaves = 0;
+	stats.max_depth = 0;
+	stats.min_leaf_size = stats.n_prims;
+	stats.max_leaf_size = 0;
+
+	// Walk the tree to find leaf depths, children always have a higher index than their parent
+	std::vector<int> depth(nodes.size(), 0);
+	for (int i = 0; i < (int)nodes.size(); i++) {
+		const BVHNode& node = nodes[i];
+		if (node.count == 0 && stats.n_prims > 0) {
+			depth[node.left_first] = depth[i] + 1;
+			depth[node.left_first + 1] = depth[i] + 1;
+			continue;
+		}
+		stats.n_leaves++;
+		stats.max_depth = std::max(stats.max_depth, depth[i]);
+		stats.min_leaf_size = std::min(stats.min_leaf_size, node.count);
+		stats.max_leaf_size = std::max(stats.max_leaf_size, node.count);
+	}
+	stats.avg_leaf_size = stats.n_leaves > 0 ? float(stats.n_prims) / stats.n_leaves : 0.0f;
+	stats.sah_cost = sah_cost();
+}
+
+namespace
+{
+	AABB sphere_bounds(const Sphere& sphere)
+	{
+		AABB b;
+		b.grow(sphere.centre - glm::vec3(sphere.radius));
+		b.grow(sphere.centre + glm::vec3(sphere.radius));
+		return b;
+	}
+
+	AABB triangle_bounds(const SceneData& scene, const Triangle& tri)
+	{
+		AABB b;
+		b.grow(scene.vertices[tri.v0].position);
+		b.grow(scene.vertices[tri.v1].position);
+		b.grow(scene.vertices[tri.v2].position);
+		return b;
+	}
+
+	// World bounds of an instance, its tree's root box with every corner transformed
+	AABB instance_bounds(const BVHNode& node, const glm::mat4& transform)
+	{
+		AABB b;
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 p = glm::vec3(corner & 1 ? node.bounds_max.x : node.bounds_min.x,
+				corner & 2 ? node.bounds_max.y : node.bounds_min.y, corner & 4 ? node.bounds_max.z : node.bounds_min.z);
+			b.grow(glm::vec3(transform * glm::vec4(p, 1.0f)));
+		}
+		return b;
+	}
+
+	// Bounds of a top-level reference, see BVH::refit()
+	AABB prim_ref_bounds(const SceneData& scene, const BVH& bvh, uint32_t prim)
+	{
+		if (is_instance_ref(prim)) {
+			const BVHInstance& instance = bvh.instances[prim & ~BVH_INSTANCE_BIT];
+			return instance_bounds(bvh.nodes[instance.root], scene.instances[prim & ~BVH_INSTANCE_BIT].transform);
+		}
+		if (prim & BVH_TRIANGLE_BIT)
+			return triangle_bounds(scene, scene.triangles[prim & ~BVH_TRIANGLE_BIT]);
+		return sphere_bounds(scene.spheres[prim]);
+	}
+
+	// Leaves per task when refitting in parallel, a few thousand primitives
+	const int REFIT_LEAVES_PER_TASK = 1024;
+
+	// Bounds of every slot referenced by the leaves among nodes [first, end)
+	void leaf_slot_bounds(const SceneData& scene, const BVH& bvh, int first, int end, ThreadPool* pool, std::vector<AABB>& slot_bounds)
+	{
+		std::vector<int> leaves;
+		for (int i = first; i < end; i++)
+			if (bvh.nodes[i].count > 0)
+				leaves.push_back(i);
+
+		// Leaves never share slots, so tasks write disjoint parts of slot_bounds
+		int n_tasks = ((int)leaves.size() + REFIT_LEAVES_PER_TASK - 1) / REFIT_LEAVES_PER_TASK;
+		auto fill = [&](int task) {
+			int last = std::min((task + 1) * REFIT_LEAVES_PER_TASK, (int)leaves.size());
+			for (int l = task * REFIT_LEAVES_PER_TASK; l < last; l++) {
+				const BVHNode& node = bvh.nodes[leaves[l]];
+				for (int j = node.left_first; j < node.left_first + node.count; j++)
+					slot_bounds[j] = prim_ref_bounds(scene, bvh, bvh.prim_indices[j]);
+			}
+		};
+		if (pool && n_tasks > 1)
+			pool->parallel_for(n_tasks, fill);
+		else
+			for (int task = 0; task < n_tasks; task++)
+				fill(task);
+	}
+
+	BVHInstance make_instance(const MeshInstance& instance, int root)
+	{
+		BVHInstance record = {};
+		glm::mat4 world_to_object = glm::inverse(instance.transform);
+		for (int row = 0; row < 3; row++)
+			record.world_to_object[row] = glm::vec4(world_to_object[0][row], world_to_object[1][row], world_to_object[2][row], world_to_object[3][row]);
+		record.root = root;
+		record.material = instance.material;
+		return record;
+	}
+
+	// The spheres, the triangles that belong to no mesh and the instances of meshes with a tree, mesh_roots[mesh]
+	// is the root of that tree or null
+	TopLevelPrims gather_top_level(const SceneData& scene, const std::vector<const BVHNode*>& mesh_roots)
+	{
+		TopLevelPrims prims;
+		for (uint32_t i = 0; i < (uint32_t)scene.spheres.size(); i++) {
+			prims.refs.push_back(i);
+			prims.bounds.push_back(sphere_bounds(scene.spheres[i]));
+		}
+		for (uint32_t i = 0; i < (uint32_t)scene.triangles.size(); i++) {
+			if (scene.triangles[i].material < 0)
+				continue;
+			prims.refs.push_back(i | BVH_TRIANGLE_BIT);
+			prims.bounds.push_back(triangle_bounds(scene, scene.triangles[i]));
+		}
+		for (uint32_t i = 0; i < (uint32_t)scene.instances.size(); i++) {
+			const MeshInstance& instance = scene.instances[i];
+			if (!mesh_roots[instance.mesh])
+				continue;
+			prims.refs.push_back(i | BVH_INSTANCE_BIT);
+			prims.bounds.push_back(instance_bounds(*mesh_roots[instance.mesh], instance.transform));
+		}
+		return prims;
+	}
+}
+
+BVH build_scene_bvh(const SceneData& scene)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// One tree per mesh in its own space, built first so the instances' bounds are known
+	std::vector<BVH> mesh_bvhs(scene.meshes.size());
+	for (size_t m = 0; m < scene.meshes.size(); m++) {
+		const SceneMesh& mesh = scene.meshes[m];
+		std::vector<AABB> prim_bounds;
+		prim_bounds.reserve(mesh.n_triangles);
+		for (uint32_t i = 0; i < mesh.n_triangles; i++)
+			prim_bounds.push_back(triangle_bounds(scene, scene.triangles[mesh.first_triangle + i]));
+		mesh_bvhs[m].build(prim_bounds);
+		for (uint32_t& prim : mesh_bvhs[m].prim_indices)
+			prim = (mesh.first_triangle + prim) | BVH_TRIANGLE_BIT;
+	}
+
+	// Empty meshes have no tree, nothing references them
+	std::vector<const BVHNode*> mesh_roots(scene.meshes.size(), nullptr);
+	for (size_t m = 0; m < scene.meshes.size(); m++)
+		if (!mesh_bvhs[m].prim_indices.empty())
+			mesh_roots[m] = &mesh_bvhs[m].nodes[0];
+	TopLevelPrims prims = gather_top_level(scene, mesh_roots);
+	BVH bvh = build_top_level(prims);
+	for (uint32_t& prim : bvh.prim_indices)
+		prim = prims.refs[prim];
+
+	std::vector<int> roots(scene.meshes.size(), -1);
+	for (size_t m = 0; m < scene.meshes.size(); m++)
+		if (!mesh_bvhs[m].prim_indices.empty())
+			roots[m] = bvh.append(mesh_bvhs[m]);
+	for (const MeshInstance& instance : scene.instances)
+		bvh.instances.push_back(make_instance(instance, roots[instance.mesh]));
+
+	auto end = std::chrono::steady_clock::now();
+	bvh.stats.build_ms = std::chrono::duration<double, std::milli>(end - start).count();
+	bvh.stats.n_instances = (int)scene.instances.size();
+	bvh.stats.n_instance_nodes = (int)bvh.nodes.size() - bvh.top_level_nodes;
+	return bvh;
+}
+
+TopLevelPrims gather_top_level_prims(const SceneData& scene, const BVH& bvh)
+{
+	std::vector<const BVHNode*> mesh_roots(scene.meshes.size(), nullptr);
+	for (size_t i = 0; i < scene.instances.size(); i++)
+		if (bvh.instances[i].root >= 0)
+			mesh_roots[scene.instances[i].mesh] = &bvh.nodes[bvh.instances[i].root];
+	return gather_top_level(scene, mesh_roots);
+}
+
+BVH build_top_level(const TopLevelPrims& prims)
+{
+	BVH top;
+	top.build(prims.bounds);
+	return top;
+}
+
+void refit_top_level(BVH& top, const TopLevelPrims& prims)
+{
+	std::vector<AABB> slot_bounds(top.prim_indices.size());
+	for (size_t i = 0; i < top.prim_indices.size(); i++)
+		slot_bounds[i] = prims.bounds[top.prim_indices[i]];
+	top.refit(slot_bounds, 0, (int)top.nodes.size());
+}
+
+void splice_top_level(BVH& bvh, const BVH& top, const TopLevelPrims& prims)
+{
+	// The top level references the same primitives as before, so the meshes' slots stay where they were
+	// and only their nodes shift by the difference in the top level's size
+	int node_shift = top.top_level_nodes - bvh.top_level_nodes;
+	if (node_shift > 0)
+		bvh.nodes.insert(bvh.nodes.begin(), node_shift, BVHNode());
+	else
+		bvh.nodes.erase(bvh.nodes.begin(), bvh.nodes.begin() - node_shift);
+	for (size_t i = top.top_level_nodes; i < bvh.nodes.size(); i++)
+		if (bvh.nodes[i].count == 0)
+			bvh.nodes[i].left_first += node_shift;
+	std::copy(top.nodes.begin(), top.nodes.end(), bvh.nodes.begin());
+	for (size_t i = 0; i < top.prim_indices.size(); i++)
+		bvh.prim_indices[i] = prims.refs[top.prim_indices[i]];
+	for (BVHInstance& instance : bvh.instances)
+		if (instance.root >= 0)
+			instance.root += node_shift;
+
+	BVHStats stats = top.stats;
+	stats.n_instances = bvh.stats.n_instances;
+	stats.n_instance_nodes = bvh.stats.n_instance_nodes;
+	bvh.stats = stats;
+	bvh.top_level_nodes = top.top_level_nodes;
+	bvh.build_sah_cost = top.build_sah_cost;
+}
+
+void refit_scene_bvh(const SceneData& scene, BVH& bvh, bool refit_meshes, ThreadPool* pool)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < scene.instances.size(); i++)
+		bvh.instances[i] = make_instance(scene.instances[i], bvh.instances[i].root);
+
+	// The top level's slots come before the meshes', which a refit that leaves those alone doesn't need
+	size_t n_slots = 0;
+	for (int i = 0; i < bvh.top_level_nodes; i++)
+		if (bvh.nodes[i].count > 0)
+			n_slots = std::max(n_slots, (size_t)(bvh.nodes[i].left_first + bvh.nodes[i].count));
+	int n_nodes = (int)bvh.nodes.size();
+	std::vector<AABB> slot_bounds(refit_meshes ? bvh.prim_indices.size() : n_slots);
+
+	// The meshes first, the instances' bounds come from their roots
+	if (refit_meshes && bvh.top_level_nodes < n_nodes) {
+		leaf_slot_bounds(scene, bvh, bvh.top_level_nodes, n_nodes, pool, slot_bounds);
+		bvh.refit(slot_bounds, bvh.top_level_nodes, n_nodes);
+	}
+	leaf_slot_bounds(scene, bvh, 0, bvh.top_level_nodes, pool, slot_bounds);
+	bvh.refit(slot_bounds, 0, bvh.top_level_nodes);
+	bvh.stats.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "scene.h"
+
+// Must match BVH_MAX_DEPTH in compute.glsl, the traversal stack is sized from it
+const int BVH_MAX_DEPTH = 32;
+const int BVH_MAX_LEAF_SIZE = 4;
+const int BVH_BINS = 16;
+
+// SAH cost constants, relative cost of stepping through a node vs. testing a primitive
+const float BVH_TRAVERSAL_COST = 1.0f;
+const float BVH_INTERSECT_COST = 1.0f;
+// A refit tree whose SAH cost has grown by this factor since it was built is worth building again
+const float BVH_REBUILD_DRIFT = 1.25f;
+
+// Primitive references in a scene BVH are packed, the high bit marks a triangle and the next one an instance
+const uint32_t BVH_TRIANGLE_BIT = 0x80000000u;
+const uint32_t BVH_INSTANCE_BIT = 0x40000000u;
+
+inline bool is_instance_ref(uint32_t prim)
+{
+	return (prim & (BVH_TRIANGLE_BIT | BVH_INSTANCE_BIT)) == BVH_INSTANCE_BIT;
+}
+
+struct AABB
+{
+	glm::vec3 bounds_min = glm::vec3(INFINITY);
+	glm::vec3 bounds_max = glm::vec3(-INFINITY);
+
+	void grow(glm::vec3 p)
+	{
+		bounds_min = glm::min(bounds_min, p);
+		bounds_max = glm::max(bounds_max, p);
+	}
+
+	void grow(const AABB& b)
+	{
+		bounds_min = glm::min(bounds_min, b.bounds_min);
+		bounds_max = glm::max(bounds_max, b.bounds_max);
+	}
+
+	glm::vec3 centroid() const { return (bounds_min + bounds_max) * 0.5f; }
+
+	float area() const
+	{
+		glm::vec3 e = bounds_max - bounds_min;
+		if (e.x < 0.0f || e.y < 0.0f || e.z < 0.0f)
+			return 0.0f;
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+};
+
+// Flattened node, laid out to match the std430 BVHNode struct in compute.glsl.
+// Interior nodes have count == 0 and their children stored at left_first and left_first + 1.
+// Leaves reference prim_indices[left_first .. left_first + count).
+struct BVHNode
+{
+	glm::vec3 bounds_min;
+	int left_first;
+	glm::vec3 bounds_max;
+	int count;
+};
+
+// Children always come after their parent, so a node with no primitives whose left_first doesn't point past
+// it has nothing under it. Only the root of an empty tree looks like that, traversals have to stop there.
+inline bool is_empty_node(const BVHNode& node, int node_idx)
+{
+	return node.count == 0 && node.left_first <= node_idx;
+}
+
+// A mesh instance as the shader reads it, laid out to match the std430 Instance struct in path_tracing.glsl.
+// Rays are moved into the mesh's space and traced through its own tree, so t stays the same in both spaces.
+struct BVHInstance
+{
+	glm::vec4 world_to_object[3];	// rows of the inverse transform's 3x4 part
+	int root;						// of the mesh's tree in BVH::nodes
+	int material;
+	int std430padding[2];
+};
+
+struct BVHStats
+{
+	int n_prims = 0;
+	int n_nodes = 0;
+	int n_leaves = 0;
+	int max_depth = 0;
+	int min_leaf_size = 0;
+	int max_leaf_size = 0;
+	float avg_leaf_size = 0.0f;
+	float sah_cost = 0.0f;
+	double build_ms = 0.0;
+	int n_instances = 0;
+	int n_instance_nodes = 0;	// in the instanced meshes' trees
+
+	void print() const;
+};
+
+class BVH
+{
+	struct BuildBin
+	{
+		AABB bounds;
+		int count = 0;
+	};
+
+	void update_node_bounds(int node_idx, const std::vector<AABB>& prim_bounds);
+	void subdivide(int node_idx, int depth, const std::vector<AABB>& prim_bounds);
+	void update_stats(const std::vector<AABB>& prim_bounds);
+
+public:
+	std::vector<BVHNode> nodes;
+	std::vector<uint32_t> prim_indices;
+	// A scene BVH's top level ends here, the instanced meshes' trees follow it in nodes and prim_indices
+	int top_level_nodes = 0;
+	std::vector<BVHInstance> instances;
+	BVHStats stats;
+	// The top level's SAH cost when it was built, stats.sah_cost follows it through refits
+	float build_sah_cost = 0.0f;
+
+	// Binned SAH build over arbitrary primitives, prim_indices refer back into prim_bounds
+	void build(const std::vector<AABB>& prim_bounds);
+
+	// Recomputes the bounds of nodes [first, end) bottom-up after primitives moved, keeping their structure.
+	// The range is the top level or the meshes' trees. Far cheaper than build(), but the tree gets worse the
+	// further primitives move from where it was built. slot_bounds[i] bounds whatever prim_indices[i] refers
+	// to, only the slots of the range's leaves are read.
+	void refit(const std::vector<AABB>& slot_bounds, int first, int end);
+
+	// Appends another tree after this one's, returns the index of its root in nodes
+	int append(const BVH& other);
+
+	// Total SAH cost of the top level, normalised by the root's surface area
+	float sah_cost() const;
+
+	// How much refits have degraded the top level, 1 as built, see BVH_REBUILD_DRIFT
+	float sah_drift() const { return build_sah_cost > 0.0f ? stats.sah_cost / build_sah_cost : 1.0f; }
+};
+
+// Two levels with packed primitive references: a tree per instanced mesh over its triangles in its own
+// space, and a top level over the scene's spheres, the triangles of no mesh, and the instances
+BVH build_scene_bvh(const SceneData& scene);
+
+// The top level of a BVH from build_scene_bvh() that refits have degraded is rebuilt in three steps, so the
+// build can run on another thread without a copy of the scene: the top level's primitives are gathered at
+// their current positions, a tree is built over them alone, and it's spliced in over the old top level.
+// The meshes' trees are kept as they are, the scene must have the same primitives and instances throughout.
+struct TopLevelPrims
+{
+	std::vector<uint32_t> refs;		// packed as in BVH::prim_indices
+	std::vector<AABB> bounds;
+};
+TopLevelPrims gather_top_level_prims(const SceneData& scene, const BVH& bvh);
+
+// Touches nothing but prims, its prim_indices index into prims.refs
+BVH build_top_level(const TopLevelPrims& prims);
+
+// Refits a tree from build_top_level() to prims gathered again since, say after a build on another thread
+void refit_top_level(BVH& top, const TopLevelPrims& prims);
+
+// Replaces bvh's top level with top, shifting the meshes' trees after it. The slots stay in place, only
+// the first top.prim_indices.size() are reordered.
+void splice_top_level(BVH& bvh, const BVH& top, const TopLevelPrims& prims);
+
+class ThreadPool;
+
+// Refits a BVH built by build_scene_bvh() to the scene's current positions and instance transforms, the
+// scene must still have the same primitives and instances of the same meshes it was built over. The
+// meshes' trees are only refit with refit_meshes, when their vertices moved. Primitive bounds are
+// computed across pool's threads when one is given, the bottom-up pass over the nodes stays serial.
+void refit_scene_bvh(const SceneData& scene, BVH& bvh, bool refit_meshes = true, ThreadPool* pool = nullptr);
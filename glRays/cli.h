@@ -0,0 +1,185 @@
+#pragma once
+
+#include <string>
+#include <format>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+#include "scene.h"
+#include "scene_file.h"
+#include "obj_loader.h"
+#include "sampler.h"
+
+// Command line settings shared by the windowed and headless modes
+struct CLIOptions
+{
+	bool headless = false;
+	bool use_cpu = false;
+	bool wavefront = false;
+	bool nee = true;
+	float adaptive_threshold = 0.0f;	// 0 keeps adaptive sampling off
+	SamplerType sampler = SAMPLER_SOBOL;
+	bool show_help = false;
+	bool shader_cache = true;
+	bool scene_cache = true;
+	std::string scene = "cornell_box_metallic";
+	std::string mesh;
+	int width = 800;
+	int height = 450;
+	int spp = 64;
+	int max_bounces = 4;
+	glm::vec3 camera_position = glm::vec3(0.0f, 0.0f, 0.0f);
+	bool camera_set = false;	// --camera given, wins over a scene file's camera
+	float fov = 45.0f;
+	std::string output = "render.ppm";
+	std::string reference;	// PFM to measure the headless render's error against as it converges
+	std::string rmse_csv;
+	std::string profile_csv;	// viewer: per-pass GPU times written on exit
+	bool ray_stats = false;
+	std::string batch;	// headless: one set of options per line, each rendered in turn
+};
+
+inline void print_usage(const char* program)
+{
+	std::clog << std::format("Usage: {} [options] [mesh.obj]\n", program)
+		<< "  --headless          render to a file without opening a window, then exit\n"
+		<< "  --cpu               use the CPU backend instead of the compute shader\n"
+		<< "  --wavefront         use the multi-kernel wavefront pipeline instead of the megakernel\n"
+		<< "  --no-nee            don't sample lights directly, only count emission that bounces hit\n"
+		<< "  --adaptive <err>    only sample pixels whose relative standard error is above err (e.g. 0.02),\n"
+		<< "                      headless renders stop early once every pixel is below it\n"
+		<< "  --sampler <name>    sobol (default), bluenoise or pcg for white noise\n"
+		<< "  --scene <name>      default, cornell_box_diffuse, cornell_box_metallic, cornell_box_glass from scenes/,\n"
+		<< "                      or any .json scene file, whose camera is used unless --camera is given\n"
+		<< "  --mesh <path>       OBJ mesh placed on the floor of the scene\n"
+		<< "  --width <px>        image width (default 800)\n"
+		<< "  --height <px>       image height (default 450)\n"
+		<< "  --spp <n>           samples per pixel to render in headless mode (default 64)\n"
+		<< "  --bounces <n>       bounce limit (default 4)\n"
+		<< "  --camera <x,y,z>    camera position (default 0,0,0)\n"
+		<< "  --output <path>     .ppm for a tone-mapped image, .pfm for linear HDR (default render.ppm)\n"
+		<< "  --reference <path>  headless: log the RMSE against this PFM at every power of two samples\n"
+		<< "  --rmse-csv <path>   headless: also write those measurements as samples,seconds,rmse rows\n"
+		<< "  --batch <path>      headless: render every line of path, each holding options like these\n"
+		<< "                      on top of the ones given here, numbering the outputs of lines without one\n"
+		<< "  --ray-stats         count rays in the GPU kernels and report rays/s, costs some speed\n"
+		<< "  --profile <path>    viewer: write the GPU profiler's per-pass history to this CSV on exit\n"
+		<< "  --no-shader-cache   always compile shaders instead of reusing binaries in shader_cache/\n"
+		<< "  --no-scene-cache    always build the scene and its BVH instead of mapping scene_cache/\n"
+		<< "  --help              show this message" << std::endl;
+}
+
+// Returns false on malformed arguments, after reporting which one
+inline bool parse_cli(int argc, char** argv, CLIOptions& opts)
+{
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (std::strcmp(arg, "--headless") == 0)
+			opts.headless = true;
+		else if (std::strcmp(arg, "--cpu") == 0)
+			opts.use_cpu = true;
+		else if (std::strcmp(arg, "--wavefront") == 0)
+			opts.wavefront = true;
+		else if (std::strcmp(arg, "--no-nee") == 0)
+			opts.nee = false;
+		else if (std::strcmp(arg, "--ray-stats") == 0)
+			opts.ray_stats = true;
+		else if (std::strcmp(arg, "--no-shader-cache") == 0)
+			opts.shader_cache = false;
+		else if (std::strcmp(arg, "--no-scene-cache") == 0)
+			opts.scene_cache = false;
+		else if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0)
+			opts.show_help = true;
+		else if (std::strcmp(arg, "--scene") == 0 && has_value)
+			opts.scene = argv[++i];
+		else if (std::strcmp(arg, "--mesh") == 0 && has_value)
+			opts.mesh = argv[++i];
+		else if (std::strcmp(arg, "--output") == 0 && has_value)
+			opts.output = argv[++i];
+		else if (std::strcmp(arg, "--reference") == 0 && has_value)
+			opts.reference = argv[++i];
+		else if (std::strcmp(arg, "--rmse-csv") == 0 && has_value)
+			opts.rmse_csv = argv[++i];
+		else if (std::strcmp(arg, "--profile") == 0 && has_value)
+			opts.profile_csv = argv[++i];
+		else if (std::strcmp(arg, "--batch") == 0 && has_value)
+			opts.batch = argv[++i];
+		else if (std::strcmp(arg, "--sampler") == 0 && has_value) {
+			if (!sampler_by_name(argv[++i], opts.sampler)) {
+				std::cerr << std::format("ERROR::CLI::UNKNOWN_SAMPLER '{}'", argv[i]) << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(arg, "--width") == 0 && has_value)
+			opts.width = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--height") == 0 && has_value)
+			opts.height = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--spp") == 0 && has_value)
+			opts.spp = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--adaptive") == 0 && has_value)
+			opts.adaptive_threshold = (float)std::atof(argv[++i]);
+		else if (std::strcmp(arg, "--bounces") == 0 && has_value)
+			opts.max_bounces = std::atoi(argv[++i]);
+		else if (std::strcmp(arg, "--camera") == 0 && has_value) {
+			glm::vec3& p = opts.camera_position;
+			if (std::sscanf(argv[++i], "%f,%f,%f", &p.x, &p.y, &p.z) != 3) {
+				std::cerr << std::format("ERROR::CLI::INVALID_CAMERA '{}', expected x,y,z", argv[i]) << std::endl;
+				return false;
+			}
+			opts.camera_set = true;
+		}
+		else if (arg[0] != '-' && opts.mesh.empty())
+			opts.mesh = arg;
+		else {
+			std::cerr << std::format("ERROR::CLI::UNKNOWN_ARGUMENT '{}'", arg) << std::endl;
+			return false;
+		}
+	}
+
+	if (opts.width <= 0 || opts.height <= 0 || opts.spp <= 0 || opts.max_bounces < 0 || opts.adaptive_threshold < 0.0f) {
+		std::cerr << std::format("ERROR::CLI::INVALID_VALUE {}x{}, {} spp, {} bounces, adaptive {}",
+			opts.width, opts.height, opts.spp, opts.max_bounces, opts.adaptive_threshold) << std::endl;
+		return false;
+	}
+
+	// Only the JSON is read here, the scene itself is built later
+	SceneFile file;
+	if (!parse_scene_file(scene_file_path(opts.scene), file))
+		return false;
+	if (file.has_camera_position && !opts.camera_set)
+		opts.camera_position = file.camera_position;
+	if (file.has_fov)
+		opts.fov = file.fov;
+	return true;
+}
+
+// Where build_cli_scene places the mesh, part of the scene cache's key
+const glm::vec3 CLI_MESH_BASE = glm::vec3(0.0f, 0.0f, -1.2f);
+const float CLI_MESH_SIZE = 0.8f;
+const glm::vec3 CLI_MESH_ALBEDO = glm::vec3(0.8f, 0.8f, 0.8f);
+
+// Builds the scene file plus the optional mesh, same placement in both modes
+inline bool build_cli_scene(const CLIOptions& opts, SceneData& scene)
+{
+	SceneFile file;
+	if (!parse_scene_file(scene_file_path(opts.scene), file) || !build_scene_file(file, scene))
+		return false;
+
+	if (!opts.mesh.empty()) {
+		Mesh mesh;
+		OBJLoadStats load_stats;
+		if (!load_obj(opts.mesh.c_str(), mesh, &load_stats))
+			return false;
+		load_stats.print(opts.mesh.c_str());
+		Material mesh_material = default_material();
+		mesh_material.albedo = CLI_MESH_ALBEDO;
+		add_mesh(scene, mesh, mesh_material, fit_mesh_transform(mesh, CLI_MESH_BASE, CLI_MESH_SIZE));
+	}
+	return true;
+}
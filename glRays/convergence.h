@@ -0,0 +1,73 @@
+#pragma once
+
+// When the viewer considers the image finished and stops tracing until the camera or settings change
+enum ConvergenceMode
+{
+	CONVERGE_NEVER = 0,		// keep accumulating forever
+	CONVERGE_SAMPLES = 1,	// after a number of samples per pixel
+	CONVERGE_NOISE = 2,		// once adaptive sampling has every pixel below its error threshold, capped by the sample count
+	CONVERGE_TIME = 3,		// after a number of seconds spent tracing
+	CONVERGE_MODE_COUNT
+};
+
+inline const char* convergence_mode_name(int mode)
+{
+	switch (mode) {
+	case CONVERGE_NEVER: return "Never";
+	case CONVERGE_SAMPLES: return "Sample count";
+	case CONVERGE_NOISE: return "Noise threshold";
+	case CONVERGE_TIME: return "Time budget";
+	default: return "Unknown";
+	}
+}
+
+struct ConvergencePolicy
+{
+	int mode = CONVERGE_SAMPLES;
+	int max_samples = 4096;
+	float time_budget = 60.0f;
+};
+
+// Frames, samples and tracing time accumulated since the image was last reset
+class ConvergenceTracker
+{
+	int frames = 0;
+	int samples = 0;
+	float seconds = 0.0f;
+
+public:
+	void reset()
+	{
+		frames = 0;
+		samples = 0;
+		seconds = 0.0f;
+	}
+
+	void add_frame(int samples_per_pixel)
+	{
+		frames++;
+		samples += samples_per_pixel;
+	}
+
+	// Wall time of a displayed frame that traced, however many frames it accumulated
+	void add_time(float frame_seconds) { seconds += frame_seconds; }
+
+	int get_frames() const { return frames; }
+	int get_samples() const { return samples; }
+	float get_seconds() const { return seconds; }
+
+	// noise_converged is the adaptive sampler's verdict, which also ends tracing under any other policy since
+	// there is nothing left for it to dispatch. Without adaptive sampling, as on the CPU backend, nothing
+	// measures the noise and the noise policy stops at the sample count instead of never.
+	bool reached(const ConvergencePolicy& policy, bool noise_converged) const
+	{
+		if (noise_converged)
+			return true;
+		switch (policy.mode) {
+		case CONVERGE_SAMPLES:
+		case CONVERGE_NOISE: return samples >= policy.max_samples;
+		case CONVERGE_TIME: return seconds >= policy.time_budget;
+		default: return false;
+		}
+	}
+};
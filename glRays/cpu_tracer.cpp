@@ -0,0 +1,670 @@
+#include "cpu_tracer.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+// Straight port of compute.glsl, kept line-for-line close to the shader so the two are easy to diff.
+// Function argument evaluation order is unspecified in C++ (left to right in GLSL),
+// so random numbers are always drawn into locals first to consume the sequence in the same order.
+namespace
+{
+	const float PI = 3.1415926535897932385f;
+
+	struct Ray
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+	};
+
+	struct HitInfo
+	{
+		int material;
+		uint32_t prim;	// BVH prim ref of the surface that was hit
+		glm::vec3 point;
+		glm::vec3 normal;
+		float dist;
+		bool collided;
+		bool from_inside;
+	};
+
+	/*
+		Utility functions
+	*/
+
+	// sampler.glsl's state: the PCG stream or the next dimension, the current bounce's first dimension and
+	// the sample it belongs to
+	struct SampleState
+	{
+		uint32_t rng_state = 0u;
+		uint32_t bounce_dims = SAMPLER_CAMERA_DIMS;
+		uint32_t index = 0u;
+		glm::ivec2 pixel = glm::ivec2(0);
+		SamplerType sampler = SAMPLER_SOBOL;
+	};
+
+	void sampler_begin(SampleState& sample, int x, int y, int w, int h, uint32_t index, int frame_count, int rays_per_pixel)
+	{
+		sample.pixel = glm::ivec2(x, y);
+		sample.index = index;
+		// Same seed as the shader, int overflow there wraps just like unsigned arithmetic here
+		if (sample.sampler != SAMPLER_PCG)
+			sample.rng_state = 0u;
+		else if (index % (uint32_t)rays_per_pixel == 0u)
+			sample.rng_state = (uint32_t)y * (uint32_t)w * (uint32_t)h + (uint32_t)x + (uint32_t)frame_count * 719393u;
+	}
+
+	void sampler_bounce(SampleState& sample, int bounce)
+	{
+		sample.bounce_dims = SAMPLER_CAMERA_DIMS + (uint32_t)bounce * SAMPLER_BOUNCE_DIMS;
+		if (sample.sampler != SAMPLER_PCG)
+			sample.rng_state = sample.bounce_dims;
+	}
+
+	void sampler_bounce_dim(SampleState& sample, uint32_t dim)
+	{
+		if (sample.sampler != SAMPLER_PCG)
+			sample.rng_state = sample.bounce_dims + dim;
+	}
+
+	float rand(SampleState& sample)
+	{
+		if (sample.sampler == SAMPLER_PCG) {
+			uint32_t& rng_state = sample.rng_state;
+			rng_state = rng_state * 747796405u + 2891336453u;
+			uint32_t result = ((rng_state >> ((rng_state >> 28) + 4)) ^ rng_state) * 277803737u;
+			result = (result >> 22) ^ result;
+			return result / 4294967295.0f;
+		}
+
+		uint32_t dim = sample.rng_state++;
+		uint32_t seed = 0u, rotation = 0u;
+		if (sample.sampler == SAMPLER_SOBOL) {
+			seed = hash_uint((uint32_t)sample.pixel.y * 65536u + (uint32_t)sample.pixel.x);
+		} else {
+			uint32_t px = ((uint32_t)sample.pixel.x + dim * 47u) % (uint32_t)BLUE_NOISE_SIZE;
+			uint32_t py = ((uint32_t)sample.pixel.y + dim * 29u) % (uint32_t)BLUE_NOISE_SIZE;
+			rotation = blue_noise_tile()[py * BLUE_NOISE_SIZE + px];
+		}
+		return uint_to_unit_float(shuffled_scrambled_sobol(sample.index, dim, seed) + rotation);
+	}
+
+	glm::vec3 random_direction(SampleState& sample)
+	{
+		float z = 1.0f - 2.0f * rand(sample);
+		float phi = 2.0f * PI * rand(sample);
+		float r = std::sqrt(glm::max(0.0f, 1.0f - z * z));
+		return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+	}
+
+	glm::vec3 random_direction_hemisphere_cos(glm::vec3 normal, SampleState& sample)
+	{
+		return glm::normalize(normal + random_direction(sample));
+	}
+
+	glm::vec3 random_in_unit_disc(SampleState& sample)
+	{
+		float angle = rand(sample) * 2 * PI;
+		glm::vec3 point = glm::vec3(std::cos(angle), std::sin(angle), 0.0f);
+		return point * std::sqrt(rand(sample));
+	}
+
+	/*
+		Ray tracing related functions
+	*/
+
+	// Schlick Fresnel approximation
+	float fresnel_reflect_amount(float n1, float n2, glm::vec3 normal, glm::vec3 incident, float f0, float f90)
+	{
+		float r0 = (n1 - n2) / (n1 + n2);
+		r0 *= r0;
+		float cos_x = -glm::dot(normal, incident);
+		if (n1 > n2) {
+			float n = n1 / n2;
+			float sin_t2 = n * n * (1.0f - cos_x * cos_x);
+			if (sin_t2 > 1.0f)
+				return f90;
+			cos_x = std::sqrt(1.0f - sin_t2);
+		}
+		float x = 1.0f - cos_x;
+		float ret = r0 + (1.0f - r0) * std::pow(x, 5.0f);
+
+		return glm::mix(f0, f90, ret);
+	}
+
+	HitInfo hit_triangle(const SceneData& scene, const Triangle& tri, const Ray& ray)
+	{
+		HitInfo hit;
+		hit.collided = false;
+		hit.from_inside = false;
+
+		const Vertex& A = scene.vertices[tri.v0];
+		const Vertex& B = scene.vertices[tri.v1];
+		const Vertex& C = scene.vertices[tri.v2];
+
+		glm::vec3 AB = B.position - A.position;
+		glm::vec3 AC = C.position - A.position;
+		glm::vec3 normal = glm::cross(AB, AC);
+		float det = -glm::dot(ray.direction, normal);
+		float invdet = 1.0f / det;
+		glm::vec3 AO = ray.origin - A.position;
+		glm::vec3 DAO = glm::cross(AO, ray.direction);
+		float u = glm::dot(AC, DAO) * invdet;
+		float v = -glm::dot(AB, DAO) * invdet;
+		float w = 1 - u - v;
+		float t = glm::dot(AO, normal) * invdet;
+
+		bool did_hit = (det >= 1e-6f && t >= 0.0f && u >= 0.0f && v >= 0.0f && (u + v) <= 1.0f);
+
+		glm::vec3 shading_normal = A.normal * w + B.normal * u + C.normal * v;
+		hit.collided = did_hit;
+		hit.point = ray.origin + ray.direction * t;
+		hit.normal = glm::dot(shading_normal, shading_normal) > 0.0f ? glm::normalize(shading_normal) : glm::normalize(normal);
+		hit.dist = t;
+		return hit;
+	}
+
+	HitInfo hit_sphere(glm::vec3 centre, float radius, float t_min, float t_max, const Ray& ray)
+	{
+		HitInfo hit;
+		hit.collided = false;
+		hit.from_inside = false;
+
+		glm::vec3 oc = centre - ray.origin;
+		float a = glm::dot(ray.direction, ray.direction);
+		float h = glm::dot(ray.direction, oc);
+		float c = glm::dot(oc, oc) - radius * radius;
+
+		float discriminant = h * h - a * c;
+
+		if (discriminant < 0.0f)
+			return hit; // missed
+
+		// Try to find a root within interval (t_min, t_max)
+		float root = (h - std::sqrt(discriminant)) / a;
+		if (root <= t_min || t_max <= root) {
+			root = (h + std::sqrt(discriminant)) / a;
+			if (root <= t_min || t_max <= root)
+				return hit; // outside of acceptable range for t
+		}
+
+		hit.collided = true;
+		hit.dist = root;
+		hit.point = ray.origin + ray.direction * root;
+		hit.normal = (hit.point - centre) / radius;
+		hit.from_inside = glm::dot(ray.direction, hit.normal) > 0.001f;
+		hit.normal = hit.from_inside ? -hit.normal : hit.normal;
+
+		return hit;
+	}
+
+	struct TraceContext
+	{
+		const SceneData& scene;
+		const BVH& bvh;
+		const PrimitiveSoA& prims;
+		const SIMDKernels& kernels;
+		const LightBVH& lights;
+	};
+
+	// Full hit record for the primitive the wide kernels picked, using the exact tests from the shader
+	HitInfo resolve_hit(const TraceContext& ctx, int slot, int instance, const Ray& ray)
+	{
+		HitInfo hit;
+		hit.collided = false;
+		if (slot < 0)
+			return hit;
+
+		uint32_t prim = ctx.bvh.prim_indices[slot];
+		if (instance >= 0) {
+			// Tested in the mesh's space like hit_instance(), then brought back to world space
+			const BVHInstance& inst = ctx.bvh.instances[instance];
+			Ray local;
+			glm::vec4 o = glm::vec4(ray.origin, 1.0f), d = glm::vec4(ray.direction, 0.0f);
+			local.origin = glm::vec3(glm::dot(inst.world_to_object[0], o), glm::dot(inst.world_to_object[1], o), glm::dot(inst.world_to_object[2], o));
+			local.direction = glm::vec3(glm::dot(inst.world_to_object[0], d), glm::dot(inst.world_to_object[1], d), glm::dot(inst.world_to_object[2], d));
+			hit = hit_triangle(ctx.scene, ctx.scene.triangles[prim & ~BVH_TRIANGLE_BIT], local);
+			glm::vec3 n = hit.normal;
+			hit.point = ray.origin + ray.direction * hit.dist;
+			hit.normal = glm::normalize(glm::vec3(inst.world_to_object[0]) * n.x + glm::vec3(inst.world_to_object[1]) * n.y + glm::vec3(inst.world_to_object[2]) * n.z);
+			hit.material = inst.material;
+			hit.prim = (uint32_t)instance | BVH_INSTANCE_BIT;
+		}
+		else if ((prim & BVH_TRIANGLE_BIT) != 0u) {
+			const Triangle& tri = ctx.scene.triangles[prim & ~BVH_TRIANGLE_BIT];
+			hit = hit_triangle(ctx.scene, tri, ray);
+			hit.material = tri.material;
+			hit.prim = prim;
+		}
+		else {
+			const Sphere& sphere = ctx.scene.spheres[prim];
+			hit = hit_sphere(sphere.centre, sphere.radius, 0.001f, INFINITY, ray);
+			hit.material = sphere.material;
+			hit.prim = prim;
+		}
+		return hit;
+	}
+
+	HitInfo ray_collision(const TraceContext& ctx, const Ray& ray)
+	{
+		float t = INFINITY;
+		int instance;
+		int slot = intersect_ray(ctx.kernels, ctx.prims, ctx.bvh, ray.origin, ray.direction, t, &instance);
+		return resolve_hit(ctx, slot, instance, ray);
+	}
+
+	/*
+		Light sampling
+	*/
+
+	int prim_material(const SceneData& scene, uint32_t prim)
+	{
+		return (prim & BVH_TRIANGLE_BIT) != 0u ? scene.triangles[prim & ~BVH_TRIANGLE_BIT].material : scene.spheres[prim].material;
+	}
+
+	// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+	float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b)
+	{
+		return cos_a > cos_b ? 1.0f : cos_a * cos_b + sin_a * sin_b;
+	}
+
+	float sin_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b)
+	{
+		return cos_a > cos_b ? 0.0f : sin_a * cos_b - cos_a * sin_b;
+	}
+
+	// Conservative estimate of how much light a light tree node sends to point: its power over the squared
+	// distance, times the cosine of the smallest angle between the node's emission cone and the direction
+	// to the point, with the node's bounding sphere widening that angle
+	float light_importance(glm::vec3 point, const LightNode& node)
+	{
+		glm::vec3 centre = (node.bounds_min + node.bounds_max) * 0.5f;
+		glm::vec3 half_diagonal = node.bounds_max - centre;
+		float radius2 = glm::dot(half_diagonal, half_diagonal);
+		glm::vec3 to_point = point - centre;
+		float dist2 = glm::max(glm::dot(to_point, to_point), radius2);
+
+		float cos_theta_w = glm::dot(node.axis, to_point) * glm::inversesqrt(glm::max(glm::dot(to_point, to_point), 1e-20f));
+		float sin_theta_w = std::sqrt(glm::max(0.0f, 1.0f - cos_theta_w * cos_theta_w));
+		float sin_theta_o = std::sqrt(glm::max(0.0f, 1.0f - node.cos_theta_o * node.cos_theta_o));
+		// Inside the bounding sphere light can come from anywhere
+		float cos_theta_b = glm::dot(to_point, to_point) < radius2 ? -1.0f : std::sqrt(glm::max(0.0f, 1.0f - radius2 / dist2));
+		float sin_theta_b = std::sqrt(glm::max(0.0f, 1.0f - cos_theta_b * cos_theta_b));
+
+		float cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, node.cos_theta_o);
+		float sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, node.cos_theta_o);
+		float cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+		if (cos_theta_p <= node.cos_theta_e)
+			return 0.0f;
+		return node.power * cos_theta_p / dist2;
+	}
+
+	// Probability of picking child + 1 over child when walking the light tree from point, -1 if neither can light it
+	float light_right_prob(const TraceContext& ctx, glm::vec3 point, int child)
+	{
+		float left = light_importance(point, ctx.lights.nodes[child]);
+		float right = light_importance(point, ctx.lights.nodes[child + 1]);
+		return left + right > 0.0f ? right / (left + right) : -1.0f;
+	}
+
+	// Walks the light tree from the root, picking children in proportion to their importance for point.
+	// u is reused for every decision by rescaling it. Returns the emitter index, or -1 if no light reaches point.
+	int pick_emitter(const TraceContext& ctx, glm::vec3 point, float u, float& pmf)
+	{
+		pmf = 1.0f;
+		int node = 0;
+		while (ctx.lights.nodes[node].child >= 0) {
+			int child = ctx.lights.nodes[node].child;
+			float p_right = light_right_prob(ctx, point, child);
+			if (p_right < 0.0f)
+				return -1;
+			if (u < 1.0f - p_right) {
+				u = glm::min(u / (1.0f - p_right), 0.99999994f);
+				pmf *= 1.0f - p_right;
+				node = child;
+			}
+			else {
+				u = glm::min((u - (1.0f - p_right)) / p_right, 0.99999994f);
+				pmf *= p_right;
+				node = child + 1;
+			}
+		}
+		return -1 - ctx.lights.nodes[node].child;
+	}
+
+	// Probability that pick_emitter() from point returns prim, following its emitter's trail down the tree
+	float emitter_pmf(const TraceContext& ctx, uint32_t prim, glm::vec3 point)
+	{
+		const std::vector<Emitter>& emitters = ctx.lights.emitters;
+		auto it = std::lower_bound(emitters.begin(), emitters.end(), prim, [](const Emitter& e, uint32_t p) { return e.prim < p; });
+		if (it == emitters.end() || it->prim != prim)
+			return 0.0f;
+
+		uint32_t trail = it->trail;
+		float pmf = 1.0f;
+		int node = 0;
+		while (ctx.lights.nodes[node].child >= 0) {
+			int child = ctx.lights.nodes[node].child;
+			float p_right = light_right_prob(ctx, point, child);
+			if (p_right < 0.0f)
+				return 0.0f;
+			bool right = (trail & 1u) != 0u;
+			pmf *= right ? p_right : 1.0f - p_right;
+			node = child + int(right);
+			trail >>= 1;
+		}
+		return pmf;
+	}
+
+	// 1 - cos of the half-angle a sphere of radius r subtends at distance sqrt(d2), without the cancellation
+	float sphere_cone_size(float r, float d2)
+	{
+		float x = r * r / d2;
+		return x / (1.0f + std::sqrt(1.0f - x));
+	}
+
+	// Solid angle density of the direction from point towards light_point on prim, once prim has been picked
+	float emitter_direction_pdf(const TraceContext& ctx, uint32_t prim, glm::vec3 point, glm::vec3 light_point)
+	{
+		if ((prim & BVH_TRIANGLE_BIT) != 0u) {
+			const Triangle& tri = ctx.scene.triangles[prim & ~BVH_TRIANGLE_BIT];
+			glm::vec3 A = ctx.scene.vertices[tri.v0].position;
+			glm::vec3 normal = glm::cross(ctx.scene.vertices[tri.v1].position - A, ctx.scene.vertices[tri.v2].position - A);
+			glm::vec3 to_light = light_point - point;
+			float dist2 = glm::dot(to_light, to_light);
+			float cos_light = std::abs(glm::dot(to_light, normal)) / (std::sqrt(dist2) * glm::length(normal));
+			float area = 0.5f * glm::length(normal);
+			return cos_light > 0.0f ? dist2 / (area * cos_light) : 0.0f;
+		}
+
+		const Sphere& sphere = ctx.scene.spheres[prim];
+		glm::vec3 to_centre = sphere.centre - point;
+		float dist2 = glm::dot(to_centre, to_centre);
+		if (dist2 <= sphere.radius * sphere.radius)
+			return 0.0f;
+		return 1.0f / (2.0f * PI * sphere_cone_size(sphere.radius, dist2));
+	}
+
+	// Solid angle density with which sample_emitter() picks the direction from point towards light_point on prim
+	float emitter_pdf(const TraceContext& ctx, uint32_t prim, glm::vec3 point, glm::vec3 light_point)
+	{
+		float pmf = emitter_pmf(ctx, prim, point);
+		return pmf > 0.0f ? pmf * emitter_direction_pdf(ctx, prim, point, light_point) : 0.0f;
+	}
+
+	void orthonormal_basis(glm::vec3 n, glm::vec3& t, glm::vec3& b)
+	{
+		// Branchless construction from Duff et al. 2017
+		float s = n.z >= 0.0f ? 1.0f : -1.0f;
+		float a = -1.0f / (s + n.z);
+		float c = n.x * n.y * a;
+		t = glm::vec3(1.0f + s * n.x * n.x * a, s * c, -s * n.x);
+		b = glm::vec3(c, s + n.y * n.y * a, -n.y);
+	}
+
+	// Picks an emitter through the light tree, then a direction towards it: uniform over a triangle's
+	// area, uniform over the cone a sphere subtends. Always draws three random numbers.
+	bool sample_emitter(const TraceContext& ctx, glm::vec3 point, glm::vec3& direction, float& pdf, uint32_t& prim, SampleState& sample)
+	{
+		float u_pick = rand(sample);
+		float u1 = rand(sample);
+		float u2 = rand(sample);
+
+		float pmf;
+		int emitter = pick_emitter(ctx, point, u_pick, pmf);
+		if (emitter < 0)
+			return false;
+		prim = ctx.lights.emitters[emitter].prim;
+
+		if ((prim & BVH_TRIANGLE_BIT) != 0u) {
+			const Triangle& tri = ctx.scene.triangles[prim & ~BVH_TRIANGLE_BIT];
+			glm::vec3 A = ctx.scene.vertices[tri.v0].position;
+			glm::vec3 B = ctx.scene.vertices[tri.v1].position;
+			glm::vec3 C = ctx.scene.vertices[tri.v2].position;
+			float su = std::sqrt(u1);
+			glm::vec3 light_point = A * (1.0f - su) + B * (u2 * su) + C * (su - u2 * su);
+			direction = glm::normalize(light_point - point);
+
+			// Triangles are one-sided, only their front face can be hit
+			if (glm::dot(direction, glm::cross(B - A, C - A)) >= 0.0f)
+				return false;
+			pdf = pmf * emitter_direction_pdf(ctx, prim, point, light_point);
+		}
+		else {
+			const Sphere& sphere = ctx.scene.spheres[prim];
+			glm::vec3 to_centre = sphere.centre - point;
+			float dist2 = glm::dot(to_centre, to_centre);
+			if (dist2 <= sphere.radius * sphere.radius)
+				return false;
+
+			float cos_theta = 1.0f - u1 * sphere_cone_size(sphere.radius, dist2);
+			float sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+			float phi = 2.0f * PI * u2;
+			glm::vec3 w = to_centre / std::sqrt(dist2);
+			glm::vec3 t, b;
+			orthonormal_basis(w, t, b);
+			direction = glm::normalize(t * (std::cos(phi) * sin_theta) + b * (std::sin(phi) * sin_theta) + w * cos_theta);
+			pdf = pmf * emitter_direction_pdf(ctx, prim, point, sphere.centre);
+		}
+		return pdf > 0.0f;
+	}
+
+	float power_heuristic(float pdf_a, float pdf_b)
+	{
+		float a2 = pdf_a * pdf_a;
+		return a2 / (a2 + pdf_b * pdf_b);
+	}
+
+	// The first hit comes in from the packet traversal of the camera rays
+	glm::vec3 trace(const TraceContext& ctx, Ray ray, HitInfo first_hit, int max_bounces, bool use_nee, SampleState& sample)
+	{
+		glm::vec3 incoming_light = glm::vec3(0.0f, 0.0f, 0.0f);
+		glm::vec3 ray_colour = glm::vec3(1.0f, 1.0f, 1.0f);
+		float bsdf_pdf = 0.0f;
+		use_nee = use_nee && !ctx.lights.emitters.empty();
+
+		for (int i = 0; i <= max_bounces; i++)
+		{
+			HitInfo hit = i == 0 ? first_hit : ray_collision(ctx, ray);
+			sampler_bounce(sample, i);
+
+			if (hit.collided)
+			{
+				const Material& material = ctx.scene.materials[hit.material];
+
+				// Light sampling could have found this emitter too, so only keep the BSDF sample's share of it
+				float emission_weight = 1.0f;
+				if (bsdf_pdf > 0.0f && material.emission_strength > 0.0f)
+					emission_weight = power_heuristic(bsdf_pdf, emitter_pdf(ctx, hit.prim, ray.origin, hit.point));
+
+				if (hit.from_inside)
+					ray_colour *= glm::exp(-material.refraction_colour * hit.dist);
+
+				// Fresnel reflections
+				float spec_chance = material.specular_chance;
+				float ref_chance = material.refraction_chance;
+				float diff_chance = glm::max(0.0f, 1.0f - spec_chance - ref_chance);
+				float ray_prob = 1.0f;
+				if (spec_chance > 0.0f) {
+					spec_chance = fresnel_reflect_amount(
+						hit.from_inside ? material.refractive_idx : 1.0f,
+						!hit.from_inside ? material.refractive_idx : 1.0f,
+						ray.direction, hit.normal, material.specular_chance, 1.0f
+					);
+					float chance_multiplier = (1.0f - spec_chance) / (1.0f - material.specular_chance);
+					ref_chance *= chance_multiplier;
+					diff_chance *= chance_multiplier;
+				}
+
+				// Determine if we're doing specular reflection, diffuse reflection, or refraction
+				float rng_roll = rand(sample);
+				float is_specular = 0.0f;
+				float is_refract = 0.0f;
+
+				if (spec_chance > 0.0f && rng_roll < spec_chance) {
+					is_specular = 1.0f;
+					ray_prob = spec_chance;
+				}
+				else if (ref_chance > 0.0f && rng_roll < spec_chance + ref_chance) {
+					is_refract = 1.0f;
+					ray_prob = ref_chance;
+				}
+				else {
+					ray_prob = 1.0f - spec_chance - ref_chance;
+				}
+				ray_prob = glm::max(ray_prob, 0.001f); // avoid divide by 0
+
+				// Generate the new bounce ray
+				ray.origin = hit.point;
+				glm::vec3 diffuse_ray_dir = random_direction_hemisphere_cos(hit.normal, sample);
+				glm::vec3 specular_ray_dir = glm::reflect(ray.direction, hit.normal);
+				float ri = hit.from_inside ? material.refractive_idx : 1.0f / material.refractive_idx;
+				glm::vec3 refract_ray_dir = glm::refract(ray.direction, hit.normal, ri);
+				specular_ray_dir = glm::mix(specular_ray_dir, diffuse_ray_dir, material.roughness * material.roughness);
+				refract_ray_dir = glm::mix(refract_ray_dir, -diffuse_ray_dir, material.refraction_roughness * material.refraction_roughness);
+				ray.direction = glm::mix(diffuse_ray_dir, specular_ray_dir, is_specular);
+				ray.direction = glm::mix(ray.direction, refract_ray_dir, is_refract);
+
+				// Next-event estimation on diffuse bounces, none on the last one since its BSDF counterpart is never traced
+				bsdf_pdf = 0.0f;
+				if (use_nee && i < max_bounces && is_specular == 0.0f && is_refract == 0.0f) {
+					glm::vec3 light_dir;
+					float light_pdf;
+					uint32_t light_prim;
+					bool sampled = sample_emitter(ctx, hit.point, light_dir, light_pdf, light_prim, sample);
+					float cos_surface = glm::dot(hit.normal, light_dir);
+					if (sampled && cos_surface > 0.0f) {
+						HitInfo shadow_hit = ray_collision(ctx, { hit.point, light_dir });
+						if (shadow_hit.collided && shadow_hit.prim == light_prim) {
+							const Material& light = ctx.scene.materials[prim_material(ctx.scene, light_prim)];
+							glm::vec3 light_emission = light.emission_colour * light.emission_strength;
+							float weight = power_heuristic(light_pdf, cos_surface / PI);
+							incoming_light += ray_colour / ray_prob * (material.albedo / PI) * light_emission * (cos_surface / light_pdf) * weight;
+						}
+					}
+					bsdf_pdf = glm::max(glm::dot(hit.normal, ray.direction), 0.0f) / PI;
+				}
+
+				glm::vec3 emitted_light = material.emission_colour * material.emission_strength;
+				incoming_light += emitted_light * ray_colour * emission_weight;
+				if (is_refract == 0.0f)
+					ray_colour *= glm::mix(material.albedo, material.specular_colour, is_specular);
+				ray_colour /= ray_prob;
+
+				// Russian Roulette, survival capped at 1
+				float p = glm::min(glm::max(ray_colour.r, glm::max(ray_colour.g, ray_colour.b)), 1.0f);
+				sampler_bounce_dim(sample, SAMPLER_ROULETTE_DIM);
+				if (rand(sample) > p)
+					break;
+				ray_colour *= 1.0f / p;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		return incoming_light;
+	}
+}
+
+CPUTracer::CPUTracer(int width, int height, int n_threads)
+	: w(width), h(height), image(width * height, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)),
+	kernels(simd_kernels(detect_simd_level())), pool(n_threads)
+{
+}
+
+void CPUTracer::set_simd_level(SIMDLevel level)
+{
+	kernels = simd_kernels(level);
+}
+
+void CPUTracer::set_scene(const SceneData& scene_data, const BVH& scene_bvh, const LightBVH& scene_lights)
+{
+	scene = &scene_data;
+	bvh = &scene_bvh;
+	prims.build(scene_data, scene_bvh);
+	lights = &scene_lights;
+}
+
+void CPUTracer::update_scene(const std::vector<int>& moved_spheres, int reordered_slots)
+{
+	prims.repack(*scene, *bvh, 0, reordered_slots);
+	prims.update_spheres(*scene, moved_spheres);
+}
+
+void CPUTracer::render_tile(int tile, const CPURenderParams& params)
+{
+	int tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+	int x0 = (tile % tiles_x) * TILE_SIZE;
+	int y0 = (tile / tiles_x) * TILE_SIZE;
+	int x1 = std::min(x0 + TILE_SIZE, w);
+	int y1 = std::min(y0 + TILE_SIZE, h);
+
+	TraceContext ctx = { *scene, *bvh, prims, kernels, *lights };
+	float aspect_ratio = float(w) / float(h);
+	float tan_half_fov = std::tan(params.fov / 2 * PI / 180);
+	glm::vec3 cam_origin = glm::vec3(params.camera_to_world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+	// Camera rays of neighbouring pixels in a row go through the BVH together as one packet,
+	// every pixel keeps its own sampler state so the random numbers match the shader's
+	for (int y = y0; y < y1; y++) {
+		for (int px = x0; px < x1; px += PACKET_SIZE) {
+			int n_lanes = std::min(PACKET_SIZE, x1 - px);
+			SampleState samples[PACKET_SIZE];
+			glm::vec3 total_light[PACKET_SIZE];
+			for (int lane = 0; lane < n_lanes; lane++) {
+				int x = px + lane;
+				if (params.camera_moved)
+					image[y * w + x] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+				samples[lane].sampler = params.sampler;
+				total_light[lane] = glm::vec3(0.0f);
+			}
+
+			for (int i = 0; i < params.rays_per_pixel; i++) {
+				Ray rays[PACKET_SIZE];
+				RayPacket packet;
+				for (int lane = 0; lane < n_lanes; lane++) {
+					int x = px + lane;
+					sampler_begin(samples[lane], x, y, w, h, (uint32_t)(params.frame_count * params.rays_per_pixel + i), params.frame_count, params.rays_per_pixel);
+					float jitter_x = rand(samples[lane]);
+					float jitter_y = rand(samples[lane]);
+					glm::vec3 pixel_camera = glm::vec3(
+						(2 * ((float(x) + jitter_x) / w) - 1) * tan_half_fov * aspect_ratio,
+						(2 * ((float(y) + jitter_y) / h) - 1) * tan_half_fov,
+						-params.focus_distance
+					);
+
+					glm::vec3 jitter = random_in_unit_disc(samples[lane]) * params.defocus_strength;
+					glm::vec3 ray_origin = cam_origin + jitter;
+					glm::vec3 P_world = glm::vec3(params.camera_to_world * glm::vec4(pixel_camera, 1.0f));
+					rays[lane] = { ray_origin, glm::normalize(P_world - ray_origin) };
+					packet.set_ray(lane, rays[lane].origin, rays[lane].direction);
+				}
+
+				intersect_packet(kernels, prims, *bvh, packet);
+				for (int lane = 0; lane < n_lanes; lane++) {
+					HitInfo first_hit = resolve_hit(ctx, packet.slot[lane], packet.instance[lane], rays[lane]);
+					total_light[lane] += trace(ctx, rays[lane], first_hit, params.max_bounces, params.use_nee, samples[lane]);
+				}
+			}
+
+			for (int lane = 0; lane < n_lanes; lane++) {
+				glm::vec4& accumulated_colour = image[y * w + px + lane];
+				glm::vec3 pixel_light = total_light[lane] / float(params.rays_per_pixel);
+				float weight = 1.0f / float(params.frame_count + 1);
+				accumulated_colour = glm::vec4(glm::mix(glm::vec3(accumulated_colour), pixel_light, weight), 1.0f);
+			}
+		}
+	}
+}
+
+void CPUTracer::render_frame(const CPURenderParams& params)
+{
+	if (!scene || !bvh || !lights)
+		return;
+
+	int tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+	int tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
+	pool.parallel_for(tiles_x * tiles_y, [&](int tile) { render_tile(tile, params); });
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene.h"
+#include "bvh.h"
+#include "thread_pool.h"
+#include "simd.h"
+#include "lights.h"
+#include "sampler.h"
+
+// Mirrors the compute shader's per-frame uniforms
+struct CPURenderParams
+{
+	glm::mat4 camera_to_world = glm::mat4(1.0f);
+	float fov = 45.0f;
+	float focus_distance = 1.0f;
+	float defocus_strength = 0.0f;
+	int frame_count = 0;
+	bool camera_moved = false;
+	int max_bounces = 4;
+	int rays_per_pixel = 1;
+	bool use_nee = true;
+	SamplerType sampler = SAMPLER_SOBOL;
+};
+
+// Reference path tracer implementing the same trace() / ray_collision() as compute.glsl.
+// Used as a fallback on machines without a GPU and as an oracle for the shader.
+class CPUTracer
+{
+	int w;
+	int h;
+	std::vector<glm::vec4> image;
+
+	const SceneData* scene = nullptr;
+	const BVH* bvh = nullptr;
+	PrimitiveSoA prims;
+	const LightBVH* lights = nullptr;
+	SIMDKernels kernels;
+	ThreadPool pool;
+
+	void render_tile(int tile, const CPURenderParams& params);
+
+public:
+	static const int TILE_SIZE = 16;
+
+	CPUTracer(int width, int height, int n_threads = 0);
+
+	int width() const { return this->w; }
+	int height() const { return this->h; }
+	int n_threads() const { return pool.size(); }
+	// Free between render_frame() calls, for other work on the scene
+	ThreadPool& thread_pool() { return pool; }
+	SIMDLevel simd_level() const { return kernels.level; }
+
+	// Defaults to the widest level the CPU supports
+	void set_simd_level(SIMDLevel level);
+
+	// Same accumulation layout as the GPU's img_output: rows bottom to top, RGBA
+	const std::vector<glm::vec4>& pixels() const { return image; }
+
+	// The scene, BVH and light tree are referenced, not copied, and must outlive the tracer's use of them
+	void set_scene(const SceneData& scene_data, const BVH& scene_bvh, const LightBVH& scene_lights);
+	// After the scene's spheres moved and the BVH reordered its first reordered_slots slots, in place.
+	// Much cheaper than set_scene(), which packs every slot including all the meshes' triangles.
+	void update_scene(const std::vector<int>& moved_spheres, int reordered_slots);
+	void render_frame(const CPURenderParams& params);
+};
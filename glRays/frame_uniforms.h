@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "gl_buffer.h"
+#include "sampler.h"
+
+// Mirrors the std140 FrameUniforms block in path_tracing.glsl, member for member
+struct FrameUniforms
+{
+	glm::mat4 camera_to_world = glm::mat4(1.0f);
+	int frame_count = 0;
+	int camera_moved = 0;	// GLSL bool, 4 bytes in std140
+	float fov = 45.0f;
+	float cam_focus_distance = 1.0f;
+	float cam_defocus_strength = 0.0f;
+	int max_bounces = 4;
+	int rays_per_pixel = 1;
+	int emitter_count = 0;
+	int use_nee = 1;	// GLSL bool
+	int adaptive = 0;	// GLSL bool
+	float adaptive_threshold = 0.02f;	// standard error relative to the pixel's luminance
+	int adaptive_min_samples = 16;	// frames before a pixel may stop, so a lucky dark run can't stop it early
+	int sampler = SAMPLER_SOBOL;
+	int padding[3] = {};
+};
+static_assert(sizeof(FrameUniforms) == 128, "FrameUniforms must match the std140 layout in path_tracing.glsl");
+
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+// The whole block goes up in one upload per frame instead of a uniform call per parameter
+class FrameUniformBuffer
+{
+	GLBuffer buffer = GLBuffer(GL_UNIFORM_BUFFER);
+
+public:
+	FrameUniformBuffer()
+	{
+		buffer.create_buffer();
+	}
+
+	void upload(const FrameUniforms& frame)
+	{
+		buffer.upload(&frame, sizeof(FrameUniforms));
+		buffer.bind_base(FRAME_UNIFORMS_BINDING);
+	}
+};
@@ -1,5 +1,6 @@
 ﻿#include <iostream>
 #include <chrono>
+#include <algorithm>
 
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
@@ -9,17 +10,38 @@
 #include <imgui_impl_opengl3.h>
 
 #include "gl_texture.h"
+#include "scene_buffers.h"
+#include "scene_cache.h"
+#include "scene_reload.h"
+#include "scene_animation.h"
 #include "camera.h"
 #include "shader.h"
+#include "workgroup.h"
+#include "frame_uniforms.h"
+#include "wavefront.h"
+#include "adaptive.h"
+#include "convergence.h"
+#include "scheduler.h"
+#include "profiler.h"
+#include "ray_stats.h"
 #include "scene.h"
+#include "bvh.h"
+#include "lights.h"
+#include "cpu_tracer.h"
 #include "options.h"
+#include "cli.h"
+#include "headless.h"
 
-const int WIDTH = 800, HEIGHT = 450;
 int window_width, window_height;
 int frame_count = 0;
 float delta_time = 0.0f;
 float last_frame = 0.0f;
 
+// Frames drawn after input wakes an idle viewer before it blocks again
+const int IDLE_SETTLE_FRAMES = 3;
+// Upper bound on accumulation frames dispatched per displayed frame, whatever the time budget allows
+const int MAX_DISPATCHES_PER_FRAME = 64;
+
 static void error_callback(int error_code, const char* description)
 {
 	std::cerr << "ERROR:GLFW::" << error_code << " -- " << description << std::endl;
@@ -58,8 +80,27 @@ static void mouse_button_callback(GLFWwindow* window, int button, int action, in
 		handler->mouse_button_event(window, button, action, mods);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	CLIOptions cli;
+	if (!parse_cli(argc, argv, cli) || cli.show_help) {
+		print_usage(argv[0]);
+		return cli.show_help ? 0 : -1;
+	}
+
+	if (!cli.shader_cache)
+		ShaderProgram::binary_cache_dir.clear();
+	if (!cli.scene_cache)
+		SceneCache::cache_dir.clear();
+
+	// Batch rendering never touches GLFW or ImGui
+	if (!cli.batch.empty())
+		return run_batch(cli);
+	if (cli.headless)
+		return run_headless(cli);
+
+	const int WIDTH = cli.width, HEIGHT = cli.height;
+
 	// Init GLFW
 	GLFWwindow* window;
 	if (!glfwInit())
@@ -142,43 +183,133 @@ int main()
 	Camera cam = Camera(window, io);
 
 
-	// Compile shaders
-	ShaderProgram compute_shader = ShaderProgram();
-	compute_shader.attach("compute.glsl", GL_COMPUTE_SHADER);
-	compute_shader.link();
-
+	// Compile shaders, the compute shader waits until the scene is uploaded so it can be tuned
 	ShaderProgram quad_shader = ShaderProgram();
 	quad_shader.attach("vertex.glsl", GL_VERTEX_SHADER);
 	quad_shader.attach("fragment.glsl", GL_FRAGMENT_SHADER);
 	quad_shader.link();
 
 
-	// Set up sphere buffer
-	unsigned int sphere_ubo;
-	SceneData scene_data = cornell_box_metallic();
-	glGenBuffers(1, &sphere_ubo);
-	glBindBuffer(GL_UNIFORM_BUFFER, sphere_ubo);
-	glBufferData(GL_UNIFORM_BUFFER, scene_data.size, scene_data.objects, GL_STATIC_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	// Set up scene buffers, sized at runtime from the scene contents
+	SceneData scene_data;
+	BVH bvh;
+	LightBVH lights;
+	SceneCache scene_cache;
+	if (!load_cli_scene(cli, scene_data, bvh, lights, scene_cache))
+		return -1;
+	// The CPU backend can be switched to at any time, so it needs its own copy either way
+	if (scene_cache.is_open())
+		scene_cache.extract(scene_data, bvh, lights);
+
+	CPUTracer cpu_tracer = CPUTracer(WIDTH, HEIGHT);
+	cpu_tracer.set_scene(scene_data, bvh, lights);
+	std::clog << std::format("CPU tracer using {} threads, {} kernels", cpu_tracer.n_threads(), simd_level_name(cpu_tracer.simd_level())) << std::endl;
 
-	glUniformBlockBinding(compute_shader.id, sphere_ubo, 2);
-	glBindBufferBase(GL_UNIFORM_BUFFER, 2, sphere_ubo);
+	SceneBuffers scene_buffers;
+	if (scene_cache.is_open())
+		scene_buffers.upload(scene_cache);
+	else
+		scene_buffers.upload(scene_data, bvh, lights);
 
 
+	cam.set_position(cli.camera_position);
+	cam.set_fov(cli.fov);
 	Options options_obj = Options(cam);
+	options_obj.camera_fov = cli.fov;
+	options_obj.rt_use_cpu = cli.use_cpu;
+	options_obj.rt_use_wavefront = cli.wavefront;
+	options_obj.rt_use_nee = cli.nee;
+	options_obj.rt_sampler = cli.sampler;
+	options_obj.rt_adaptive = cli.adaptive_threshold > 0.0f;
+	if (options_obj.rt_adaptive)
+		options_obj.rt_adaptive_threshold = cli.adaptive_threshold;
+	options_obj.image_pixels = WIDTH * HEIGHT;
+	options_obj.rt_max_bounces = cli.max_bounces;
+
+	FrameUniformBuffer frame_uniforms;
+	auto upload_frame_uniforms = [&](int frame_count, bool camera_moved) {
+		FrameUniforms frame;
+		frame.camera_to_world = cam.get_camera_to_world();
+		frame.frame_count = frame_count;
+		frame.camera_moved = camera_moved;
+		frame.fov = options_obj.camera_fov;
+		frame.cam_focus_distance = cam.get_focus_distance();
+		frame.cam_defocus_strength = cam.get_defocus_strength();
+		frame.max_bounces = options_obj.rt_max_bounces;
+		frame.rays_per_pixel = options_obj.rt_rays_per_pixel;
+		frame.emitter_count = scene_buffers.emitter_count;
+		frame.use_nee = options_obj.rt_use_nee;
+		frame.sampler = options_obj.rt_sampler;
+		frame.adaptive = options_obj.rt_adaptive;
+		frame.adaptive_threshold = options_obj.rt_adaptive_threshold;
+		frame.adaptive_min_samples = options_obj.rt_adaptive_min_samples;
+		frame_uniforms.upload(frame);
+	};
+
+	// Time a few workgroup shapes on this GPU at this resolution and build the kernel with the fastest
+	AdaptiveSampler sampler = AdaptiveSampler(WIDTH, HEIGHT);
+	upload_frame_uniforms(0, true);
+	WorkgroupSize workgroup = autotune_workgroup_size("compute.glsl", WIDTH, HEIGHT);
+	sampler.set_workgroup(workgroup);
+	RayStats ray_stats = RayStats(cli.ray_stats);
+	ShaderProgram compute_shader = ShaderProgram();
+	compute_shader.attach("compute.glsl", GL_COMPUTE_SHADER, workgroup.defines() + ray_stats.defines());
+	compute_shader.link();
+	options_obj.total_tiles = sampler.total_tiles();
+	options_obj.ray_stats = &ray_stats;
+	WavefrontTracer wavefront = WavefrontTracer(WIDTH, HEIGHT, workgroup, ray_stats.defines());
+
+	ConvergenceTracker convergence;
+	DispatchScheduler scheduler;
+
+	// The path tracing batch is timed by the scheduler, the frame by the CPU for comparison
+	GPUProfiler profiler;
+	const int PASS_TRACE = profiler.add_pass("Path tracing");
+	const int PASS_BLIT = profiler.add_pass("Blit");
+	const int PASS_IMGUI = profiler.add_pass("ImGui");
+	const int PASS_FRAME = profiler.add_pass("Frame (CPU)");
+	if (!cli.profile_csv.empty())
+		profiler.csv_path = cli.profile_csv;
+	options_obj.profiler = &profiler;
+
+	// Edits to a scene file or its meshes are picked up while the viewer runs, the camera stays where it is
+	FileWatcher scene_watcher;
+	scene_watcher.watch(cli_scene_sources(cli));
+
+	// Orbiting objects move every frame, their BVH is refit and rebuilt in the background when it degrades
+	SceneAnimator animator(&cpu_tracer.thread_pool());
+	options_obj.animator = &animator;
+
+	bool idle = false;
+	int settle_frames = 0;
+
 	auto start = std::chrono::steady_clock::now();
 
 	// Main loop
 	while (!glfwWindowShouldClose(window)) {
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		// Process input
-		glfwPollEvents();
+		// Process input. Once the image is finished there's nothing to redraw, so block until something
+		// happens, then give ImGui a few frames to settle hover and click states before blocking again.
+		if (idle && settle_frames == 0) {
+			if (scene_watcher.empty())
+				glfwWaitEvents();
+			else
+				glfwWaitEventsTimeout(SCENE_WATCH_INTERVAL);
+			settle_frames = IDLE_SETTLE_FRAMES;
+			// The wait isn't frame time, the camera would jump by all of it
+			start = std::chrono::steady_clock::now();
+		}
+		else
+			glfwPollEvents();
+		settle_frames = std::max(settle_frames - 1, 0);
 		{
 			auto end = std::chrono::steady_clock::now();
 			const std::chrono::duration<float> diff = end - start;
 			delta_time = diff.count();
 			start = end;
+			profiler.new_frame();
+			profiler.record(PASS_FRAME, delta_time * 1000.0f);
 
 			ImGui_ImplOpenGL3_NewFrame();
 			ImGui_ImplGlfw_NewFrame();
@@ -192,26 +323,105 @@ int main()
 			cam.set_delta_time(delta_time);
 		}
 
-		// Run compute shader
-		{
-			compute_shader.use();
-			compute_shader.setInt("u_frame_count", cam.get_frames_still());
-			compute_shader.setBool("u_camera_moved", cam.get_moved());
-			compute_shader.setFloat("u_fov", options_obj.camera_fov);
-			compute_shader.setInt("u_max_bounces", options_obj.rt_max_bounces);
-			compute_shader.setInt("u_rays_per_pixel", options_obj.rt_rays_per_pixel);
-			compute_shader.setInt("u_num_spheres", scene_data.n_objects);
-			compute_shader.setMat4("camera_to_world", cam.get_camera_to_world());
-			compute_shader.setFloat("u_cam_focus_distance", cam.get_focus_distance());
-			compute_shader.setFloat("u_cam_defocus_strength", cam.get_defocus_strength());
-			glDispatchCompute((GLuint)tex.width(), (GLuint)tex.height(), 1);
+		// A save that leaves the scene unusable keeps the old one, the next save is tried again
+		if (scene_watcher.poll()) {
+			SceneData next;
+			if (build_cli_scene(cli, next)) {
+				animator.pose(next);
+				SceneUpdateStats update = apply_scene_update(scene_data, bvh, lights, scene_buffers, next);
+				update.print();
+				if (update.changed) {
+					animator.scene_replaced();
+					cpu_tracer.set_scene(scene_data, bvh, lights);
+					cam.need_refresh();
+				}
+				// The file's meshes may have changed too
+				scene_watcher.watch(cli_scene_sources(cli));
+			}
+		}
+		if (animator.update(delta_time, scene_data, bvh, lights, scene_buffers)) {
+			cpu_tracer.update_scene(animator.moved_spheres, animator.reordered_slots);
+			cam.need_refresh();
 		}
 
+		// Frame count of the accumulation, only frames that were actually traced count towards it
+		if (cam.get_moved())
+			convergence.reset();
+		bool converged = false;
+
+		// Run compute shader, or the CPU reference tracer and upload its output in place of the image
+		if (options_obj.rt_use_cpu) {
+			converged = !cam.get_moved() && convergence.reached(options_obj.rt_convergence, false);
+			if (!converged) {
+				CPURenderParams params;
+				params.camera_to_world = cam.get_camera_to_world();
+				params.fov = options_obj.camera_fov;
+				params.focus_distance = cam.get_focus_distance();
+				params.defocus_strength = cam.get_defocus_strength();
+				params.frame_count = convergence.get_frames();
+				params.camera_moved = cam.get_moved();
+				params.max_bounces = options_obj.rt_max_bounces;
+				params.rays_per_pixel = options_obj.rt_rays_per_pixel;
+				params.use_nee = options_obj.rt_use_nee;
+				params.sampler = (SamplerType)options_obj.rt_sampler;
+				cpu_tracer.render_frame(params);
+				tex.upload(&cpu_tracer.pixels()[0].x);
+				convergence.add_frame(options_obj.rt_rays_per_pixel);
+				convergence.add_time(delta_time);
+			}
+			options_obj.active_tiles = converged ? 0 : options_obj.total_tiles;
+			options_obj.dispatches_per_frame = converged ? 0 : 1;
+		}
+		else {
+			// As many frames as fit the time budget, each one a full dispatch at the samples/pixel count
+			bool moved = cam.get_moved();
+			int planned = scheduler.begin_frame(options_obj.rt_frame_budget_ms, MAX_DISPATCHES_PER_FRAME, moved);
+			int dispatched = 0;
+			for (; dispatched < planned; dispatched++) {
+				bool first = dispatched == 0;
+				upload_frame_uniforms(convergence.get_frames(), moved && first);
+				sampler.prepare(first);
+				if (first)
+					options_obj.active_tiles = sampler.active_tiles();
+
+				// Adaptive sampling with every pixel below the error threshold has nothing left to dispatch either
+				if (!(moved && first) && convergence.reached(options_obj.rt_convergence, options_obj.rt_adaptive && sampler.converged()))
+					break;
+				if (options_obj.rt_use_wavefront)
+					wavefront.render_frame(options_obj.rt_rays_per_pixel, options_obj.rt_max_bounces, sampler);
+				else {
+					compute_shader.use();
+					sampler.dispatch();
+				}
+				convergence.add_frame(options_obj.rt_rays_per_pixel);
+			}
+			scheduler.end_frame(dispatched, profiler.frame_index());
+			ray_stats.update();
+			double batch_ms;
+			int batch_frame;
+			if (scheduler.take_batch_ms(batch_ms, batch_frame))
+				profiler.record(PASS_TRACE, (float)batch_ms, batch_frame);
+
+			converged = dispatched == 0;
+			if (converged)
+				options_obj.active_tiles = 0;
+			else
+				convergence.add_time(delta_time);
+			options_obj.dispatches_per_frame = dispatched;
+			options_obj.dispatch_ms = (float)scheduler.dispatch_time_ms();
+		}
+
+		idle = converged;
+		options_obj.converged = converged;
+		options_obj.accumulated_samples = convergence.get_samples();
+		options_obj.accumulated_seconds = convergence.get_seconds();
+
 		// prevent reading until finished writing to image
 		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
 		// Draw results to screen
 		{
+			profiler.begin(PASS_BLIT);
 			glClear(GL_COLOR_BUFFER_BIT);
 			quad_shader.use();
 			glBindVertexArray(vao);
@@ -220,11 +430,14 @@ int main()
 
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			profiler.end(PASS_BLIT);
 		} 
 
 		// ImGui
 		ImGui::Render();
+		profiler.begin(PASS_IMGUI);
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		profiler.end(PASS_IMGUI);
 
 		// Have to call this after render, otherwise we get ghosting when rotating camera
 		cam.update_movement();
@@ -232,6 +445,9 @@ int main()
 		glfwSwapBuffers(window);
 	}
 
+	if (!cli.profile_csv.empty() && profiler.write_csv(cli.profile_csv))
+		std::clog << std::format("Wrote profile '{}'", cli.profile_csv) << std::endl;
+
 	// Cleanup
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
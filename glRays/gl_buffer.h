@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <vector>
+#include <format>
+#include <iostream>
+#include <algorithm>
+
+// Growable GPU buffer, reallocates storage only when an upload no longer fits
+class GLBuffer
+{
+	GLenum target;
+	GLuint id;
+	size_t buf_size;
+	size_t buf_capacity;
+
+public:
+	GLBuffer(GLenum target = GL_SHADER_STORAGE_BUFFER) : target(target), id(0), buf_size(0), buf_capacity(0) {}
+
+	GLBuffer(const GLBuffer&) = delete;
+	GLBuffer& operator=(const GLBuffer&) = delete;
+
+	~GLBuffer()
+	{
+		if (id != 0)
+			glDeleteBuffers(1, &id);
+	}
+
+	GLuint get_id() const { return this->id; }
+	size_t size() const { return this->buf_size; }
+	size_t capacity() const { return this->buf_capacity; }
+
+	void create_buffer()
+	{
+		glGenBuffers(1, &id);
+	}
+
+	void upload(const void* data, size_t size)
+	{
+		allocate(size);
+		glBindBuffer(target, id);
+		if (size > 0)
+			glBufferSubData(target, 0, size, data);
+		glBindBuffer(target, 0);
+	}
+
+	// Makes room for size bytes without filling them, for buffers only the GPU writes
+	void allocate(size_t size)
+	{
+		glBindBuffer(target, id);
+		if (size > buf_capacity) {
+			GLint64 max_size = 0;
+			if (target == GL_SHADER_STORAGE_BUFFER)
+				glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &max_size);
+			if (max_size > 0 && (GLint64)size > max_size)
+				std::cerr << std::format("ERROR::BUFFER::SIZE_EXCEEDS_LIMIT {} bytes > {} bytes", size, max_size) << std::endl;
+
+			// Grow geometrically so repeated uploads of a growing scene don't reallocate every time
+			buf_capacity = std::max({ size, buf_capacity + buf_capacity / 2, (size_t)64 });
+			glBufferData(target, buf_capacity, nullptr, GL_DYNAMIC_DRAW);
+		}
+		glBindBuffer(target, 0);
+		buf_size = size;
+	}
+
+	template <typename T>
+	void upload(const std::vector<T>& data)
+	{
+		upload(data.data(), data.size() * sizeof(T));
+	}
+
+	// Overwrites part of what's already there, the buffer keeps its size
+	void update(size_t offset, const void* data, size_t size)
+	{
+		if (size == 0 || offset + size > buf_size) {
+			if (size > 0)
+				std::cerr << std::format("ERROR::BUFFER::UPDATE_OUT_OF_RANGE {} bytes at {} > {} bytes", size, offset, buf_size) << std::endl;
+			return;
+		}
+		glBindBuffer(target, id);
+		glBufferSubData(target, offset, size, data);
+		glBindBuffer(target, 0);
+	}
+
+	// Elements [first, first + count) of data, which is the buffer's whole contents
+	template <typename T>
+	void update(const std::vector<T>& data, size_t first, size_t count)
+	{
+		update(first * sizeof(T), data.data() + first, count * sizeof(T));
+	}
+
+	void bind_base(GLuint index)
+	{
+		glBindBufferBase(target, index, id);
+	}
+};
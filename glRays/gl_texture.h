@@ -33,6 +33,20 @@ public:
 		glBindImageTexture(0, id, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 	}
 
+	// Replace the whole image with tightly packed RGBA floats, e.g. from the CPU tracer
+	void upload(const float* rgba)
+	{
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->w, this->h, GL_RGBA, GL_FLOAT, rgba);
+	}
+
+	// Read the whole image back as tightly packed RGBA floats
+	void download(float* rgba)
+	{
+		glBindTexture(GL_TEXTURE_2D, id);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, rgba);
+	}
+
 	void bind(GLenum tex_unit = GL_TEXTURE0)
 	{
 		glActiveTexture(tex_unit);
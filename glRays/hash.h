@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+const uint64_t FNV1A_OFFSET = 0xcbf29ce484222325ull;
+
+// FNV-1a, stable between runs and platforms unlike std::hash, for keys of files cached on disk
+inline uint64_t fnv1a_bytes(const void* data, size_t size, uint64_t hash = FNV1A_OFFSET)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+inline uint64_t fnv1a(std::string_view data, uint64_t hash = FNV1A_OFFSET)
+{
+	return fnv1a_bytes(data.data(), data.size(), hash);
+}
@@ -0,0 +1,431 @@
+#include "headless.h"
+
+#include <chrono>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <cstring>
+#include <format>
+#include <iostream>
+
+#include <glad/gl.h>
+#ifdef GLRAYS_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <glm/ext/matrix_transform.hpp>
+
+#include "bvh.h"
+#include "lights.h"
+#include "shader.h"
+#include "workgroup.h"
+#include "frame_uniforms.h"
+#include "wavefront.h"
+#include "adaptive.h"
+#include "ray_stats.h"
+#include "gl_texture.h"
+#include "scene_buffers.h"
+#include "scene_cache.h"
+#include "cpu_tracer.h"
+#include "image_io.h"
+
+static glm::mat4 headless_camera_to_world(const CLIOptions& opts)
+{
+	return glm::translate(glm::mat4(1.0f), opts.camera_position);
+}
+
+// RMSE against a reference image at every power of two frames and after the last one, so samplers and
+// sampling strategies can be compared by the error they reach for a sample count
+struct ConvergenceLog
+{
+	bool enabled = false;
+	int width = 0;
+	int height = 0;
+	std::vector<float> reference;
+	std::ofstream csv;
+	std::chrono::steady_clock::time_point start;
+
+	bool open(const CLIOptions& opts)
+	{
+		if (opts.reference.empty())
+			return true;
+		if (!read_pfm(opts.reference, width, height, reference))
+			return false;
+		if (width != opts.width || height != opts.height) {
+			std::cerr << std::format("ERROR::HEADLESS::REFERENCE_SIZE {}x{}, rendering {}x{}", width, height, opts.width, opts.height) << std::endl;
+			return false;
+		}
+		if (!opts.rmse_csv.empty()) {
+			csv.open(opts.rmse_csv);
+			if (!csv) {
+				std::cerr << std::format("ERROR::HEADLESS::FILE_NOT_WRITABLE '{}'", opts.rmse_csv) << std::endl;
+				return false;
+			}
+			csv << "samples,seconds,rmse\n";
+		}
+		enabled = true;
+		return true;
+	}
+
+	void begin()
+	{
+		start = std::chrono::steady_clock::now();
+	}
+
+	bool due(int frames, int total_frames) const
+	{
+		return enabled && ((frames & (frames - 1)) == 0 || frames == total_frames);
+	}
+
+	void record(int samples, const float* rgba)
+	{
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double rmse = image_rmse(rgba, reference.data(), (size_t)width * height);
+		std::clog << std::format("{:>6} spp  {:8.2f}s  RMSE {:.6f}", samples, seconds, rmse) << std::endl;
+		if (csv.is_open())
+			csv << std::format("{},{:.4f},{:.8f}\n", samples, seconds, rmse);
+	}
+};
+
+#ifdef GLRAYS_HAS_EGL
+// Context made current without any surface, everything renders into our own texture
+struct EGLHeadlessContext
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+
+	~EGLHeadlessContext()
+	{
+		if (display == EGL_NO_DISPLAY)
+			return;
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		eglTerminate(display);
+	}
+
+	bool try_display(EGLDisplay candidate)
+	{
+		EGLint major, minor;
+		if (candidate == EGL_NO_DISPLAY || !eglInitialize(candidate, &major, &minor))
+			return false;
+
+		const char* extensions = eglQueryString(candidate, EGL_EXTENSIONS);
+		if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context") || !eglBindAPI(EGL_OPENGL_API)) {
+			eglTerminate(candidate);
+			return false;
+		}
+
+		EGLConfig config = (EGLConfig)0;
+		if (!std::strstr(extensions, "EGL_KHR_no_config_context")) {
+			const EGLint config_attribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+			EGLint n_configs = 0;
+			if (!eglChooseConfig(candidate, config_attribs, &config, 1, &n_configs) || n_configs == 0) {
+				eglTerminate(candidate);
+				return false;
+			}
+		}
+
+		// 4.3 is all the compute shader needs, drivers hand out their newest compatible version anyway
+		const EGLint context_attribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		EGLContext candidate_context = eglCreateContext(candidate, config, EGL_NO_CONTEXT, context_attribs);
+		if (candidate_context == EGL_NO_CONTEXT || !eglMakeCurrent(candidate, EGL_NO_SURFACE, EGL_NO_SURFACE, candidate_context)) {
+			if (candidate_context != EGL_NO_CONTEXT)
+				eglDestroyContext(candidate, candidate_context);
+			eglTerminate(candidate);
+			return false;
+		}
+
+		display = candidate;
+		context = candidate_context;
+		return true;
+	}
+
+	// GPUs enumerated as EGL devices first (no display server needed), then Mesa's
+	// surfaceless platform, then whatever the default display is
+	bool create()
+	{
+		auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		auto query_devices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+
+		if (get_platform_display && query_devices) {
+			EGLDeviceEXT devices[8];
+			EGLint n_devices = 0;
+			if (query_devices(8, devices, &n_devices)) {
+				for (int i = 0; i < n_devices; i++)
+					if (try_display(get_platform_display(EGL_PLATFORM_DEVICE_EXT, devices[i], nullptr)))
+						return true;
+			}
+		}
+		if (get_platform_display && try_display(get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)))
+			return true;
+		return try_display(eglGetDisplay(EGL_DEFAULT_DISPLAY));
+	}
+};
+
+static bool render_gpu(const CLIOptions& opts, const SceneData& scene, const BVH& bvh, const LightBVH& lights, const SceneCache& cache, ConvergenceLog& convergence, HeadlessResult& result)
+{
+	EGLHeadlessContext egl;
+	if (!egl.create()) {
+		std::cerr << "ERROR::HEADLESS::NO_EGL_CONTEXT" << std::endl;
+		return false;
+	}
+	if (!gladLoadGL((GLADloadfunc)eglGetProcAddress)) {
+		std::cerr << "Failed to initialise GLAD" << std::endl;
+		return false;
+	}
+	std::clog << "OpenGL " << glGetString(GL_VERSION) << " on " << glGetString(GL_RENDERER) << std::endl;
+	result.renderer = (const char*)glGetString(GL_RENDERER);
+	std::vector<float>& pixels = result.pixels;
+
+	GLTexture tex = GLTexture(opts.width, opts.height);
+	tex.create_texture();
+
+	SceneBuffers buffers;
+	if (cache.is_open())
+		buffers.upload(cache);
+	else
+		buffers.upload(scene, bvh, lights);
+
+	FrameUniformBuffer frame_uniforms;
+	FrameUniforms frame;
+	frame.camera_to_world = headless_camera_to_world(opts);
+	frame.fov = opts.fov;
+	frame.max_bounces = opts.max_bounces;
+	frame.rays_per_pixel = 1;
+	frame.emitter_count = buffers.emitter_count;
+	frame.use_nee = opts.nee;
+	frame.sampler = opts.sampler;
+	frame.adaptive = opts.adaptive_threshold > 0.0f;
+	if (frame.adaptive)
+		frame.adaptive_threshold = opts.adaptive_threshold;
+	frame.camera_moved = true;
+	frame_uniforms.upload(frame);
+
+	// Frame 0 of every candidate overwrites the image, so tuning leaves nothing behind in the accumulation
+	AdaptiveSampler sampler = AdaptiveSampler(opts.width, opts.height);
+	WorkgroupSize workgroup = autotune_workgroup_size("compute.glsl", opts.width, opts.height);
+	sampler.set_workgroup(workgroup);
+	RayStats ray_stats = RayStats(opts.ray_stats);
+	ShaderProgram compute_shader = ShaderProgram();
+	compute_shader.attach("compute.glsl", GL_COMPUTE_SHADER, workgroup.defines() + ray_stats.defines());
+	compute_shader.link();
+
+	std::unique_ptr<WavefrontTracer> wavefront;
+	if (opts.wavefront)
+		wavefront = std::make_unique<WavefrontTracer>(opts.width, opts.height, workgroup, ray_stats.defines());
+
+	// Only the frames themselves, so the two pipelines can be compared without startup costs
+	glFinish();
+	auto start = std::chrono::steady_clock::now();
+	convergence.begin();
+	int frame_count = 0;
+	for (; frame_count < opts.spp; frame_count++) {
+		frame.frame_count = frame_count;
+		frame.camera_moved = frame_count == 0;
+		frame_uniforms.upload(frame);
+		sampler.prepare();
+
+		// The tile count lags a frame, a converged image stops one frame after its last samples
+		if (frame_count > 0 && sampler.converged()) {
+			std::clog << std::format("Every pixel converged after {} of {} frames", frame_count - 1, opts.spp) << std::endl;
+			break;
+		}
+
+		if (wavefront)
+			wavefront->render_frame(frame.rays_per_pixel, frame.max_bounces, sampler);
+		else {
+			compute_shader.use();
+			sampler.dispatch();
+		}
+
+		// Each frame reads the previous frame's accumulation
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		// Collected as it goes so the 32-bit counters never come near overflowing
+		ray_stats.update();
+
+		if (convergence.due(frame_count + 1, opts.spp)) {
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+			tex.download(pixels.data());
+			convergence.record((frame_count + 1) * frame.rays_per_pixel, pixels.data());
+		}
+	}
+
+	glFinish();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::clog << std::format("{} traced {:.2f}M samples/s", opts.wavefront ? "Wavefront pipeline" : "Megakernel",
+		(double)opts.width * opts.height * frame_count / seconds / 1e6) << std::endl;
+	if (ray_stats.is_enabled()) {
+		ray_stats.flush();
+		ray_stats.print(ray_stats.total(), seconds);
+		result.rays = ray_stats.total();
+	}
+	result.frames = frame_count;
+	result.seconds = seconds;
+
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	tex.download(pixels.data());
+	return true;
+}
+#endif
+
+static void render_cpu(const CLIOptions& opts, const SceneData& scene, const BVH& bvh, const LightBVH& lights, ConvergenceLog& convergence, HeadlessResult& result)
+{
+	CPUTracer tracer = CPUTracer(opts.width, opts.height);
+	tracer.set_scene(scene, bvh, lights);
+	result.renderer = std::format("CPU tracer using {} threads, {} kernels", tracer.n_threads(), simd_level_name(tracer.simd_level()));
+	std::clog << result.renderer << std::endl;
+	if (opts.adaptive_threshold > 0.0f)
+		std::clog << "Adaptive sampling is only implemented for the GPU pipelines, the CPU backend samples every pixel" << std::endl;
+
+	CPURenderParams params;
+	params.camera_to_world = headless_camera_to_world(opts);
+	params.fov = opts.fov;
+	params.max_bounces = opts.max_bounces;
+	params.rays_per_pixel = 1;
+	params.use_nee = opts.nee;
+	params.sampler = opts.sampler;
+	auto start = std::chrono::steady_clock::now();
+	convergence.begin();
+	for (int frame = 0; frame < opts.spp; frame++) {
+		params.frame_count = frame;
+		params.camera_moved = frame == 0;
+		tracer.render_frame(params);
+		if (convergence.due(frame + 1, opts.spp))
+			convergence.record((frame + 1) * params.rays_per_pixel, &tracer.pixels()[0].x);
+	}
+
+	result.frames = opts.spp;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const float* image = &tracer.pixels()[0].x;
+	result.pixels.assign(image, image + result.pixels.size());
+}
+
+bool render_headless(const CLIOptions& opts, HeadlessResult& result)
+{
+	SceneData scene;
+	BVH bvh;
+	LightBVH lights;
+	SceneCache cache;
+	if (!load_cli_scene(opts, scene, bvh, lights, cache))
+		return false;
+
+	ConvergenceLog convergence;
+	if (!convergence.open(opts))
+		return false;
+
+	result = HeadlessResult();
+	result.pixels.resize(opts.width * opts.height * 4);
+
+	bool use_cpu = opts.use_cpu;
+#ifdef GLRAYS_HAS_EGL
+	if (!use_cpu && !render_gpu(opts, scene, bvh, lights, cache, convergence, result)) {
+		std::clog << "No offscreen OpenGL context available, falling back to the CPU backend" << std::endl;
+		use_cpu = true;
+	}
+#else
+	if (!use_cpu) {
+		std::clog << "Built without EGL, rendering headless on the CPU backend" << std::endl;
+		use_cpu = true;
+	}
+#endif
+	if (use_cpu && cache.is_open())
+		cache.extract(scene, bvh, lights);
+	if (use_cpu)
+		render_cpu(opts, scene, bvh, lights, convergence, result);
+	result.used_gpu = !use_cpu;
+	return true;
+}
+
+int run_headless(const CLIOptions& opts)
+{
+	HeadlessResult result;
+	auto start = std::chrono::steady_clock::now();
+	if (!render_headless(opts, result))
+		return 1;
+
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+	std::clog << std::format("Rendered {}x{} at {} spp on the {} with the {} sampler in {:.2f}s", opts.width, opts.height, opts.spp,
+		result.used_gpu ? "GPU" : "CPU", sampler_name(opts.sampler), seconds) << std::endl;
+
+	if (!write_image(opts.output, opts.width, opts.height, result.pixels.data()))
+		return 1;
+	std::clog << std::format("Wrote '{}'", opts.output) << std::endl;
+	return 0;
+}
+
+// Splits a batch line into arguments at whitespace, double quotes keep paths with spaces together
+static std::vector<std::string> split_batch_line(const std::string& line)
+{
+	std::vector<std::string> args;
+	std::string arg;
+	bool quoted = false, in_arg = false;
+	for (char c : line) {
+		if (c == '"') {
+			quoted = !quoted;
+			in_arg = true;
+		}
+		else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+			if (in_arg)
+				args.push_back(arg);
+			arg.clear();
+			in_arg = false;
+		}
+		else {
+			arg += c;
+			in_arg = true;
+		}
+	}
+	if (in_arg)
+		args.push_back(arg);
+	return args;
+}
+
+int run_batch(const CLIOptions& base)
+{
+	std::ifstream file(base.batch);
+	if (!file) {
+		std::cerr << std::format("ERROR::HEADLESS::BATCH_NOT_FOUND '{}'", base.batch) << std::endl;
+		return 1;
+	}
+
+	int n_lines = 0, n_renders = 0, n_failed = 0;
+	std::string line;
+	while (std::getline(file, line)) {
+		n_lines++;
+		std::vector<std::string> args = split_batch_line(line);
+		if (args.empty() || args[0][0] == '#')
+			continue;
+
+		std::vector<char*> argv = { (char*)"glRays" };
+		for (std::string& arg : args)
+			argv.push_back(arg.data());
+		CLIOptions opts = base;
+		opts.batch.clear();
+		std::clog << std::format("Batch line {}: {}", n_lines, line) << std::endl;
+		if (!parse_cli((int)argv.size(), argv.data(), opts)) {
+			n_failed++;
+			continue;
+		}
+
+		// Lines that don't name an output would all overwrite the same file
+		if (opts.output == base.output) {
+			std::filesystem::path output = base.output;
+			opts.output = (output.parent_path() / std::format("{}_{}{}", output.stem().string(), n_lines, output.extension().string())).string();
+		}
+		n_renders++;
+		if (run_headless(opts) != 0)
+			n_failed++;
+	}
+
+	std::clog << std::format("Batch '{}': {} renders, {} failed", base.batch, n_renders, n_failed) << std::endl;
+	return n_failed > 0 ? 1 : 0;
+}
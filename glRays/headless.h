@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cli.h"
+#include "ray_stats.h"
+
+// What a headless render produced and how long it took, for callers that measure renders
+struct HeadlessResult
+{
+	std::vector<float> pixels;	// RGBA, rows bottom to top
+	bool used_gpu = false;
+	std::string renderer;		// GL_RENDERER, or the CPU tracer's threads and kernels
+	int frames = 0;
+	double seconds = 0.0;		// the frames only, without scene, BVH or shader setup
+	RayStatsTotals rays;		// only counted by the GPU pipelines with opts.ray_stats
+};
+
+// Renders opts.spp samples per pixel into result without writing anything, false if the scene or
+// reference can't be loaded
+bool render_headless(const CLIOptions& opts, HeadlessResult& result);
+
+// Renders opts.spp samples per pixel to opts.output and returns the process exit code.
+// Never creates a window or UI, the GPU path needs an EGL context without a surface and
+// falls back to the CPU backend when there isn't one.
+int run_headless(const CLIOptions& opts);
+
+// Renders every line of opts.batch as its own headless render, the line's options on top of opts.
+// Returns 1 if any line failed to parse or render, after trying all of them.
+int run_batch(const CLIOptions& opts);
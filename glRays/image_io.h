@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <format>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// Images are RGBA floats with rows bottom to top, the layout of the render texture
+
+// Same tone mapping as fragment.glsl: exposure, ACES filmic curve, then the sRGB transfer function
+inline float tone_map_channel(float x)
+{
+	x *= 0.8f;
+	x = std::clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), 0.0f, 1.0f);
+	return x < 0.0031308f ? x * 12.92f : std::pow(x, 1.0f / 2.4f) * 1.055f - 0.055f;
+}
+
+// 8-bit binary PPM of the tone-mapped image, as it would appear on screen
+inline bool write_ppm(const std::string& path, int width, int height, const float* rgba)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << std::format("ERROR::IMAGE::FILE_NOT_WRITABLE '{}'", path) << std::endl;
+		return false;
+	}
+
+	file << std::format("P6\n{} {}\n255\n", width, height);
+	std::vector<unsigned char> row(width * 3);
+	for (int y = height - 1; y >= 0; y--) {
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < 3; c++) {
+				float v = tone_map_channel(rgba[(y * width + x) * 4 + c]);
+				row[x * 3 + c] = (unsigned char)std::lround(v * 255.0f);
+			}
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+	return (bool)file;
+}
+
+// Linear HDR radiance as a little-endian PFM, rows are stored bottom to top like ours
+inline bool write_pfm(const std::string& path, int width, int height, const float* rgba)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << std::format("ERROR::IMAGE::FILE_NOT_WRITABLE '{}'", path) << std::endl;
+		return false;
+	}
+
+	file << std::format("PF\n{} {}\n-1.0\n", width, height);
+	std::vector<float> row(width * 3);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++)
+			for (int c = 0; c < 3; c++)
+				row[x * 3 + c] = rgba[(y * width + x) * 4 + c];
+		file.write((const char*)row.data(), row.size() * sizeof(float));
+	}
+	return (bool)file;
+}
+
+// Reads a little-endian RGB PFM like write_pfm's into RGBA, alpha 1
+inline bool read_pfm(const std::string& path, int& width, int& height, std::vector<float>& rgba)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::string magic;
+	float scale = 0.0f;
+	if (!(file >> magic >> width >> height >> scale) || magic != "PF" || scale >= 0.0f || width <= 0 || height <= 0) {
+		std::cerr << std::format("ERROR::IMAGE::UNSUPPORTED_PFM '{}', expected little-endian RGB", path) << std::endl;
+		return false;
+	}
+	file.get();
+
+	std::vector<float> rgb((size_t)width * height * 3);
+	if (!file.read((char*)rgb.data(), rgb.size() * sizeof(float))) {
+		std::cerr << std::format("ERROR::IMAGE::TRUNCATED_PFM '{}'", path) << std::endl;
+		return false;
+	}
+	rgba.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		for (int c = 0; c < 3; c++)
+			rgba[i * 4 + c] = rgb[i * 3 + c];
+		rgba[i * 4 + 3] = 1.0f;
+	}
+	return true;
+}
+
+// Root mean square error over the RGB channels of two images of n_pixels RGBA floats
+inline double image_rmse(const float* rgba, const float* reference, size_t n_pixels)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < n_pixels; i++) {
+		for (int c = 0; c < 3; c++) {
+			double d = (double)rgba[i * 4 + c] - reference[i * 4 + c];
+			sum += d * d;
+		}
+	}
+	return n_pixels > 0 ? std::sqrt(sum / (n_pixels * 3)) : 0.0;
+}
+
+// Picks the format from the extension, PPM unless the path ends in .pfm
+inline bool write_image(const std::string& path, int width, int height, const float* rgba)
+{
+	bool is_pfm = path.size() >= 4 && path.compare(path.size() - 4, 4, ".pfm") == 0;
+	return is_pfm ? write_pfm(path, width, height, rgba) : write_ppm(path, width, height, rgba);
+}
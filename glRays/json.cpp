@@ -0,0 +1,260 @@
+#include "json.h"
+
+#include <cctype>
+#include <cstdint>
+#include <format>
+#include <cstdlib>
+#include <charconv>
+
+const int JSON_MAX_DEPTH = 64;
+
+const JsonValue* JsonValue::find(std::string_view key) const
+{
+	for (const auto& [name, value] : object)
+		if (name == key)
+			return &value;
+	return nullptr;
+}
+
+namespace
+{
+	struct JsonParser
+	{
+		std::string_view text;
+		size_t pos = 0;
+		std::string error;
+
+		bool fail(const std::string& what)
+		{
+			if (error.empty()) {
+				int line = 1;
+				for (size_t i = 0; i < pos && i < text.size(); i++)
+					line += text[i] == '\n';
+				error = std::format("line {}: {}", line, what);
+			}
+			return false;
+		}
+
+		void skip_space()
+		{
+			while (pos < text.size()) {
+				char c = text[pos];
+				if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+					pos++;
+				else if (c == '/' && pos + 1 < text.size() && text[pos + 1] == '/') {
+					while (pos < text.size() && text[pos] != '\n')
+						pos++;
+				}
+				else
+					break;
+			}
+		}
+
+		bool literal(std::string_view word)
+		{
+			if (text.substr(pos, word.size()) != word)
+				return fail("unexpected character");
+			pos += word.size();
+			return true;
+		}
+
+		static void append_utf8(std::string& out, uint32_t cp)
+		{
+			if (cp < 0x80)
+				out += (char)cp;
+			else if (cp < 0x800) {
+				out += (char)(0xc0 | (cp >> 6));
+				out += (char)(0x80 | (cp & 0x3f));
+			}
+			else if (cp < 0x10000) {
+				out += (char)(0xe0 | (cp >> 12));
+				out += (char)(0x80 | ((cp >> 6) & 0x3f));
+				out += (char)(0x80 | (cp & 0x3f));
+			}
+			else {
+				out += (char)(0xf0 | (cp >> 18));
+				out += (char)(0x80 | ((cp >> 12) & 0x3f));
+				out += (char)(0x80 | ((cp >> 6) & 0x3f));
+				out += (char)(0x80 | (cp & 0x3f));
+			}
+		}
+
+		bool hex4(uint32_t& cp)
+		{
+			if (pos + 4 > text.size())
+				return fail("truncated \\u escape");
+			auto [end, ec] = std::from_chars(text.data() + pos, text.data() + pos + 4, cp, 16);
+			if (ec != std::errc() || end != text.data() + pos + 4)
+				return fail("invalid \\u escape");
+			pos += 4;
+			return true;
+		}
+
+		bool parse_string(std::string& out)
+		{
+			pos++;	// opening quote
+			while (true) {
+				// Copy runs without escapes in one go
+				size_t start = pos;
+				while (pos < text.size() && text[pos] != '"' && text[pos] != '\\' && (unsigned char)text[pos] >= 0x20)
+					pos++;
+				out.append(text.data() + start, pos - start);
+
+				if (pos >= text.size())
+					return fail("unterminated string");
+				char c = text[pos++];
+				if (c == '"')
+					return true;
+				if (c != '\\')
+					return fail("control character in string");
+				if (pos >= text.size())
+					return fail("unterminated string");
+
+				char e = text[pos++];
+				switch (e) {
+				case '"': out += '"'; break;
+				case '\\': out += '\\'; break;
+				case '/': out += '/'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'n': out += '\n'; break;
+				case 'r': out += '\r'; break;
+				case 't': out += '\t'; break;
+				case 'u': {
+					uint32_t cp;
+					if (!hex4(cp))
+						return false;
+					// Surrogate pairs encode everything above the basic multilingual plane
+					if (cp >= 0xd800 && cp < 0xdc00 && text.substr(pos, 2) == "\\u") {
+						pos += 2;
+						uint32_t low;
+						if (!hex4(low))
+							return false;
+						cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+					}
+					append_utf8(out, cp);
+					break;
+				}
+				default:
+					return fail(std::format("invalid escape '\\{}'", e));
+				}
+			}
+		}
+
+		bool parse_number(double& out)
+		{
+			size_t start = pos;
+			if (pos < text.size() && text[pos] == '-')
+				pos++;
+			while (pos < text.size() && (std::isdigit((unsigned char)text[pos]) || text[pos] == '.' || text[pos] == 'e' || text[pos] == 'E' || text[pos] == '+' || text[pos] == '-'))
+				pos++;
+			// strtod wants a terminated string, numbers are short
+			std::string digits(text.substr(start, pos - start));
+			char* end = nullptr;
+			out = std::strtod(digits.c_str(), &end);
+			if (digits.empty() || end != digits.c_str() + digits.size()) {
+				pos = start;
+				return fail(std::format("invalid number '{}'", digits));
+			}
+			return true;
+		}
+
+		bool parse_value(JsonValue& value, int depth)
+		{
+			if (depth > JSON_MAX_DEPTH)
+				return fail("nested too deeply");
+			skip_space();
+			if (pos >= text.size())
+				return fail("unexpected end of file");
+
+			char c = text[pos];
+			if (c == '{') {
+				value.type = JsonValue::Object;
+				pos++;
+				skip_space();
+				if (pos < text.size() && text[pos] == '}') {
+					pos++;
+					return true;
+				}
+				while (true) {
+					skip_space();
+					if (pos >= text.size() || text[pos] != '"')
+						return fail("expected a key string");
+					auto& [key, member] = value.object.emplace_back();
+					if (!parse_string(key))
+						return false;
+					skip_space();
+					if (pos >= text.size() || text[pos] != ':')
+						return fail(std::format("expected ':' after \"{}\"", key));
+					pos++;
+					if (!parse_value(member, depth + 1))
+						return false;
+					skip_space();
+					if (pos < text.size() && text[pos] == ',') {
+						pos++;
+						continue;
+					}
+					if (pos < text.size() && text[pos] == '}') {
+						pos++;
+						return true;
+					}
+					return fail("expected ',' or '}'");
+				}
+			}
+			if (c == '[') {
+				value.type = JsonValue::Array;
+				pos++;
+				skip_space();
+				if (pos < text.size() && text[pos] == ']') {
+					pos++;
+					return true;
+				}
+				while (true) {
+					if (!parse_value(value.array.emplace_back(), depth + 1))
+						return false;
+					skip_space();
+					if (pos < text.size() && text[pos] == ',') {
+						pos++;
+						continue;
+					}
+					if (pos < text.size() && text[pos] == ']') {
+						pos++;
+						return true;
+					}
+					return fail("expected ',' or ']'");
+				}
+			}
+			if (c == '"') {
+				value.type = JsonValue::String;
+				return parse_string(value.string);
+			}
+			if (c == 't' || c == 'f') {
+				value.type = JsonValue::Bool;
+				value.boolean = c == 't';
+				return literal(value.boolean ? "true" : "false");
+			}
+			if (c == 'n') {
+				value.type = JsonValue::Null;
+				return literal("null");
+			}
+			value.type = JsonValue::Number;
+			return parse_number(value.number);
+		}
+	};
+
+}
+
+bool parse_json(std::string_view text, JsonValue& value, std::string& error)
+{
+	JsonParser parser;
+	parser.text = text;
+	value = JsonValue();
+	bool ok = parser.parse_value(value, 0);
+	if (ok) {
+		parser.skip_space();
+		if (parser.pos < text.size())
+			ok = parser.fail("unexpected text after the document");
+	}
+	error = parser.error;
+	return ok;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <string_view>
+
+// Parsed JSON document, just enough for scene files: objects keep their keys in file order
+struct JsonValue
+{
+	enum Type { Null, Bool, Number, String, Array, Object };
+
+	Type type = Null;
+	bool boolean = false;
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+
+	bool is_null() const { return type == Null; }
+	bool is_number() const { return type == Number; }
+	bool is_string() const { return type == String; }
+	bool is_array() const { return type == Array; }
+	bool is_object() const { return type == Object; }
+
+	// Member of an object by key, nullptr if it's missing or this isn't an object
+	const JsonValue* find(std::string_view key) const;
+};
+
+// Standard JSON plus // comments, on failure error says what went wrong on which line
+bool parse_json(std::string_view text, JsonValue& value, std::string& error);
@@ -0,0 +1,292 @@
+#include "lights.h"
+
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <format>
+#include <iostream>
+
+namespace
+{
+	const float PI = 3.1415926535897932385f;
+
+	// Cone of directions, half-angle in radians
+	struct Cone
+	{
+		glm::vec3 axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		float theta = -1.0f;	// empty
+	};
+
+	// Grows a to also contain b, the bounding cone construction from PBRT v4
+	void merge_cone(Cone& a, Cone b)
+	{
+		if (b.theta < 0.0f)
+			return;
+		if (a.theta < 0.0f || b.theta > a.theta)
+			std::swap(a, b);
+		if (b.theta < 0.0f)
+			return;
+
+		float theta_d = std::acos(std::clamp(glm::dot(a.axis, b.axis), -1.0f, 1.0f));
+		if (std::min(theta_d + b.theta, PI) <= a.theta)
+			return;
+
+		float theta_o = (a.theta + theta_d + b.theta) / 2;
+		glm::vec3 rot_axis = glm::cross(a.axis, b.axis);
+		if (theta_o >= PI || glm::dot(rot_axis, rot_axis) == 0.0f) {
+			a.theta = PI;
+			return;
+		}
+
+		// Rotate a's axis towards b's by the amount the cone grows on b's side
+		float theta_r = theta_o - a.theta;
+		glm::vec3 k = glm::normalize(rot_axis);
+		a.axis = glm::normalize(a.axis * std::cos(theta_r) + glm::cross(k, a.axis) * std::sin(theta_r));
+		a.theta = theta_o;
+	}
+
+	// Orientation measure M_Omega of the surface area orientation heuristic
+	float orientation_measure(float theta_o, float theta_e)
+	{
+		float theta_w = std::min(theta_o + theta_e, PI);
+		float sin_o = std::sin(theta_o);
+		return 2 * PI * (1 - std::cos(theta_o))
+			+ PI / 2 * (2 * theta_w * sin_o - std::cos(theta_o - 2 * theta_w) - 2 * theta_o * sin_o + std::cos(theta_o));
+	}
+
+	int ceil_log2(int n)
+	{
+		int levels = 0;
+		while ((1 << levels) < n)
+			levels++;
+		return levels;
+	}
+
+	struct LightBin
+	{
+		AABB bounds;
+		float power = 0.0f;
+		Cone cone;
+		float theta_e = 0.0f;
+		int count = 0;
+
+		void grow(const LightBin& b)
+		{
+			bounds.grow(b.bounds);
+			power += b.power;
+			merge_cone(cone, b.cone);
+			theta_e = std::max(theta_e, b.theta_e);
+			count += b.count;
+		}
+
+		float cost() const
+		{
+			return count > 0 ? power * bounds.area() * orientation_measure(cone.theta, theta_e) : 0.0f;
+		}
+	};
+}
+
+void LightBVHStats::print() const
+{
+	std::clog << std::format("Light BVH built in {:.2f}ms: {} emitters, {} nodes, depth max {} / avg {:.2f}",
+		build_ms, n_emitters, n_nodes, max_depth, avg_depth) << std::endl;
+}
+
+void LightBVH::make_node(int node_idx, int first, int count, const std::vector<BuildEmitter>& build)
+{
+	LightBin all;
+	for (int i = first; i < first + count; i++) {
+		const BuildEmitter& e = build[order[i]];
+		LightBin single;
+		single.bounds = e.bounds;
+		single.power = e.power;
+		single.cone = { e.axis, e.theta_o };
+		single.theta_e = e.theta_e;
+		single.count = 1;
+		all.grow(single);
+	}
+
+	LightNode& node = nodes[node_idx];
+	node.bounds_min = all.bounds.bounds_min;
+	node.bounds_max = all.bounds.bounds_max;
+	node.power = all.power;
+	node.child = 0;
+	node.axis = all.cone.axis;
+	node.cos_theta_o = std::cos(all.cone.theta);
+	node.cos_theta_e = std::cos(all.theta_e);
+	node.std430padding[0] = node.std430padding[1] = node.std430padding[2] = 0.0f;
+}
+
+void LightBVH::subdivide(int node_idx, int first, int count, int depth, uint32_t trail, const std::vector<BuildEmitter>& build)
+{
+	if (count == 1) {
+		nodes[node_idx].child = -1 - order[first];
+		emitters[order[first]].trail = trail;
+		stats.max_depth = std::max(stats.max_depth, depth);
+		stats.avg_depth += depth;
+		return;
+	}
+
+	AABB centroid_bounds;
+	for (int i = first; i < first + count; i++)
+		centroid_bounds.grow(build[order[i]].centroid);
+	glm::vec3 extent = centroid_bounds.bounds_max - centroid_bounds.bounds_min;
+	float max_extent = std::max({ extent.x, extent.y, extent.z });
+
+	// Bin centroids along each axis and sweep the bins for the split with the lowest orientation-aware
+	// SAH cost, scaled up on short axes so thin slabs of lights don't get cut lengthwise.
+	// Close to the trail's depth limit only median splits are left, they finish in log2(count) levels.
+	int best_axis = -1;
+	int best_split = 0;
+	float best_cost = INFINITY;
+	bool median_only = depth + 1 + ceil_log2(count) > LIGHT_BVH_MAX_DEPTH;
+	for (int axis = 0; axis < 3 && !median_only; axis++) {
+		float c_min = centroid_bounds.bounds_min[axis];
+		if (extent[axis] <= 0.0f)
+			continue;
+
+		LightBin bins[LIGHT_BVH_BINS];
+		float scale = LIGHT_BVH_BINS / extent[axis];
+		for (int i = first; i < first + count; i++) {
+			const BuildEmitter& e = build[order[i]];
+			int bin = std::min(LIGHT_BVH_BINS - 1, (int)((e.centroid[axis] - c_min) * scale));
+			LightBin single;
+			single.bounds = e.bounds;
+			single.power = e.power;
+			single.cone = { e.axis, e.theta_o };
+			single.theta_e = e.theta_e;
+			single.count = 1;
+			bins[bin].grow(single);
+		}
+
+		float left_cost[LIGHT_BVH_BINS - 1], right_cost[LIGHT_BVH_BINS - 1];
+		int left_count[LIGHT_BVH_BINS - 1];
+		LightBin left, right;
+		for (int i = 0; i < LIGHT_BVH_BINS - 1; i++) {
+			left.grow(bins[i]);
+			left_cost[i] = left.cost();
+			left_count[i] = left.count;
+
+			right.grow(bins[LIGHT_BVH_BINS - 1 - i]);
+			right_cost[LIGHT_BVH_BINS - 2 - i] = right.cost();
+		}
+
+		float regularisation = max_extent / extent[axis];
+		for (int i = 0; i < LIGHT_BVH_BINS - 1; i++) {
+			if (left_count[i] == 0 || left_count[i] == count)
+				continue;
+			float cost = regularisation * (left_cost[i] + right_cost[i]);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = i;
+			}
+		}
+	}
+
+	auto begin = order.begin() + first;
+	int left_count;
+	if (best_axis >= 0) {
+		float c_min = centroid_bounds.bounds_min[best_axis];
+		float scale = LIGHT_BVH_BINS / extent[best_axis];
+		auto mid = std::partition(begin, begin + count, [&](int e) {
+			int bin = std::min(LIGHT_BVH_BINS - 1, (int)((build[e].centroid[best_axis] - c_min) * scale));
+			return bin <= best_split;
+		});
+		left_count = (int)(mid - begin);
+	}
+	else {
+		// Median along the widest axis, which also separates lights whose centroids all coincide
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		left_count = count / 2;
+		std::nth_element(begin, begin + left_count, begin + count, [&](int a, int b) {
+			return build[a].centroid[axis] < build[b].centroid[axis];
+		});
+	}
+
+	int left_idx = (int)nodes.size();
+	nodes.emplace_back();
+	nodes.emplace_back();
+	make_node(left_idx, first, left_count, build);
+	make_node(left_idx + 1, first + left_count, count - left_count, build);
+	nodes[node_idx].child = left_idx;
+
+	subdivide(left_idx, first, left_count, depth + 1, trail, build);
+	subdivide(left_idx + 1, first + left_count, count - left_count, depth + 1, trail | (1u << depth), build);
+}
+
+void LightBVH::build(const SceneData& scene)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Spheres first then triangles, which keeps emitters sorted by their packed prim reference
+	std::vector<BuildEmitter> build;
+	emitters.clear();
+	for (uint32_t i = 0; i < (uint32_t)scene.spheres.size(); i++) {
+		float power = emitter_power(scene, i);
+		if (power <= 0.0f)
+			continue;
+
+		// Spheres emit in every direction, from every point in the direction of its normal
+		const Sphere& sphere = scene.spheres[i];
+		BuildEmitter e;
+		e.bounds.grow(sphere.centre - glm::vec3(sphere.radius));
+		e.bounds.grow(sphere.centre + glm::vec3(sphere.radius));
+		e.centroid = sphere.centre;
+		e.power = power;
+		e.axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		e.theta_o = PI;
+		e.theta_e = PI / 2;
+		build.push_back(e);
+		emitters.push_back({ i, 0u });
+	}
+	for (uint32_t i = 0; i < (uint32_t)scene.triangles.size(); i++) {
+		uint32_t prim = i | BVH_TRIANGLE_BIT;
+		float power = emitter_power(scene, prim);
+		if (power <= 0.0f)
+			continue;
+
+		// Triangles are one-sided, they only emit from their front face
+		const Triangle& tri = scene.triangles[i];
+		glm::vec3 a = scene.vertices[tri.v0].position;
+		glm::vec3 b = scene.vertices[tri.v1].position;
+		glm::vec3 c = scene.vertices[tri.v2].position;
+		BuildEmitter e;
+		e.bounds.grow(a);
+		e.bounds.grow(b);
+		e.bounds.grow(c);
+		e.centroid = (a + b + c) / 3.0f;
+		e.power = power;
+		e.axis = glm::normalize(glm::cross(b - a, c - a));
+		e.theta_o = 0.0f;
+		e.theta_e = PI / 2;
+		build.push_back(e);
+		emitters.push_back({ prim, 0u });
+	}
+
+	int n_emitters = (int)emitters.size();
+	order.resize(n_emitters);
+	std::iota(order.begin(), order.end(), 0);
+
+	nodes.clear();
+	stats = LightBVHStats();
+	if (n_emitters > 0) {
+		nodes.reserve(2 * n_emitters - 1);
+		nodes.emplace_back();
+		make_node(0, 0, n_emitters, build);
+		subdivide(0, 0, n_emitters, 0, 0u, build);
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	stats.build_ms = std::chrono::duration<double, std::milli>(end - start).count();
+	stats.n_emitters = n_emitters;
+	stats.n_nodes = (int)nodes.size();
+	stats.avg_depth = n_emitters > 0 ? stats.avg_depth / n_emitters : 0.0f;
+}
+
+LightBVH build_light_bvh(const SceneData& scene)
+{
+	LightBVH lights;
+	lights.build(scene);
+	return lights;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "scene.h"
+#include "bvh.h"
+
+// An emitter's path from the light tree's root is stored in 32 bits
+const int LIGHT_BVH_MAX_DEPTH = 32;
+const int LIGHT_BVH_BINS = 12;
+
+// An emissive primitive for next-event estimation, laid out to match path_tracing.glsl (std430).
+// prim uses the BVH's encoding (BVH_TRIANGLE_BIT marks triangles) and emitters are sorted by it, so the
+// shader can find the emitter of a primitive it hit. Bit d of trail is set when the path from the light
+// tree's root to this emitter's leaf takes the right child at depth d.
+struct Emitter
+{
+	uint32_t prim;
+	uint32_t trail;
+};
+
+// Flattened light tree node, laid out to match the std430 LightNode struct in path_tracing.glsl.
+// Interior nodes have their children at child and child + 1, leaves hold one emitter as child = -1 - index.
+// Everything a node contains emits within cos_theta_e of some direction inside the cone (axis, cos_theta_o).
+struct LightNode
+{
+	glm::vec3 bounds_min;
+	float power;
+	glm::vec3 bounds_max;
+	int child;
+	glm::vec3 axis;
+	float cos_theta_o;
+	float cos_theta_e;
+	float std430padding[3];
+};
+
+struct LightBVHStats
+{
+	int n_emitters = 0;
+	int n_nodes = 0;
+	int max_depth = 0;
+	float avg_depth = 0.0f;
+	double build_ms = 0.0;
+
+	void print() const;
+};
+
+// Light hierarchy over the scene's emissive primitives, in the spirit of Conty Estevez & Kulla's
+// "Importance Sampling of Many Lights with Adaptive Tree Splitting". Shading points walk it from the
+// root and pick a child in proportion to an importance estimate built from its power, bounds and
+// orientation cone, so a light sample costs O(log n) and favours lights that matter for the point.
+class LightBVH
+{
+	struct BuildEmitter
+	{
+		AABB bounds;
+		glm::vec3 centroid;
+		float power;
+		glm::vec3 axis;
+		float theta_o;
+		float theta_e;
+	};
+
+	// Emitter indices, reordered so every node covers a contiguous range
+	std::vector<int> order;
+
+	void make_node(int node_idx, int first, int count, const std::vector<BuildEmitter>& build);
+	void subdivide(int node_idx, int first, int count, int depth, uint32_t trail, const std::vector<BuildEmitter>& build);
+
+public:
+	std::vector<Emitter> emitters;
+	std::vector<LightNode> nodes;
+	LightBVHStats stats;
+
+	void build(const SceneData& scene);
+};
+
+inline float luminance(glm::vec3 colour)
+{
+	return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Power up to a constant factor
+inline float emitter_power(const SceneData& scene, uint32_t prim)
+{
+	if ((prim & BVH_TRIANGLE_BIT) != 0u) {
+		const Triangle& tri = scene.triangles[prim & ~BVH_TRIANGLE_BIT];
+		// Instanced meshes' own triangles, emissive instances are flattened into the scene's
+		if (tri.material < 0)
+			return 0.0f;
+		const Material& m = scene.materials[tri.material];
+		glm::vec3 a = scene.vertices[tri.v0].position;
+		glm::vec3 b = scene.vertices[tri.v1].position;
+		glm::vec3 c = scene.vertices[tri.v2].position;
+		float area = 0.5f * glm::length(glm::cross(b - a, c - a));
+		return area * m.emission_strength * luminance(m.emission_colour);
+	}
+	const Sphere& sphere = scene.spheres[prim];
+	const Material& m = scene.materials[sphere.material];
+	return 4.0f * 3.1415926535897932385f * sphere.radius * sphere.radius * m.emission_strength * luminance(m.emission_colour);
+}
+
+// Light tree over every primitive with a material that emits
+LightBVH build_light_bvh(const SceneData& scene);
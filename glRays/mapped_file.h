@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Read-only memory mapping of a whole file, lets loaders walk large files without copying them
+class MappedFile
+{
+	const char* ptr = nullptr;
+	size_t len = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int fd = -1;
+#endif
+
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() { close(); }
+
+	const char* data() const { return ptr; }
+	size_t size() const { return len; }
+
+	bool open(const char* path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			std::cerr << "ERROR::MAPPED_FILE::OPEN_FAILED '" << path << "'" << std::endl;
+			return false;
+		}
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		len = (size_t)file_size.QuadPart;
+		if (len == 0)
+			return true;
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+			ptr = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			std::cerr << "ERROR::MAPPED_FILE::OPEN_FAILED '" << path << "'" << std::endl;
+			return false;
+		}
+		struct stat st;
+		fstat(fd, &st);
+		len = (size_t)st.st_size;
+		if (len == 0)
+			return true;
+
+		void* p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			madvise(p, len, MADV_SEQUENTIAL);
+			ptr = (const char*)p;
+		}
+#endif
+		if (!ptr) {
+			std::cerr << "ERROR::MAPPED_FILE::MAP_FAILED '" << path << "'" << std::endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (ptr)
+			UnmapViewOfFile(ptr);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (ptr)
+			munmap((void*)ptr, len);
+		if (fd >= 0)
+			::close(fd);
+		fd = -1;
+#endif
+		ptr = nullptr;
+		len = 0;
+	}
+};
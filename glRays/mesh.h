@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// GPU-ready vertex, std430 layout with the texture coordinates packed into the vec3 padding
+struct Vertex
+{
+	glm::vec3 position;
+	float u;
+	glm::vec3 normal;
+	float v;
+};
+
+// Indexed triangle mesh, three indices per triangle
+struct Mesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	size_t n_triangles() const { return indices.size() / 3; }
+};
@@ -0,0 +1,293 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+
+#include <cstring>
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <iostream>
+
+namespace
+{
+	inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline const char* skip_blank(const char* p, const char* end)
+	{
+		while (p < end && is_blank(*p))
+			p++;
+		return p;
+	}
+
+	inline const char* next_line(const char* p, const char* end)
+	{
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		return nl ? nl + 1 : end;
+	}
+
+	inline const char* parse_float(const char* p, const char* end, float& out, bool& ok)
+	{
+		p = skip_blank(p, end);
+		if (p < end && *p == '+')
+			p++;
+		auto res = std::from_chars(p, end, out);
+		if (res.ec != std::errc()) {
+			out = 0.0f;
+			ok = false;
+			return p;
+		}
+		return res.ptr;
+	}
+
+	inline const char* parse_index(const char* p, const char* end, long long& out, bool& ok)
+	{
+		auto res = std::from_chars(p, end, out);
+		if (res.ec != std::errc()) {
+			ok = false;
+			return p;
+		}
+		return res.ptr;
+	}
+
+	// OBJ indices are 1-based and may be negative (relative to the end), 0 means absent
+	inline uint32_t resolve_index(long long idx, size_t count, bool& ok)
+	{
+		if (idx < 0)
+			idx += (long long)count + 1;
+		if (idx <= 0 || idx > (long long)count) {
+			ok = false;
+			return 0;
+		}
+		return (uint32_t)idx;
+	}
+
+	// Open-addressing map from (position, texcoord, normal) index triples to output vertex indices.
+	// Uses one flat table so the per-corner lookup never allocates.
+	class VertexCache
+	{
+		struct Slot
+		{
+			uint32_t v = 0, vt = 0, vn = 0;
+			uint32_t index = 0;
+		};
+
+		std::vector<Slot> slots;
+		size_t used = 0;
+
+		static size_t hash(uint32_t v, uint32_t vt, uint32_t vn)
+		{
+			uint64_t h = v * 0x9E3779B97F4A7C15ull ^ vt * 0xC2B2AE3D27D4EB4Full ^ vn * 0x165667B19E3779F9ull;
+			return (size_t)(h ^ (h >> 29));
+		}
+
+		void grow()
+		{
+			std::vector<Slot> old = std::move(slots);
+			slots.assign(old.empty() ? 1024 : old.size() * 2, Slot());
+			for (const Slot& s : old) {
+				if (s.v == 0)
+					continue;
+				size_t mask = slots.size() - 1;
+				size_t i = hash(s.v, s.vt, s.vn) & mask;
+				while (slots[i].v != 0)
+					i = (i + 1) & mask;
+				slots[i] = s;
+			}
+		}
+
+	public:
+		void reserve(size_t n)
+		{
+			size_t cap = 1024;
+			while (cap < n * 2)
+				cap *= 2;
+			slots.assign(cap, Slot());
+			used = 0;
+		}
+
+		// Returns the existing index for the triple, or stores new_index and sets inserted
+		uint32_t find_or_insert(uint32_t v, uint32_t vt, uint32_t vn, uint32_t new_index, bool& inserted)
+		{
+			if ((used + 1) * 2 > slots.size())
+				grow();
+
+			size_t mask = slots.size() - 1;
+			size_t i = hash(v, vt, vn) & mask;
+			while (slots[i].v != 0) {
+				if (slots[i].v == v && slots[i].vt == vt && slots[i].vn == vn) {
+					inserted = false;
+					return slots[i].index;
+				}
+				i = (i + 1) & mask;
+			}
+			slots[i] = { v, vt, vn, new_index };
+			used++;
+			inserted = true;
+			return new_index;
+		}
+	};
+}
+
+void OBJLoadStats::print(const char* path) const
+{
+	double seconds = parse_ms / 1000.0;
+	double mb = file_bytes / (1024.0 * 1024.0);
+	std::clog << std::format("Loaded '{}': {:.1f}MB in {:.1f}ms ({:.1f} MB/s, {:.2f}M triangles/s)",
+		path, mb, parse_ms, seconds > 0.0 ? mb / seconds : 0.0, seconds > 0.0 ? n_triangles / seconds / 1e6 : 0.0) << std::endl;
+	std::clog << std::format("    {} triangles, {} vertices from {} corners ({} positions)",
+		n_triangles, n_vertices, n_vertex_refs, n_positions) << std::endl;
+	if (n_skipped_faces > 0)
+		std::cerr << std::format("WARNING::OBJ::SKIPPED_MALFORMED_FACES {}", n_skipped_faces) << std::endl;
+}
+
+bool load_obj(const char* path, Mesh& mesh, OBJLoadStats* stats)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+
+	const char* p = file.data();
+	const char* end = p + file.size();
+
+	// Rough guesses from typical OBJ line lengths, just to avoid most regrowth
+	size_t estimate = file.size() / 40;
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> texcoords;
+	positions.reserve(estimate);
+	normals.reserve(estimate);
+	texcoords.reserve(estimate);
+
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.vertices.reserve(estimate);
+	mesh.indices.reserve(estimate * 3);
+
+	VertexCache cache;
+	cache.reserve(estimate);
+	std::vector<uint8_t> needs_normal;
+	size_t n_vertex_refs = 0, n_skipped_faces = 0;
+
+	while (p < end) {
+		p = skip_blank(p, end);
+		if (p >= end)
+			break;
+
+		if (p[0] == 'v' && p + 1 < end) {
+			bool ok = true;
+			if (is_blank(p[1])) {
+				glm::vec3 v;
+				p = parse_float(p + 1, end, v.x, ok);
+				p = parse_float(p, end, v.y, ok);
+				p = parse_float(p, end, v.z, ok);
+				positions.push_back(v);
+			}
+			else if (p[1] == 't' && p + 2 < end && is_blank(p[2])) {
+				glm::vec2 t;
+				p = parse_float(p + 2, end, t.x, ok);
+				p = parse_float(p, end, t.y, ok);
+				texcoords.push_back(t);
+			}
+			else if (p[1] == 'n' && p + 2 < end && is_blank(p[2])) {
+				glm::vec3 n;
+				p = parse_float(p + 2, end, n.x, ok);
+				p = parse_float(p, end, n.y, ok);
+				p = parse_float(p, end, n.z, ok);
+				normals.push_back(n);
+			}
+		}
+		else if (p[0] == 'f' && p + 1 < end && is_blank(p[1])) {
+			// Fan triangulate on the fly, so polygons of any size need no scratch storage
+			size_t face_start = mesh.indices.size();
+			uint32_t first = 0, prev = 0;
+			int corner = 0;
+			bool ok = true;
+			p++;
+
+			while (ok) {
+				p = skip_blank(p, end);
+				if (p >= end || *p == '\n' || *p == '#')
+					break;
+
+				long long vi = 0, ti = 0, ni = 0;
+				p = parse_index(p, end, vi, ok);
+				if (p < end && *p == '/') {
+					p++;
+					if (p < end && *p != '/')
+						p = parse_index(p, end, ti, ok);
+					if (p < end && *p == '/')
+						p = parse_index(p + 1, end, ni, ok);
+				}
+				if (!ok)
+					break;
+
+				uint32_t v = resolve_index(vi, positions.size(), ok);
+				uint32_t vt = ti != 0 ? resolve_index(ti, texcoords.size(), ok) : 0;
+				uint32_t vn = ni != 0 ? resolve_index(ni, normals.size(), ok) : 0;
+				if (!ok)
+					break;
+
+				bool inserted;
+				uint32_t idx = cache.find_or_insert(v, vt, vn, (uint32_t)mesh.vertices.size(), inserted);
+				if (inserted) {
+					Vertex vert;
+					vert.position = positions[v - 1];
+					vert.u = vt ? texcoords[vt - 1].x : 0.0f;
+					vert.v = vt ? texcoords[vt - 1].y : 0.0f;
+					vert.normal = vn ? normals[vn - 1] : glm::vec3(0.0f);
+					mesh.vertices.push_back(vert);
+					needs_normal.push_back(vn == 0);
+				}
+				n_vertex_refs++;
+
+				if (corner == 0) {
+					first = idx;
+				}
+				else if (corner >= 2) {
+					mesh.indices.push_back(first);
+					mesh.indices.push_back(prev);
+					mesh.indices.push_back(idx);
+				}
+				prev = idx;
+				corner++;
+			}
+
+			if (!ok) {
+				mesh.indices.resize(face_start);
+				n_skipped_faces++;
+			}
+		}
+
+		p = next_line(p, end);
+	}
+
+	// Area-weighted smooth normals for corners the file didn't give one
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+		if (!needs_normal[a] && !needs_normal[b] && !needs_normal[c])
+			continue;
+		glm::vec3 n = glm::cross(mesh.vertices[b].position - mesh.vertices[a].position,
+			mesh.vertices[c].position - mesh.vertices[a].position);
+		if (needs_normal[a]) mesh.vertices[a].normal += n;
+		if (needs_normal[b]) mesh.vertices[b].normal += n;
+		if (needs_normal[c]) mesh.vertices[c].normal += n;
+	}
+	for (Vertex& vert : mesh.vertices) {
+		float len = glm::length(vert.normal);
+		if (len > 0.0f)
+			vert.normal /= len;
+	}
+
+	auto end_time = std::chrono::steady_clock::now();
+	if (stats) {
+		stats->file_bytes = file.size();
+		stats->n_positions = positions.size();
+		stats->n_vertex_refs = n_vertex_refs;
+		stats->n_vertices = mesh.vertices.size();
+		stats->n_triangles = mesh.n_triangles();
+		stats->n_skipped_faces = n_skipped_faces;
+		stats->parse_ms = std::chrono::duration<double, std::milli>(end_time - start).count();
+	}
+
+	return true;
+}
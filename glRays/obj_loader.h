@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+#include "mesh.h"
+
+struct OBJLoadStats
+{
+	size_t file_bytes = 0;
+	size_t n_positions = 0;
+	size_t n_vertex_refs = 0; // face corners before deduplication
+	size_t n_vertices = 0;
+	size_t n_triangles = 0;
+	size_t n_skipped_faces = 0;
+	double parse_ms = 0.0;
+
+	void print(const char* path) const;
+};
+
+// Parses a Wavefront OBJ file into an indexed mesh. Corners sharing the same
+// position/texcoord/normal triple are merged into one vertex, polygons are fan
+// triangulated and missing normals are generated from the surrounding faces.
+bool load_obj(const char* path, Mesh& mesh, OBJLoadStats* stats = nullptr);
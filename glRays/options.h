@@ -2,6 +2,12 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include "sampler.h"
+#include "convergence.h"
+#include "profiler.h"
+#include "ray_stats.h"
+#include "scene_animation.h"
+
 class Options
 {
 public:
@@ -28,6 +34,32 @@ public:
 	// Ray training settings
 	int rt_rays_per_pixel = 1;
 	int rt_max_bounces = 4;
+	bool rt_use_cpu = false;
+	bool rt_use_wavefront = false;
+	bool rt_use_nee = true;
+	int rt_sampler = SAMPLER_SOBOL;
+	bool rt_adaptive = false;
+	float rt_adaptive_threshold = 0.02f;
+	int rt_adaptive_min_samples = 16;
+	ConvergencePolicy rt_convergence;
+	float rt_frame_budget_ms = 14.0f;
+
+	// Set by main so throughput can be shown as samples/second
+	int image_pixels = 0;
+	// Set by main each frame, tiles of the image still being sampled
+	int active_tiles = 0;
+	int total_tiles = 0;
+	// Set by main each frame, progress towards the convergence policy
+	int accumulated_samples = 0;
+	float accumulated_seconds = 0.0f;
+	bool converged = false;
+	// Set by main each frame, accumulation frames dispatched and the GPU time of one
+	int dispatches_per_frame = 1;
+	float dispatch_ms = -1.0f;
+	// Set by main, shown under its own header when there is one
+	GPUProfiler* profiler = nullptr;
+	const RayStats* ray_stats = nullptr;
+	SceneAnimator* animator = nullptr;
 
 	Options(Camera& camera) : cam(camera) {}
 
@@ -44,6 +76,8 @@ public:
 		ImGui::Text("Frame time: %.3fms", delta_time * 1000);
 		ImGui::SameLine();
 		ImGui::Text("    FPS: %.0f", 1.0 / delta_time);
+		float active_fraction = total_tiles > 0 ? (float)active_tiles / total_tiles : 1.0f;
+		ImGui::Text("Samples/s: %.2fM", image_pixels * active_fraction * rt_rays_per_pixel * dispatches_per_frame / delta_time / 1e6);
 		ImGui::PushItemWidth(125);
 
 		// Camera settings
@@ -83,6 +117,54 @@ public:
 		if (ImGui::SliderInt("Bounce limit", &rt_max_bounces, 0, 16, "%d", ImGuiSliderFlags_AlwaysClamp))
 			camera_moved = true;
 		ImGui::SliderInt("Samples/pixel", &rt_rays_per_pixel, 1, 8, "%d", ImGuiSliderFlags_AlwaysClamp);
+		// Frames of samples/pixel each are dispatched until the budget is spent, zero is one per displayed frame
+		ImGui::SliderFloat("Frame budget", &rt_frame_budget_ms, 0.0f, 50.0f, "%.1fms", ImGuiSliderFlags_AlwaysClamp);
+		if (dispatch_ms >= 0.0f)
+			ImGui::Text("Dispatches/frame: %d (%.2fms each)", dispatches_per_frame, dispatch_ms);
+		if (ImGui::Checkbox("Light sampling (NEE)", &rt_use_nee))
+			camera_moved = true;
+		const char* samplers[] = { sampler_name(SAMPLER_PCG), sampler_name(SAMPLER_SOBOL), sampler_name(SAMPLER_BLUE_NOISE) };
+		if (ImGui::Combo("Sampler", &rt_sampler, samplers, SAMPLER_COUNT))
+			camera_moved = true;
+		if (ImGui::Checkbox("CPU backend", &rt_use_cpu))
+			camera_moved = true;
+		ImGui::BeginDisabled(rt_use_cpu);
+		if (ImGui::Checkbox("Wavefront kernels", &rt_use_wavefront))
+			camera_moved = true;
+
+		// Only changes where samples go from now on, what's accumulated stays valid
+		ImGui::BeginDisabled(rt_convergence.mode == CONVERGE_NOISE);
+		ImGui::Checkbox("Adaptive sampling", &rt_adaptive);
+		ImGui::EndDisabled();
+		ImGui::BeginDisabled(!rt_adaptive);
+		ImGui::SliderFloat("Error threshold", &rt_adaptive_threshold, 0.001f, 0.2f, "%.3f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_Logarithmic);
+		ImGui::SliderInt("Min samples", &rt_adaptive_min_samples, 2, 256, "%d", ImGuiSliderFlags_AlwaysClamp);
+		if (active_tiles == 0)
+			ImGui::Text("Converged");
+		else
+			ImGui::Text("Active tiles: %d / %d", active_tiles, total_tiles);
+		ImGui::EndDisabled();
+		ImGui::EndDisabled();
+
+		// Tracing stops once the policy is met and resumes as soon as it no longer is
+		ImGui::SeparatorText("Convergence");
+		const char* modes[] = { convergence_mode_name(CONVERGE_NEVER), convergence_mode_name(CONVERGE_SAMPLES), convergence_mode_name(CONVERGE_NOISE), convergence_mode_name(CONVERGE_TIME) };
+		ImGui::Combo("Stop after", &rt_convergence.mode, modes, CONVERGE_MODE_COUNT);
+		// The noise threshold is adaptive sampling's error threshold, it's what measures the noise
+		if (rt_convergence.mode == CONVERGE_NOISE)
+			rt_adaptive = true;
+		if (rt_convergence.mode == CONVERGE_SAMPLES || rt_convergence.mode == CONVERGE_NOISE)
+			ImGui::DragInt("Max samples", &rt_convergence.max_samples, 16.0f, 1, 1 << 20, "%d", ImGuiSliderFlags_AlwaysClamp);
+		if (rt_convergence.mode == CONVERGE_TIME)
+			ImGui::DragFloat("Time budget", &rt_convergence.time_budget, 1.0f, 1.0f, 3600.0f, "%.0fs", ImGuiSliderFlags_AlwaysClamp);
+		ImGui::Text("%d samples in %.1fs%s", accumulated_samples, accumulated_seconds, converged ? ", converged" : "");
+
+		if (profiler && ImGui::CollapsingHeader("GPU profiler"))
+			profiler->render_ui();
+		if (ray_stats && ray_stats->is_enabled() && ImGui::CollapsingHeader("Ray statistics"))
+			ray_stats->render_ui();
+		if (animator && animator->animated && ImGui::CollapsingHeader("Animation", ImGuiTreeNodeFlags_DefaultOpen))
+			animator->render_ui();
 
 		ImGui::End();
 
@@ -0,0 +1,833 @@
+// Scene data, sampling and intersection shared by the megakernel (compute.glsl) and the
+// wavefront stages (wavefront_*.glsl). Included after #version, the includer declares its own layout
+
+// Per-frame parameters, filled by one buffer upload per frame (FrameUniforms in frame_uniforms.h)
+layout(std140, binding = 0) uniform FrameUniforms
+{
+	mat4 camera_to_world;
+	int u_frame_count;
+	bool u_camera_moved;
+	float u_fov;
+	float u_cam_focus_distance;
+	float u_cam_defocus_strength;
+	int u_max_bounces;
+	int u_rays_per_pixel;
+	int u_emitter_count;
+	bool u_use_nee;
+	bool u_adaptive;
+	float u_adaptive_threshold;
+	int u_adaptive_min_samples;
+	int u_sampler;
+};
+
+const float PI = 3.1415926535897932385;
+const float INFINITY = 1.0 / 0.0;
+const int BVH_MAX_DEPTH = 32;
+const uint BVH_TRIANGLE_BIT = 0x80000000u;
+const uint BVH_INSTANCE_BIT = 0x40000000u;
+
+struct Ray
+{
+	vec3 origin;
+	vec3 direction;
+};
+
+struct Material
+{
+	vec3 albedo;
+    float roughness;
+    vec3 emission_colour;
+    float emission_strength;
+    vec3 specular_colour;
+    float specular_chance;
+	vec3 refraction_colour;
+    float refraction_chance;
+	float refraction_roughness;
+    float refractive_idx;
+    float std140padding1;
+    float std140padding2;
+};
+
+struct Sphere
+{
+	vec3 centre;
+	float radius;
+	int material;
+};
+
+struct Vertex
+{
+	vec3 position;
+	float u;
+	vec3 normal;
+	float v;
+};
+
+struct Triangle
+{
+	uint v0;
+	uint v1;
+	uint v2;
+	int material;
+};
+
+struct BVHNode
+{
+	vec3 bounds_min;
+	int left_first;
+	vec3 bounds_max;
+	int count;
+};
+
+// Mesh instance, rays are moved into the mesh's space and traced through its tree at root
+struct Instance
+{
+	vec4 world_to_object[3];	// rows of the 3x4 transform
+	int root;
+	int material;
+};
+
+struct HitInfo
+{
+	int material;
+	uint prim;	// BVH prim ref of the surface that was hit, the instance's ref for instanced meshes
+	vec3 point;
+	vec3 normal;
+	float dist;
+	bool collided;
+	bool from_inside;
+};
+
+layout (std430, binding = 2) readonly buffer sphere_buffer
+{
+	Sphere u_spheres[];
+};
+
+layout (std430, binding = 3) readonly buffer triangle_buffer
+{
+	Triangle u_triangles[];
+};
+
+layout (std430, binding = 4) readonly buffer bvh_node_buffer
+{
+	BVHNode u_bvh_nodes[];
+};
+
+layout (std430, binding = 5) readonly buffer bvh_prim_buffer
+{
+	uint u_bvh_prims[];
+};
+
+layout (std430, binding = 19) readonly buffer instance_buffer
+{
+	Instance u_instances[];
+};
+
+layout (std430, binding = 6) readonly buffer vertex_buffer
+{
+	Vertex u_vertices[];
+};
+
+layout (std430, binding = 7) readonly buffer material_buffer
+{
+	Material u_materials[];
+};
+
+// Emissive primitives sorted by prim, see lights.h. trail holds the path from the light tree's root
+struct Emitter
+{
+	uint prim;
+	uint trail;
+};
+
+layout (std430, binding = 13) readonly buffer emitter_buffer
+{
+	Emitter u_emitters[];
+};
+
+// Light tree node, children at child and child + 1 or a single emitter as child = -1 - index
+struct LightNode
+{
+	vec3 bounds_min;
+	float power;
+	vec3 bounds_max;
+	int child;
+	vec3 axis;
+	float cos_theta_o;
+	float cos_theta_e;
+};
+
+layout (std430, binding = 15) readonly buffer light_node_buffer
+{
+	LightNode u_light_nodes[];
+};
+
+// Next-event estimation sample, contribution counts only if the ray reaches prim unblocked
+struct ShadowRay
+{
+	Ray ray;
+	uint prim;
+	vec3 contribution;
+};
+
+
+/*
+	Utility functions
+*/
+
+#include "sampler.glsl"
+#include "ray_stats.glsl"
+
+// Random direction vector, uniform on the sphere
+vec3 random_direction()
+{
+	float z = 1.0 - 2.0 * rand();
+	float phi = 2.0 * PI * rand();
+	float r = sqrt(max(0.0, 1.0 - z * z));
+	return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+// Random direction vector in hemisphere based on normal, cosine-weighted distribution
+vec3 random_direction_hemisphere_cos(vec3 normal)
+{
+	return normalize(normal + random_direction());
+}
+
+vec3 random_in_unit_disc()
+{
+	float angle = rand() * 2 * PI;
+	vec3 point = vec3(cos(angle), sin(angle), 0.0f);
+	return point * sqrt(rand());
+
+	// while (true) {
+	// 	vec3 p = vec3(rand() * 2 - 1, rand() * 2 - 1, 0);
+	// 	if (dot(p, p) < 1)
+	// 		return p;
+	// }
+}
+
+/*
+	Ray tracing related functions
+*/
+
+// Schlick Fresnel approximation
+float fresnel_reflect_amount(float n1, float n2, vec3 normal, vec3 incident, float f0, float f90)
+{
+	float r0 = (n1 - n2) / (n1 + n2);
+	r0 *= r0;
+	float cos_x = -dot(normal, incident);
+	if(n1 > n2) {
+		float n = n1 / n2;
+		float sin_t2 = n * n * (1.0 - cos_x * cos_x);
+		if(sin_t2 > 1.0)
+			return f90;
+		cos_x = sqrt(1.0 - sin_t2);
+	}
+	float x = 1.0 - cos_x;
+	float ret = r0 + (1.0 - r0) * pow(x, 5.0);
+
+	return mix(f0, f90, ret);
+}
+
+vec3 environment_light(Ray ray)
+{
+	vec3 colour_ground = vec3(0.5, 0.5, 0.5);
+	vec3 colour_sky_horizon = vec3(1.0, 1.0, 1.0);
+	vec3 colour_sky_zenith = vec3(0.5, 0.7, 1.0);
+	vec3 sun_direction = normalize(vec3(0.5, 1, -1));
+	float sun_focus = 50.0;
+	float sun_intensity = 20.0;
+
+	float gradient_interp = pow(smoothstep(0.0, 0.4, ray.direction.y), 0.35);
+	float ground_to_sky = smoothstep(-0.01, 0.0, ray.direction.y);
+	vec3 gradient = mix(colour_sky_horizon, colour_sky_zenith, gradient_interp);
+	float sun = pow(max(0, dot(ray.direction, sun_direction)), sun_focus) * sun_intensity;
+
+	vec3 composite = mix(colour_ground, gradient, ground_to_sky) + sun * float(ground_to_sky >= 1);
+	return composite;
+}
+
+HitInfo hit_triangle(Triangle tri, Ray ray)
+{
+	HitInfo hit;
+	hit.collided = false;
+	hit.from_inside = false;
+
+	Vertex A = u_vertices[tri.v0];
+	Vertex B = u_vertices[tri.v1];
+	Vertex C = u_vertices[tri.v2];
+
+	vec3 AB = B.position - A.position;
+	vec3 AC = C.position - A.position;
+	vec3 normal = cross(AB, AC);
+	float det = -dot(ray.direction, normal);
+	float invdet = 1.0 / det;
+	vec3 AO = ray.origin - A.position;
+	vec3 DAO = cross(AO, ray.direction);
+	float u = dot(AC, DAO) * invdet;
+	float v = -dot(AB, DAO) * invdet;
+	float w = 1 - u - v;
+	float t = dot(AO, normal) * invdet;
+
+	bool did_hit = (det >= 1e-6 && t >= 0.0 && u >= 0.0 && v >= 0.0 && (u+v) <= 1.0);
+
+	// Interpolate the vertex normals, falling back to the face normal if they cancel out
+	vec3 shading_normal = A.normal * w + B.normal * u + C.normal * v;
+	hit.collided = did_hit;
+	hit.point = ray.origin + ray.direction * t;
+	hit.normal = dot(shading_normal, shading_normal) > 0.0 ? normalize(shading_normal) : normalize(normal);
+	hit.dist = t;
+	return hit;
+}
+
+HitInfo hit_sphere(vec3 centre, float radius, float t_min, float t_max, Ray ray)
+{
+	HitInfo hit;
+	hit.collided = false;
+	hit.from_inside = false;
+
+	vec3 oc = centre - ray.origin;
+	float a = dot(ray.direction, ray.direction);
+	float h = dot(ray.direction, oc);
+	float c = dot(oc, oc) - radius * radius;
+
+	float discriminant = h * h - a * c;
+
+	if (discriminant < 0.0f)
+		return hit; // missed
+
+	// Try to find a root within interval (t_min, t_max)
+	float root = (h - sqrt(discriminant)) / a ;
+	if (root <= t_min || t_max <= root) {
+		root = (h + sqrt(discriminant)) / a ;
+		if (root <= t_min || t_max <= root)
+			return hit; // outside of acceptable range for t
+	}
+
+	hit.collided = true;
+	hit.dist = root;
+	hit.point = ray.origin + ray.direction * root;
+	hit.normal = (hit.point - centre) / radius;
+	hit.from_inside = dot(ray.direction, hit.normal) > 0.001f;
+	hit.normal = hit.from_inside ? -hit.normal : hit.normal;
+
+	return hit;
+}
+
+// Slab test, returns the entry distance or INFINITY on a miss
+float hit_aabb(vec3 bounds_min, vec3 bounds_max, Ray ray, vec3 inv_dir, float t_max)
+{
+	vec3 t0 = (bounds_min - ray.origin) * inv_dir;
+	vec3 t1 = (bounds_max - ray.origin) * inv_dir;
+	vec3 t_small = min(t0, t1);
+	vec3 t_big = max(t0, t1);
+	float t_near = max(max(t_small.x, t_small.y), max(t_small.z, 0.0));
+	float t_far = min(min(t_big.x, t_big.y), min(t_big.z, t_max));
+	return t_near <= t_far ? t_near : INFINITY;
+}
+
+void hit_primitive(uint prim, Ray ray, inout HitInfo closest)
+{
+	if ((prim & BVH_TRIANGLE_BIT) != 0u) {
+		Triangle tri = u_triangles[prim & ~BVH_TRIANGLE_BIT];
+		HitInfo hit = hit_triangle(tri, ray);
+
+		if (hit.collided && hit.dist < closest.dist) {
+			closest = hit;
+			closest.material = tri.material;
+			closest.prim = prim;
+		}
+	}
+	else {
+		Sphere sphere = u_spheres[prim];
+		HitInfo hit = hit_sphere(sphere.centre, sphere.radius, 0.001f, closest.dist, ray);
+
+		if (hit.collided && hit.dist < closest.dist) {
+			closest = hit;
+			closest.material = sphere.material;
+			closest.prim = prim;
+		}
+	}
+}
+
+// Traces the ray through an instanced mesh's tree in the mesh's space. The direction isn't renormalised there,
+// so distances match the world ray's and the hit only needs its normal brought back.
+void hit_instance(uint instance_idx, Ray ray, inout HitInfo closest)
+{
+	Instance instance = u_instances[instance_idx];
+	Ray local;
+	local.origin = vec3(dot(instance.world_to_object[0], vec4(ray.origin, 1.0)), dot(instance.world_to_object[1], vec4(ray.origin, 1.0)), dot(instance.world_to_object[2], vec4(ray.origin, 1.0)));
+	local.direction = vec3(dot(instance.world_to_object[0].xyz, ray.direction), dot(instance.world_to_object[1].xyz, ray.direction), dot(instance.world_to_object[2].xyz, ray.direction));
+
+	vec3 inv_dir = 1.0 / local.direction;
+	if (hit_aabb(u_bvh_nodes[instance.root].bounds_min, u_bvh_nodes[instance.root].bounds_max, local, inv_dir, closest.dist) == INFINITY)
+		return;
+
+	// Same traversal as ray_collision(), the mesh's tree only holds triangles
+	int stack[BVH_MAX_DEPTH];
+	int stack_ptr = 0;
+	int node_idx = instance.root;
+	bool found = false;
+	vec3 normal;
+	while (true) {
+		BVHNode node = u_bvh_nodes[node_idx];
+
+		if (node.count > 0) {
+			for (int i = 0; i < node.count; i++) {
+				HitInfo hit = hit_triangle(u_triangles[u_bvh_prims[node.left_first + i] & ~BVH_TRIANGLE_BIT], local);
+				if (hit.collided && hit.dist < closest.dist) {
+					closest.dist = hit.dist;
+					normal = hit.normal;
+					found = true;
+				}
+			}
+
+			if (stack_ptr == 0)
+				break;
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		int near_idx = node.left_first;
+		int far_idx = node.left_first + 1;
+		float near_dist = hit_aabb(u_bvh_nodes[near_idx].bounds_min, u_bvh_nodes[near_idx].bounds_max, local, inv_dir, closest.dist);
+		float far_dist = hit_aabb(u_bvh_nodes[far_idx].bounds_min, u_bvh_nodes[far_idx].bounds_max, local, inv_dir, closest.dist);
+		if (far_dist < near_dist) {
+			int tmp_idx = near_idx; near_idx = far_idx; far_idx = tmp_idx;
+			float tmp_dist = near_dist; near_dist = far_dist; far_dist = tmp_dist;
+		}
+
+		if (near_dist == INFINITY) {
+			if (stack_ptr == 0)
+				break;
+			node_idx = stack[--stack_ptr];
+		}
+		else {
+			node_idx = near_idx;
+			if (far_dist != INFINITY)
+				stack[stack_ptr++] = far_idx;
+		}
+	}
+
+	if (!found)
+		return;
+	// Normals go back through the inverse transpose, whose 3x3 part is the world_to_object rows as columns
+	closest.collided = true;
+	closest.from_inside = false;
+	closest.material = instance.material;
+	closest.prim = instance_idx | BVH_INSTANCE_BIT;
+	closest.point = ray.origin + ray.direction * closest.dist;
+	closest.normal = normalize(instance.world_to_object[0].xyz * normal.x + instance.world_to_object[1].xyz * normal.y + instance.world_to_object[2].xyz * normal.z);
+}
+
+HitInfo ray_collision(Ray ray)
+{
+	HitInfo closest;
+	closest.dist = INFINITY;
+	closest.material = -1;
+	closest.prim = 0u;
+	closest.collided = false;
+	closest.from_inside = false;
+
+	// An empty scene's root has no children, and its inverted bounds would still pass the slab test
+	vec3 inv_dir = 1.0 / ray.direction;
+	if (u_bvh_nodes[0].count == 0 && u_bvh_nodes[0].left_first == 0)
+		return closest;
+	if (hit_aabb(u_bvh_nodes[0].bounds_min, u_bvh_nodes[0].bounds_max, ray, inv_dir, INFINITY) == INFINITY)
+		return closest;
+
+	// Depth-first traversal, always descending into the nearer child first
+	int stack[BVH_MAX_DEPTH];
+	int stack_ptr = 0;
+	int node_idx = 0;
+	while (true) {
+		BVHNode node = u_bvh_nodes[node_idx];
+
+		if (node.count > 0) {
+			for (int i = 0; i < node.count; i++) {
+				uint prim = u_bvh_prims[node.left_first + i];
+				if ((prim & (BVH_TRIANGLE_BIT | BVH_INSTANCE_BIT)) == BVH_INSTANCE_BIT)
+					hit_instance(prim & ~BVH_INSTANCE_BIT, ray, closest);
+				else
+					hit_primitive(prim, ray, closest);
+			}
+
+			if (stack_ptr == 0)
+				break;
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		int near_idx = node.left_first;
+		int far_idx = node.left_first + 1;
+		float near_dist = hit_aabb(u_bvh_nodes[near_idx].bounds_min, u_bvh_nodes[near_idx].bounds_max, ray, inv_dir, closest.dist);
+		float far_dist = hit_aabb(u_bvh_nodes[far_idx].bounds_min, u_bvh_nodes[far_idx].bounds_max, ray, inv_dir, closest.dist);
+		if (far_dist < near_dist) {
+			int tmp_idx = near_idx; near_idx = far_idx; far_idx = tmp_idx;
+			float tmp_dist = near_dist; near_dist = far_dist; far_dist = tmp_dist;
+		}
+
+		if (near_dist == INFINITY) {
+			if (stack_ptr == 0)
+				break;
+			node_idx = stack[--stack_ptr];
+		}
+		else {
+			node_idx = near_idx;
+			if (far_dist != INFINITY)
+				stack[stack_ptr++] = far_idx;
+		}
+	}
+
+	return closest;
+}
+
+/*
+	Light sampling
+*/
+
+int prim_material(uint prim)
+{
+	return (prim & BVH_TRIANGLE_BIT) != 0u ? u_triangles[prim & ~BVH_TRIANGLE_BIT].material : u_spheres[prim].material;
+}
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b)
+{
+	return cos_a > cos_b ? 1.0 : cos_a * cos_b + sin_a * sin_b;
+}
+
+float sin_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b)
+{
+	return cos_a > cos_b ? 0.0 : sin_a * cos_b - cos_a * sin_b;
+}
+
+// Conservative estimate of how much light a light tree node sends to point: its power over the squared
+// distance, times the cosine of the smallest angle between the node's emission cone and the direction
+// to the point, with the node's bounding sphere widening that angle
+float light_importance(vec3 point, LightNode node)
+{
+	vec3 centre = (node.bounds_min + node.bounds_max) * 0.5;
+	vec3 half_diagonal = node.bounds_max - centre;
+	float radius2 = dot(half_diagonal, half_diagonal);
+	vec3 to_point = point - centre;
+	float dist2 = max(dot(to_point, to_point), radius2);
+
+	float cos_theta_w = dot(node.axis, to_point) * inversesqrt(max(dot(to_point, to_point), 1e-20));
+	float sin_theta_w = sqrt(max(0.0, 1.0 - cos_theta_w * cos_theta_w));
+	float sin_theta_o = sqrt(max(0.0, 1.0 - node.cos_theta_o * node.cos_theta_o));
+	// Inside the bounding sphere light can come from anywhere
+	float cos_theta_b = dot(to_point, to_point) < radius2 ? -1.0 : sqrt(max(0.0, 1.0 - radius2 / dist2));
+	float sin_theta_b = sqrt(max(0.0, 1.0 - cos_theta_b * cos_theta_b));
+
+	float cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, node.cos_theta_o);
+	float sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, node.cos_theta_o);
+	float cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+	if (cos_theta_p <= node.cos_theta_e)
+		return 0.0;
+	return node.power * cos_theta_p / dist2;
+}
+
+// Probability of picking child + 1 over child when walking the light tree from point, -1 if neither can light it
+float light_right_prob(vec3 point, int child)
+{
+	float left = light_importance(point, u_light_nodes[child]);
+	float right = light_importance(point, u_light_nodes[child + 1]);
+	return left + right > 0.0 ? right / (left + right) : -1.0;
+}
+
+// Walks the light tree from the root, picking children in proportion to their importance for point.
+// u is reused for every decision by rescaling it. Returns the emitter index, or -1 if no light reaches point.
+int pick_emitter(vec3 point, float u, out float pmf)
+{
+	pmf = 1.0;
+	int node = 0;
+	while (u_light_nodes[node].child >= 0) {
+		int child = u_light_nodes[node].child;
+		float p_right = light_right_prob(point, child);
+		if (p_right < 0.0)
+			return -1;
+		if (u < 1.0 - p_right) {
+			u = min(u / (1.0 - p_right), 0.99999994);
+			pmf *= 1.0 - p_right;
+			node = child;
+		}
+		else {
+			u = min((u - (1.0 - p_right)) / p_right, 0.99999994);
+			pmf *= p_right;
+			node = child + 1;
+		}
+	}
+	return -1 - u_light_nodes[node].child;
+}
+
+// Probability that pick_emitter() from point returns prim, following its emitter's trail down the tree
+float emitter_pmf(uint prim, vec3 point)
+{
+	int lo = 0;
+	int hi = u_emitter_count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (u_emitters[mid].prim < prim)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (u_emitters[lo].prim != prim)
+		return 0.0;
+
+	uint trail = u_emitters[lo].trail;
+	float pmf = 1.0;
+	int node = 0;
+	while (u_light_nodes[node].child >= 0) {
+		int child = u_light_nodes[node].child;
+		float p_right = light_right_prob(point, child);
+		if (p_right < 0.0)
+			return 0.0;
+		bool right = (trail & 1u) != 0u;
+		pmf *= right ? p_right : 1.0 - p_right;
+		node = child + int(right);
+		trail >>= 1;
+	}
+	return pmf;
+}
+
+// 1 - cos of the half-angle a sphere of radius r subtends at distance sqrt(d2), without the cancellation
+float sphere_cone_size(float r, float d2)
+{
+	float x = r * r / d2;
+	return x / (1.0 + sqrt(1.0 - x));
+}
+
+// Solid angle density of the direction from point towards light_point on prim, once prim has been picked
+float emitter_direction_pdf(uint prim, vec3 point, vec3 light_point)
+{
+	if ((prim & BVH_TRIANGLE_BIT) != 0u) {
+		Triangle tri = u_triangles[prim & ~BVH_TRIANGLE_BIT];
+		vec3 A = u_vertices[tri.v0].position;
+		vec3 normal = cross(u_vertices[tri.v1].position - A, u_vertices[tri.v2].position - A);
+		vec3 to_light = light_point - point;
+		float dist2 = dot(to_light, to_light);
+		float cos_light = abs(dot(to_light, normal)) / (sqrt(dist2) * length(normal));
+		float area = 0.5 * length(normal);
+		return cos_light > 0.0 ? dist2 / (area * cos_light) : 0.0;
+	}
+
+	Sphere sphere = u_spheres[prim];
+	vec3 to_centre = sphere.centre - point;
+	float dist2 = dot(to_centre, to_centre);
+	if (dist2 <= sphere.radius * sphere.radius)
+		return 0.0;
+	return 1.0 / (2.0 * PI * sphere_cone_size(sphere.radius, dist2));
+}
+
+// Solid angle density with which sample_emitter() picks the direction from point towards light_point on prim
+float emitter_pdf(uint prim, vec3 point, vec3 light_point)
+{
+	float pmf = emitter_pmf(prim, point);
+	return pmf > 0.0 ? pmf * emitter_direction_pdf(prim, point, light_point) : 0.0;
+}
+
+void orthonormal_basis(vec3 n, out vec3 t, out vec3 b)
+{
+	// Branchless construction from Duff et al. 2017
+	float s = n.z >= 0.0 ? 1.0 : -1.0;
+	float a = -1.0 / (s + n.z);
+	float c = n.x * n.y * a;
+	t = vec3(1.0 + s * n.x * n.x * a, s * c, -s * n.x);
+	b = vec3(c, s + n.y * n.y * a, -n.y);
+}
+
+// Picks an emitter through the light tree, then a direction towards it: uniform over a triangle's
+// area, uniform over the cone a sphere subtends. Always draws three random numbers.
+bool sample_emitter(vec3 point, out vec3 direction, out float pdf, out uint prim)
+{
+	float u_pick = rand();
+	float u1 = rand();
+	float u2 = rand();
+
+	float pmf;
+	int emitter = pick_emitter(point, u_pick, pmf);
+	if (emitter < 0)
+		return false;
+	prim = u_emitters[emitter].prim;
+
+	if ((prim & BVH_TRIANGLE_BIT) != 0u) {
+		Triangle tri = u_triangles[prim & ~BVH_TRIANGLE_BIT];
+		vec3 A = u_vertices[tri.v0].position;
+		vec3 B = u_vertices[tri.v1].position;
+		vec3 C = u_vertices[tri.v2].position;
+		float su = sqrt(u1);
+		vec3 light_point = A * (1.0 - su) + B * (u2 * su) + C * (su - u2 * su);
+		direction = normalize(light_point - point);
+
+		// Triangles are one-sided, only their front face can be hit
+		if (dot(direction, cross(B - A, C - A)) >= 0.0)
+			return false;
+		pdf = pmf * emitter_direction_pdf(prim, point, light_point);
+	}
+	else {
+		Sphere sphere = u_spheres[prim];
+		vec3 to_centre = sphere.centre - point;
+		float dist2 = dot(to_centre, to_centre);
+		if (dist2 <= sphere.radius * sphere.radius)
+			return false;
+
+		float cos_theta = 1.0 - u1 * sphere_cone_size(sphere.radius, dist2);
+		float sin_theta = sqrt(max(0.0, 1.0 - cos_theta * cos_theta));
+		float phi = 2.0 * PI * u2;
+		vec3 w = to_centre / sqrt(dist2);
+		vec3 t, b;
+		orthonormal_basis(w, t, b);
+		direction = normalize(t * (cos(phi) * sin_theta) + b * (sin(phi) * sin_theta) + w * cos_theta);
+		pdf = pmf * emitter_direction_pdf(prim, point, sphere.centre);
+	}
+	return pdf > 0.0;
+}
+
+float power_heuristic(float pdf_a, float pdf_b)
+{
+	float a2 = pdf_a * pdf_a;
+	return a2 / (a2 + pdf_b * pdf_b);
+}
+
+// Whether the shadow ray's closest hit is the emitter it was aimed at
+bool shadow_visible(ShadowRay shadow)
+{
+	HitInfo hit = ray_collision(shadow.ray);
+	RAY_STATS_TRACED(RAY_KIND_SHADOW);
+	return hit.collided && hit.prim == shadow.prim;
+}
+
+// Shades a hit and turns the ray into the next bounce, adding the surface's emission to incoming_light.
+// bsdf_pdf carries the density of a diffuse bounce towards this hit when it has to be MIS weighted
+// against light sampling (0 otherwise), and is updated for the next hit. With allow_nee, diffuse
+// bounces also sample a light; shadow.contribution is then non-zero and the caller traces shadow.ray.
+// Returns false when Russian roulette ends the path
+bool scatter(HitInfo hit, inout Ray ray, inout vec3 ray_colour, inout vec3 incoming_light, inout float bsdf_pdf, bool allow_nee, out ShadowRay shadow)
+{
+	Material material = u_materials[hit.material];
+
+	// Light sampling could have found this emitter too, so only keep the BSDF sample's share of it
+	float emission_weight = 1.0;
+	if (bsdf_pdf > 0.0 && material.emission_strength > 0.0)
+		emission_weight = power_heuristic(bsdf_pdf, emitter_pdf(hit.prim, ray.origin, hit.point));
+
+	if (hit.from_inside)
+		ray_colour *= exp(-material.refraction_colour * hit.dist);
+
+	// Fresnel reflections
+	float spec_chance = material.specular_chance;
+	float ref_chance = material.refraction_chance;
+	float diff_chance = max(0.0f, 1.0f - spec_chance - ref_chance);
+	float ray_prob = 1.0f;
+	if (spec_chance > 0.0f) {
+		spec_chance = fresnel_reflect_amount(
+			hit.from_inside ? material.refractive_idx : 1.0,
+			!hit.from_inside ? material.refractive_idx : 1.0,
+			ray.direction, hit.normal, material.specular_chance, 1.0f
+		);
+		float chance_multiplier = (1.0f - spec_chance) / (1.0f - material.specular_chance);
+		ref_chance *= chance_multiplier;
+		diff_chance *= chance_multiplier;
+	}
+
+	// Determine if we're doing specular reflection, diffuse reflection, or refraction
+	float rng_roll = rand();
+	float is_specular = 0.0f;
+	float is_refract = 0.0f;
+
+	if (spec_chance > 0.0f && rng_roll < spec_chance) {
+		is_specular = 1.0f;
+		ray_prob = spec_chance;
+	}
+	else if (ref_chance > 0.0f && rng_roll < spec_chance + ref_chance) {
+		is_refract = 1.0f;
+		ray_prob = ref_chance;
+	}
+	else {
+		ray_prob = 1.0f - spec_chance - ref_chance;
+	}
+	ray_prob = max(ray_prob, 0.001f); // avoid divide by 0
+
+	// Update bounce ray pos based on if this is a refraction or not
+	if (is_refract == 1.0f)
+		ray.origin -= hit.normal * 0.001f;
+	else
+		ray.origin += hit.normal * 0.001f;
+
+	// Generate the new bounce ray
+	// Diffuse uses a cosine-weighted random direction in hemisphere
+	// 100% smooth specular uses a perfect reflection
+	// Rough specular lerps between smooth specular and diffuse
+	ray.origin = hit.point;
+	vec3 diffuse_ray_dir = random_direction_hemisphere_cos(hit.normal);
+	vec3 specular_ray_dir = reflect(ray.direction, hit.normal);
+	float ri = hit.from_inside ? material.refractive_idx : 1.0f / material.refractive_idx;
+	vec3 refract_ray_dir = refract(ray.direction, hit.normal, ri);
+	specular_ray_dir = mix(specular_ray_dir, diffuse_ray_dir, material.roughness * material.roughness);
+	refract_ray_dir = mix(refract_ray_dir, -diffuse_ray_dir, material.refraction_roughness * material.refraction_roughness);
+	ray.direction = mix(diffuse_ray_dir, specular_ray_dir, is_specular);
+	ray.direction = mix(ray.direction, refract_ray_dir, is_refract);
+
+	// Next-event estimation on diffuse bounces, weighted against the cosine-sampled bounce ray finding the light
+	shadow.contribution = vec3(0.0);
+	bsdf_pdf = 0.0;
+	if (allow_nee && u_use_nee && u_emitter_count > 0 && is_specular == 0.0f && is_refract == 0.0f) {
+		vec3 light_dir;
+		float light_pdf;
+		uint light_prim;
+		bool sampled = sample_emitter(hit.point, light_dir, light_pdf, light_prim);
+		float cos_surface = dot(hit.normal, light_dir);
+		if (sampled && cos_surface > 0.0) {
+			Material light = u_materials[prim_material(light_prim)];
+			vec3 light_emission = light.emission_colour * light.emission_strength;
+			float weight = power_heuristic(light_pdf, cos_surface / PI);
+			shadow.ray = Ray(hit.point, light_dir);
+			shadow.prim = light_prim;
+			shadow.contribution = ray_colour / ray_prob * (material.albedo / PI) * light_emission * (cos_surface / light_pdf) * weight;
+		}
+		bsdf_pdf = max(dot(hit.normal, ray.direction), 0.0) / PI;
+	}
+
+	vec3 emitted_light = material.emission_colour * material.emission_strength;
+	incoming_light += emitted_light * ray_colour * emission_weight;
+	if (is_refract == 0.0f)
+		ray_colour *= mix(material.albedo, material.specular_colour, is_specular);
+	ray_colour /= ray_prob;
+
+	// Russian Roulette -- rays with low brightness have high 
+	// probability to terminate early. Surviving rays are boosted
+	// to compensate for the reduced amount of samples. Survival is
+	// capped at 1, dividing by more would darken bright paths.
+	float p = min(max(ray_colour.r, max(ray_colour.g, ray_colour.b)), 1.0f);
+	sampler_bounce_dim(SAMPLER_ROULETTE_DIM);
+	if(rand() > p) {
+		RAY_STATS_ROULETTE_KILL();
+		return false;
+	}
+	ray_colour *= 1.0f / p;
+	return true;
+}
+
+// Primary ray through a jittered point of the pixel, with defocus blur from the lens
+Ray camera_ray(ivec2 pix_coords, ivec2 dims)
+{
+	float aspect_ratio = float(dims.x) / float(dims.y);
+
+	// Translate pixels from raster space -> NDC space -> screen space -> camera space
+	// Run-down of the math can be found here:
+	// https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-generating-camera-rays/generating-camera-rays.html
+	vec3 pixel_camera = vec3(
+		(2 * ((float(pix_coords.x) + rand()) / dims.x) - 1) * tan(u_fov / 2 * PI / 180) * aspect_ratio,
+		(2 * ((float(pix_coords.y) + rand()) / dims.y) - 1) * tan(u_fov / 2 * PI / 180),
+		-u_cam_focus_distance
+	);
+
+	// Camera space -> world space
+	vec3 jitter = random_in_unit_disc() * u_cam_defocus_strength;
+	vec3 ray_origin = vec3(camera_to_world * vec4(0.0f, 0.0f, 0.0f, 1.0f)) + jitter;
+	vec3 P_world = vec3(camera_to_world * vec4(pixel_camera, 1.0f));
+	vec3 ray_direction = normalize(P_world - ray_origin);
+	return Ray(ray_origin, ray_direction);
+}
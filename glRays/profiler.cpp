@@ -0,0 +1,113 @@
+#include "profiler.h"
+
+#include <imgui.h>
+
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+GPUProfiler::~GPUProfiler()
+{
+	for (Pass& pass : passes)
+		glDeleteQueries(2, pass.queries);
+}
+
+int GPUProfiler::add_pass(const std::string& name)
+{
+	Pass& pass = passes.emplace_back();
+	pass.name = name;
+	glGenQueries(2, pass.queries);
+	return (int)passes.size() - 1;
+}
+
+void GPUProfiler::new_frame()
+{
+	ticks++;
+	if (!paused)
+		frame++;
+	int row = frame % HISTORY_FRAMES;
+	int buffer = ticks % 2;
+
+	for (Pass& pass : passes) {
+		if (!paused)
+			pass.history[row] = 0.0f;
+
+		// The query this frame is about to reuse was issued two frames ago, a result that still isn't
+		// ready is dropped rather than waited on. A ready one goes into that frame's row, not this one's.
+		if (!pass.issued[buffer])
+			continue;
+		pass.issued[buffer] = false;
+		GLint available = 0;
+		glGetQueryObjectiv(pass.queries[buffer], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(pass.queries[buffer], GL_QUERY_RESULT, &ns);
+		record((int)(&pass - passes.data()), ns / 1e6f, pass.issued_frame[buffer]);
+	}
+}
+
+void GPUProfiler::begin(int pass)
+{
+	glBeginQuery(GL_TIME_ELAPSED, passes[pass].queries[ticks % 2]);
+}
+
+void GPUProfiler::end(int pass)
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	passes[pass].issued[ticks % 2] = true;
+	passes[pass].issued_frame[ticks % 2] = frame_index();
+}
+
+void GPUProfiler::record(int pass, float ms, int issued_frame)
+{
+	// Frames issued while paused, or so long ago the ring has moved past them, have no row
+	passes[pass].latest = ms;
+	if (issued_frame >= 0 && frame - issued_frame < HISTORY_FRAMES)
+		passes[pass].history[issued_frame % HISTORY_FRAMES] = ms;
+}
+
+void GPUProfiler::render_ui()
+{
+	ImGui::Checkbox("Pause", &paused);
+	ImGui::SameLine();
+	if (ImGui::Button("Export CSV") && write_csv(csv_path))
+		std::clog << std::format("Wrote profile '{}'", csv_path) << std::endl;
+
+	// Rings start after the head, so the plots scroll left with the newest frame on the right
+	int offset = (frame + 1) % HISTORY_FRAMES;
+	for (const Pass& pass : passes) {
+		float sum = 0.0f, peak = 0.0f;
+		for (float ms : pass.history) {
+			sum += ms;
+			peak = std::max(peak, ms);
+		}
+		std::string overlay = std::format("{:.2f}ms, avg {:.2f}ms, max {:.2f}ms", pass.latest, sum / HISTORY_FRAMES, peak);
+		ImGui::Text("%s", pass.name.c_str());
+		ImGui::PlotLines(std::format("##{}", pass.name).c_str(), pass.history.data(), HISTORY_FRAMES, offset, overlay.c_str(), 0.0f, std::max(peak * 1.2f, 0.1f), ImVec2(0.0f, 40.0f));
+	}
+}
+
+bool GPUProfiler::write_csv(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file) {
+		std::cerr << std::format("ERROR::PROFILER::FILE_NOT_WRITABLE '{}'", path) << std::endl;
+		return false;
+	}
+
+	file << "frame";
+	for (const Pass& pass : passes)
+		file << "," << pass.name;
+	file << "\n";
+
+	int rows = std::min(frame, HISTORY_FRAMES);
+	for (int f = frame - rows + 1; f <= frame; f++) {
+		file << f;
+		for (const Pass& pass : passes)
+			file << std::format(",{:.4f}", pass.history[f % HISTORY_FRAMES]);
+		file << "\n";
+	}
+	return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <string>
+#include <vector>
+
+// Per-pass GPU times of the viewer's frames. Each pass has two GL_TIME_ELAPSED queries used on alternate
+// frames, a frame reads the other one's result if it's ready and skips it otherwise, so nothing stalls.
+// Results arrive a couple of frames late and go into the row of the frame that issued them.
+// Passes timed some other way, like the path tracing batch the DispatchScheduler already times, are
+// recorded directly. Only one GL_TIME_ELAPSED query can be active at a time, so passes mustn't nest.
+class GPUProfiler
+{
+public:
+	static const int HISTORY_FRAMES = 240;
+
+private:
+	struct Pass
+	{
+		std::string name;
+		GLuint queries[2] = {};
+		bool issued[2] = {};
+		int issued_frame[2] = {};
+		float latest = 0.0f;
+		std::vector<float> history = std::vector<float>(HISTORY_FRAMES, 0.0f);
+	};
+
+	std::vector<Pass> passes;
+	int ticks = 0;		// displayed frames, picks the query of each pair
+	int frame = 0;		// frames of history, its ring's head is frame % HISTORY_FRAMES, stops while paused
+	bool paused = false;
+
+public:
+	// Where the UI's export button writes
+	std::string csv_path = "glRays_profile.csv";
+
+	GPUProfiler() = default;
+	~GPUProfiler();
+
+	GPUProfiler(const GPUProfiler&) = delete;
+	GPUProfiler& operator=(const GPUProfiler&) = delete;
+
+	// Registers a pass, returns the id begin(), end() and record() take
+	int add_pass(const std::string& name);
+
+	// Collects whatever results are ready and starts a new history row, once per displayed frame
+	void new_frame();
+
+	void begin(int pass);
+	void end(int pass);
+	// The history row of what's measured during this frame, -1 while paused. Passes timed elsewhere keep
+	// it with their measurement when that only resolves later.
+	int frame_index() const { return paused ? -1 : frame; }
+
+	// A time measured outside the profiler, for the row of the frame it was measured in
+	void record(int pass, float ms, int issued_frame);
+	void record(int pass, float ms) { record(pass, ms, frame_index()); }
+
+	// Rolling plots with the average and peak of each pass, inside whatever ImGui window is current
+	void render_ui();
+
+	// One row per frame of history, oldest first, one column of milliseconds per pass
+	bool write_csv(const std::string& path) const;
+};
@@ -0,0 +1,125 @@
+#include "ray_stats.h"
+
+#include <imgui.h>
+
+#include <format>
+#include <iostream>
+
+RayStatsTotals& RayStatsTotals::operator+=(const RayStatsCounters& snapshot)
+{
+	for (int i = 0; i < 3; i++)
+		rays[i] += snapshot.rays[i];
+	roulette_kills += snapshot.roulette_kills;
+	for (int i = 0; i < RAY_STATS_DEPTHS; i++)
+		path_depth[i] += snapshot.path_depth[i];
+	return *this;
+}
+
+RayStats::RayStats(bool enabled) : enabled(enabled)
+{
+	if (!enabled)
+		return;
+
+	counters.create_buffer();
+	counters.allocate(sizeof(RayStatsCounters));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counters.get_id());
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	counters.bind_base(RAY_STATS_BINDING);
+
+	readback.create_buffer();
+	readback.allocate(sizeof(RayStatsCounters));
+	last_snapshot = std::chrono::steady_clock::now();
+}
+
+RayStats::~RayStats()
+{
+	if (fence)
+		glDeleteSync(fence);
+}
+
+void RayStats::harvest()
+{
+	glDeleteSync(fence);
+	fence = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, readback.get_id());
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(RayStatsCounters), &latest);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	latest_seconds = pending_seconds;
+	totals += latest;
+}
+
+void RayStats::update()
+{
+	if (!enabled)
+		return;
+
+	// One snapshot in flight at a time, the counters keep counting until it's collected
+	if (fence) {
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			return;
+		harvest();
+	}
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, counters.get_id());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readback.get_id());
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(RayStatsCounters));
+	glClearBufferData(GL_COPY_READ_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	auto now = std::chrono::steady_clock::now();
+	pending_seconds = std::chrono::duration<double>(now - last_snapshot).count();
+	last_snapshot = now;
+}
+
+void RayStats::flush()
+{
+	if (!enabled)
+		return;
+	if (fence) {
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		harvest();
+	}
+	update();
+	glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	harvest();
+}
+
+void RayStats::print(const RayStatsTotals& stats, double seconds) const
+{
+	uint64_t rays = stats.total_rays();
+	uint64_t paths = 0;
+	for (uint64_t n : stats.path_depth)
+		paths += n;
+
+	std::clog << std::format("Ray stats: {:.2f}M rays/s, {} primary, {} bounce, {} shadow", rays / seconds / 1e6,
+		stats.rays[0], stats.rays[1], stats.rays[2]) << std::endl;
+	std::clog << std::format("  Russian roulette ended {:.1f}% of {} paths", paths > 0 ? 100.0 * stats.roulette_kills / paths : 0.0, paths) << std::endl;
+	std::string depths = "  Surfaces hit per path:";
+	for (int i = 0; i < RAY_STATS_DEPTHS; i++) {
+		if (stats.path_depth[i] > 0)
+			depths += std::format(" {}{}: {:.1f}%", i, i == RAY_STATS_DEPTHS - 1 ? "+" : "", 100.0 * stats.path_depth[i] / paths);
+	}
+	std::clog << depths << std::endl;
+}
+
+void RayStats::render_ui() const
+{
+	const RayStatsCounters& stats = latest;
+	double seconds = latest_seconds > 0.0 ? latest_seconds : 1.0;
+	uint64_t paths = 0;
+	for (uint32_t n : stats.path_depth)
+		paths += n;
+
+	ImGui::Text("Rays/s: %.2fM", stats.total_rays() / seconds / 1e6);
+	ImGui::Text("Primary %.2fM, bounce %.2fM, shadow %.2fM", stats.rays[0] / seconds / 1e6, stats.rays[1] / seconds / 1e6, stats.rays[2] / seconds / 1e6);
+	ImGui::Text("Roulette ended %.1f%% of paths", paths > 0 ? 100.0 * stats.roulette_kills / paths : 0.0);
+
+	float depths[RAY_STATS_DEPTHS];
+	for (int i = 0; i < RAY_STATS_DEPTHS; i++)
+		depths[i] = paths > 0 ? (float)stats.path_depth[i] / paths : 0.0f;
+	ImGui::PlotHistogram("##depths", depths, RAY_STATS_DEPTHS, 0, "Surfaces hit per path", 0.0f, 1.0f, ImVec2(0.0f, 60.0f));
+}
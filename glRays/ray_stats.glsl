@@ -0,0 +1,25 @@
+// Ray counters for profiling, read back by RayStats (ray_stats.h). The host defines RAY_STATS only when
+// they're wanted, otherwise every RAY_STATS_* macro is empty and the kernels carry no trace of them.
+
+const int RAY_KIND_PRIMARY = 0;
+const int RAY_KIND_BOUNCE = 1;
+const int RAY_KIND_SHADOW = 2;
+// Paths by the number of surfaces they hit, the last bin takes everything longer
+const int RAY_STATS_DEPTHS = 18;
+
+#ifdef RAY_STATS
+layout (std430, binding = 18) buffer ray_stats_buffer
+{
+	uint u_stat_rays[3];		// by RAY_KIND_*
+	uint u_stat_roulette_kills;
+	uint u_stat_path_depth[RAY_STATS_DEPTHS];
+};
+
+#define RAY_STATS_TRACED(kind) atomicAdd(u_stat_rays[kind], 1u)
+#define RAY_STATS_ROULETTE_KILL() atomicAdd(u_stat_roulette_kills, 1u)
+#define RAY_STATS_PATH_END(depth) atomicAdd(u_stat_path_depth[min(depth, RAY_STATS_DEPTHS - 1)], 1u)
+#else
+#define RAY_STATS_TRACED(kind)
+#define RAY_STATS_ROULETTE_KILL()
+#define RAY_STATS_PATH_END(depth)
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+#include "gl_buffer.h"
+
+const GLuint RAY_STATS_BINDING = 18;
+const int RAY_STATS_DEPTHS = 18;
+
+// std430 layout of ray_stats_buffer in ray_stats.glsl
+struct RayStatsCounters
+{
+	uint32_t rays[3] = {};			// primary, bounce, shadow
+	uint32_t roulette_kills = 0;
+	uint32_t path_depth[RAY_STATS_DEPTHS] = {};	// paths by the number of surfaces they hit
+
+	uint64_t total_rays() const { return (uint64_t)rays[0] + rays[1] + rays[2]; }
+};
+
+// The same counts summed over many snapshots, which overflow 32 bits within seconds on a fast GPU
+struct RayStatsTotals
+{
+	uint64_t rays[3] = {};
+	uint64_t roulette_kills = 0;
+	uint64_t path_depth[RAY_STATS_DEPTHS] = {};
+
+	uint64_t total_rays() const { return rays[0] + rays[1] + rays[2]; }
+	RayStatsTotals& operator+=(const RayStatsCounters& snapshot);
+};
+
+// Counts the rays the GPU path tracers trace. The kernels only count when compiled with defines(), a
+// disabled RayStats creates no buffers and the kernels are exactly the production ones. The counters are
+// copied out and cleared once per update() and read back behind a fence when the copy has finished, so
+// nothing waits on the GPU; each snapshot covers the time since the one before it.
+class RayStats
+{
+	bool enabled;
+	GLBuffer counters, readback;
+	GLsync fence = 0;
+
+	std::chrono::steady_clock::time_point last_snapshot;
+	double pending_seconds = 0.0;
+
+	RayStatsCounters latest;
+	double latest_seconds = 0.0;
+	RayStatsTotals totals;
+
+	void harvest();
+
+public:
+	RayStats(bool enabled);
+	~RayStats();
+
+	RayStats(const RayStats&) = delete;
+	RayStats& operator=(const RayStats&) = delete;
+
+	bool is_enabled() const { return enabled; }
+
+	// Shader defines for the kernels that should count, empty when disabled
+	std::string defines() const { return enabled ? "#define RAY_STATS\n" : ""; }
+
+	// Starts a new snapshot after the frame's dispatches and collects the previous one if it has arrived
+	void update();
+	// Waits for everything dispatched so far to be counted, for the end of a headless render
+	void flush();
+
+	// The latest snapshot and the seconds it covers
+	const RayStatsCounters& last_interval() const { return latest; }
+	double last_interval_seconds() const { return latest_seconds; }
+	// Everything counted since creation
+	const RayStatsTotals& total() const { return totals; }
+
+	// Rays per second, the mix of ray kinds, roulette's share of path ends and the depth distribution
+	void print(const RayStatsTotals& stats, double seconds) const;
+	// The same for the latest snapshot, inside whatever ImGui window is current
+	void render_ui() const;
+};
@@ -0,0 +1,21 @@
+# Writes OUTPUT, a header defining GLRAYS_REVISION as git describe of SOURCE_DIR. Run by the glRays_revision
+# target on every build, the header is only rewritten when the revision changed so nothing recompiles otherwise.
+set(revision "unknown")
+if (GIT_EXECUTABLE)
+	execute_process(COMMAND ${GIT_EXECUTABLE} describe --always --dirty
+		WORKING_DIRECTORY ${SOURCE_DIR}
+		OUTPUT_VARIABLE git_revision OUTPUT_STRIP_TRAILING_WHITESPACE ERROR_QUIET
+		RESULT_VARIABLE git_result)
+	if (git_result EQUAL 0 AND git_revision)
+		set(revision ${git_revision})
+	endif()
+endif()
+
+set(header "#pragma once\n\n#define GLRAYS_REVISION \"${revision}\"\n")
+set(previous "")
+if (EXISTS ${OUTPUT})
+	file(READ ${OUTPUT} previous)
+endif()
+if (NOT "${header}" STREQUAL "${previous}")
+	file(WRITE ${OUTPUT} "${header}")
+endif()
@@ -0,0 +1,169 @@
+#include "sampler.h"
+
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <iostream>
+
+const uint32_t SOBOL_DIRECTIONS[4][32] = {
+	{
+		0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+		0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+		0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+		0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u, 0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u
+	},
+	{
+		0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+		0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+		0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+		0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu
+	},
+	{
+		0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u, 0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+		0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u, 0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+		0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u, 0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+		0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u, 0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u
+	},
+	{
+		0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u, 0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+		0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u, 0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+		0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u, 0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+		0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u, 0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u
+	}
+};
+
+const char* sampler_name(SamplerType type)
+{
+	switch (type) {
+	case SAMPLER_PCG: return "pcg";
+	case SAMPLER_SOBOL: return "sobol";
+	case SAMPLER_BLUE_NOISE: return "bluenoise";
+	default: return "unknown";
+	}
+}
+
+bool sampler_by_name(const std::string& name, SamplerType& type)
+{
+	for (int i = 0; i < SAMPLER_COUNT; i++) {
+		if (name == sampler_name((SamplerType)i)) {
+			type = (SamplerType)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+namespace
+{
+	const float BLUE_NOISE_SIGMA = 1.5f;
+	const float BLUE_NOISE_INITIAL_FILL = 0.1f;
+
+	// Gaussian energy of a binary pattern on the torus, kept up to date as points are toggled
+	struct VoidAndCluster
+	{
+		int size;
+		std::vector<float> kernel;
+		std::vector<float> energy;
+		std::vector<char> pattern;
+
+		VoidAndCluster(int size) : size(size), kernel(size * size), energy(size * size, 0.0f), pattern(size * size, 0)
+		{
+			for (int y = 0; y < size; y++) {
+				for (int x = 0; x < size; x++) {
+					int dx = std::min(x, size - x);
+					int dy = std::min(y, size - y);
+					kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+				}
+			}
+		}
+
+		void toggle(int p)
+		{
+			pattern[p] = !pattern[p];
+			float sign = pattern[p] ? 1.0f : -1.0f;
+			int px = p % size, py = p / size;
+			for (int y = 0; y < size; y++) {
+				const float* row = &kernel[((y - py + size) % size) * size];
+				for (int x = 0; x < size; x++)
+					energy[y * size + x] += sign * row[(x - px + size) % size];
+			}
+		}
+
+		// Highest energy point that is set, or lowest energy point that isn't
+		int tightest_cluster() const { return extreme(1); }
+		int largest_void() const { return extreme(0); }
+
+		int extreme(char set) const
+		{
+			int best = -1;
+			for (int p = 0; p < size * size; p++) {
+				if (pattern[p] != set)
+					continue;
+				if (best < 0 || (set ? energy[p] > energy[best] : energy[p] < energy[best]))
+					best = p;
+			}
+			return best;
+		}
+	};
+
+	std::vector<uint32_t> build_blue_noise(int size)
+	{
+		int n = size * size;
+		VoidAndCluster vc(size);
+
+		// Random initial points, then move the tightest cluster into the largest void until it settles
+		uint32_t rng = 1u;
+		int initial = (int)(n * BLUE_NOISE_INITIAL_FILL);
+		for (int placed = 0; placed < initial;) {
+			rng = hash_uint(rng);
+			int p = (int)(rng % (uint32_t)n);
+			if (!vc.pattern[p]) {
+				vc.toggle(p);
+				placed++;
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			int cluster = vc.tightest_cluster();
+			vc.toggle(cluster);
+			int hole = vc.largest_void();
+			if (hole == cluster) {
+				vc.toggle(cluster);
+				break;
+			}
+			vc.toggle(hole);
+		}
+		VoidAndCluster initial_pattern = vc;
+
+		// Ranks below the initial points come from taking clusters away, the rest from filling voids
+		std::vector<int> rank(n, 0);
+		for (int r = initial - 1; r >= 0; r--) {
+			int cluster = vc.tightest_cluster();
+			vc.toggle(cluster);
+			rank[cluster] = r;
+		}
+		vc = initial_pattern;
+		for (int r = initial; r < n; r++) {
+			int hole = vc.largest_void();
+			vc.toggle(hole);
+			rank[hole] = r;
+		}
+
+		std::vector<uint32_t> tile(n);
+		for (int p = 0; p < n; p++)
+			tile[p] = (uint32_t)(((2 * (uint64_t)rank[p] + 1) << 31) / n);
+		return tile;
+	}
+}
+
+const std::vector<uint32_t>& blue_noise_tile()
+{
+	static const std::vector<uint32_t> tile = [] {
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint32_t> result = build_blue_noise(BLUE_NOISE_SIZE);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::clog << std::format("Blue noise {}x{} generated in {:.1f}ms", BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, ms) << std::endl;
+		return result;
+	}();
+	return tile;
+}
@@ -0,0 +1,155 @@
+// Random numbers for the path tracer, mirrored by sampler.h and the CPU tracer. rand() returns the next
+// dimension of the current sample. sampler_begin() starts a sample, sampler_bounce() moves to the
+// dimensions of a bounce, so low-discrepancy samplers give every dimension the same job in each sample.
+// Needs the FrameUniforms from path_tracing.glsl.
+
+const int SAMPLER_PCG = 0;
+const int SAMPLER_SOBOL = 1;
+const int SAMPLER_BLUE_NOISE = 2;
+
+const uint SAMPLER_CAMERA_DIMS = 4u;
+const uint SAMPLER_BOUNCE_DIMS = 8u;
+const uint SAMPLER_ROULETTE_DIM = 6u;
+const int BLUE_NOISE_SIZE = 64;
+
+const uint SOBOL_DIRECTIONS[4][32] = {
+	{
+		0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+		0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+		0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+		0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u, 0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u
+	},
+	{
+		0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+		0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+		0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+		0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu
+	},
+	{
+		0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u, 0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+		0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u, 0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+		0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u, 0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+		0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u, 0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u
+	},
+	{
+		0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u, 0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+		0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u, 0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+		0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u, 0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+		0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u, 0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u
+	}
+};
+
+// Tileable blue-noise ranks over the 32-bit range, see blue_noise_tile() in sampler.h
+layout (std430, binding = 17) readonly buffer blue_noise_buffer
+{
+	uint u_blue_noise[];
+};
+
+// PCG state, or the next dimension for the low-discrepancy samplers
+uint rng_state = 0;
+uint bounce_dims = SAMPLER_CAMERA_DIMS;
+uint sample_index = 0;
+ivec2 sample_pixel = ivec2(0);
+
+uint hash_uint(uint x)
+{
+	x = x * 747796405u + 2891336453u;
+	x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+	return (x >> 22) ^ x;
+}
+
+uint hash_combine(uint seed, uint v)
+{
+	return seed ^ (hash_uint(v) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+// Owen scrambling of the bits of x, most significant first
+uint nested_uniform_scramble(uint x, uint seed)
+{
+	x = bitfieldReverse(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return bitfieldReverse(x);
+}
+
+uint sobol(uint index, uint dim)
+{
+	uint x = 0u;
+	for (int bit = 0; index != 0u; bit++, index >>= 1)
+		if ((index & 1u) != 0u)
+			x ^= SOBOL_DIRECTIONS[dim][bit];
+	return x;
+}
+
+// Dimension dim of sample index of a scrambled Sobol sequence, padded past four dimensions by shuffling
+// the index per block of four (Burley, "Practical Hash-based Owen Scrambling")
+uint shuffled_scrambled_sobol(uint index, uint dim, uint seed)
+{
+	uint block_seed = hash_combine(seed, dim / 4u);
+	uint shuffled = nested_uniform_scramble(index, block_seed);
+	return nested_uniform_scramble(sobol(shuffled, dim % 4u), hash_combine(block_seed, dim % 4u));
+}
+
+// 24 bits so the conversion is exact
+float uint_to_unit_float(uint x)
+{
+	return float(x >> 8) * (1.0 / 16777216.0);
+}
+
+// Picks up a sample at its current dimension, e.g. in a later wavefront stage
+void sampler_resume(ivec2 pix_coords, uint index)
+{
+	sample_pixel = pix_coords;
+	sample_index = index;
+}
+
+// Starts sample index of a pixel. PCG seeds its stream at the first sample of a frame and carries on
+// through the frame's later samples, as it always has.
+void sampler_begin(ivec2 pix_coords, ivec2 dims, uint index)
+{
+	sampler_resume(pix_coords, index);
+	if (u_sampler != SAMPLER_PCG)
+		rng_state = 0u;
+	else if (index % uint(u_rays_per_pixel) == 0u)
+		rng_state = (pix_coords.y * dims.x * dims.y + pix_coords.x) + u_frame_count * 719393;
+}
+
+// Skips to the dimensions of a bounce, past whatever the previous bounce didn't use
+void sampler_bounce(int bounce)
+{
+	bounce_dims = SAMPLER_CAMERA_DIMS + uint(bounce) * SAMPLER_BOUNCE_DIMS;
+	if (u_sampler != SAMPLER_PCG)
+		rng_state = bounce_dims;
+}
+
+// Skips to one of the current bounce's dimensions, whichever of the ones before it were drawn
+void sampler_bounce_dim(uint dim)
+{
+	if (u_sampler != SAMPLER_PCG)
+		rng_state = bounce_dims + dim;
+}
+
+float rand()
+{
+	if (u_sampler == SAMPLER_PCG) {
+		rng_state = rng_state * 747796405 + 2891336453;
+		uint result = ((rng_state >> ((rng_state >> 28) + 4)) ^ rng_state) * 277803737;
+		result = (result >> 22) ^ result;
+		return result / 4294967295.0;
+	}
+
+	// Sobol scrambles every pixel's sequence on its own. Blue noise shares one sequence over the whole image
+	// and rotates each dimension by the blue-noise tile at its own offset.
+	uint dim = rng_state++;
+	uint seed = 0u, rotation = 0u;
+	if (u_sampler == SAMPLER_SOBOL) {
+		seed = hash_uint(uint(sample_pixel.y) * 65536u + uint(sample_pixel.x));
+	} else {
+		uvec2 p = (uvec2(sample_pixel) + uvec2(dim * 47u, dim * 29u)) % uint(BLUE_NOISE_SIZE);
+		rotation = u_blue_noise[p.y * uint(BLUE_NOISE_SIZE) + p.x];
+	}
+	return uint_to_unit_float(shuffled_scrambled_sobol(sample_index, dim, seed) + rotation);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Where the path tracer's random numbers come from, FrameUniforms::sampler and CPURenderParams::sampler.
+// Matches the SAMPLER_* constants in sampler.glsl.
+enum SamplerType
+{
+	SAMPLER_PCG = 0,		// white noise, a PCG hash stream per pixel
+	SAMPLER_SOBOL = 1,		// Owen-scrambled Sobol, scrambled independently per pixel
+	SAMPLER_BLUE_NOISE = 2,	// one Sobol sequence for every pixel, rotated per pixel by a blue-noise tile
+	SAMPLER_COUNT
+};
+
+// Random numbers are requested by dimension rather than drawn from a stream, so the same dimension does
+// the same job in every sample of a pixel: the camera takes the first ones, then every bounce its own block
+const uint32_t SAMPLER_CAMERA_DIMS = 4;		// pixel jitter x/y, lens u/v
+const uint32_t SAMPLER_BOUNCE_DIMS = 8;		// lobe, direction u/v, light pick, light u/v, roulette, spare
+// Bounces without a light sample skip its dimensions, roulette always reads this one
+const uint32_t SAMPLER_ROULETTE_DIM = 6;
+
+const int BLUE_NOISE_SIZE = 64;
+
+const char* sampler_name(SamplerType type);
+// Accepts the names sampler_name() returns, false for anything else
+bool sampler_by_name(const std::string& name, SamplerType& type);
+
+// Sobol generator matrices of the first four dimensions, the sequences are padded past that by
+// shuffling the sample index per block of four dimensions (Burley, "Practical Hash-based Owen Scrambling")
+extern const uint32_t SOBOL_DIRECTIONS[4][32];
+
+inline uint32_t reverse_bits(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+inline uint32_t hash_uint(uint32_t x)
+{
+	x = x * 747796405u + 2891336453u;
+	x = ((x >> ((x >> 28) + 4)) ^ x) * 277803737u;
+	return (x >> 22) ^ x;
+}
+
+inline uint32_t hash_combine(uint32_t seed, uint32_t v)
+{
+	return seed ^ (hash_uint(v) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+// Owen scrambling of the bits of x, most significant first
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+{
+	x = reverse_bits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverse_bits(x);
+}
+
+inline uint32_t sobol(uint32_t index, uint32_t dim)
+{
+	uint32_t x = 0u;
+	for (int bit = 0; index != 0u; bit++, index >>= 1)
+		if (index & 1u)
+			x ^= SOBOL_DIRECTIONS[dim][bit];
+	return x;
+}
+
+// Dimension dim of sample index of a scrambled Sobol sequence, every seed gives an independent sequence
+inline uint32_t shuffled_scrambled_sobol(uint32_t index, uint32_t dim, uint32_t seed)
+{
+	uint32_t block_seed = hash_combine(seed, dim / 4u);
+	uint32_t shuffled = nested_uniform_scramble(index, block_seed);
+	return nested_uniform_scramble(sobol(shuffled, dim % 4u), hash_combine(block_seed, dim % 4u));
+}
+
+// 24 bits so the conversion is exact in a float, on the CPU and the GPU alike
+inline float uint_to_unit_float(uint32_t x)
+{
+	return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Tileable BLUE_NOISE_SIZE^2 blue-noise ranks scaled to the full 32-bit range, so a rotation by them is an
+// exact wrapping add. Generated once with void-and-cluster (Ulichney 1993) and shared by the CPU tracer
+// and the GPU copy in SceneBuffers.
+const std::vector<uint32_t>& blue_noise_tile();
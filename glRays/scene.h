@@ -1,6 +1,16 @@
 #pragma once
 
+#include <string>
+#include <vector>
+#include <format>
+#include <iostream>
+#include <functional>
+#include <unordered_map>
+
 #include <glm/glm.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include "mesh.h"
 
 struct Material
 {
@@ -18,21 +28,147 @@ struct Material
     float std140padding2;
 };
 
+inline bool operator==(const Material& a, const Material& b)
+{
+    return a.albedo == b.albedo && a.roughness == b.roughness
+        && a.emission_colour == b.emission_colour && a.emission_strength == b.emission_strength
+        && a.specular_colour == b.specular_colour && a.specular_chance == b.specular_chance
+        && a.refraction_colour == b.refraction_colour && a.refraction_chance == b.refraction_chance
+        && a.refraction_roughness == b.refraction_roughness && a.refractive_idx == b.refractive_idx;
+}
+
+struct MaterialHash
+{
+    size_t operator()(const Material& m) const
+    {
+        const float fields[] = {
+            m.albedo.x, m.albedo.y, m.albedo.z, m.roughness,
+            m.emission_colour.x, m.emission_colour.y, m.emission_colour.z, m.emission_strength,
+            m.specular_colour.x, m.specular_colour.y, m.specular_colour.z, m.specular_chance,
+            m.refraction_colour.x, m.refraction_colour.y, m.refraction_colour.z, m.refraction_chance,
+            m.refraction_roughness, m.refractive_idx
+        };
+        size_t h = 0;
+        for (float f : fields)
+            h = h * 31 + std::hash<float>()(f);
+        return h;
+    }
+};
+
+// Primitives only carry an index into SceneData::materials, laid out to match compute.glsl (std430)
 struct Sphere
 {
-	Material material;
 	glm::vec3 centre;
 	float radius;
+	int material;
+	int std430padding[3];
+};
+
+// Indices into SceneData::vertices. Triangles of instanced meshes have material -1, their instances carry it.
+struct Triangle
+{
+	uint32_t v0, v1, v2;
+	int material;
+};
+
+// A mesh stored once in its own space, ranges of SceneData::vertices and SceneData::triangles
+struct SceneMesh
+{
+	uint32_t first_vertex, n_vertices;
+	uint32_t first_triangle, n_triangles;
+};
+
+// One placement of a SceneMesh, the BVH turns these into the records the shader reads
+struct MeshInstance
+{
+	glm::mat4 transform;	// object to world
+	int mesh;
+	int material;
+	int padding[2];
+};
+
+// Turns a sphere or an instance about an axis through centre as time passes, see animate_scene()
+struct SceneMotion
+{
+	glm::mat4 base;		// placement at time zero, a sphere's centre is its translation
+	glm::vec3 centre;
+	float speed;		// degrees per second
+	glm::vec3 axis;		// normalised
+	int sphere;			// index into spheres, or -1
+	int instance;		// index into instances, or -1
 };
 
 struct SceneData
 {
-	const void* objects;
-	size_t size;
-	int n_objects;
+	std::vector<Material> materials;
+	std::vector<Sphere> spheres;
+	std::vector<Vertex> vertices;
+	std::vector<Triangle> triangles;
+	std::vector<SceneMesh> meshes;
+	std::vector<MeshInstance> instances;
+	std::vector<SceneMotion> motions;
+
+	// Identical materials share a single entry in the material table
+	int add_material(const Material& material)
+	{
+		auto it = material_lookup.find(material);
+		if (it != material_lookup.end())
+			return it->second;
+
+		int idx = (int)materials.size();
+		materials.push_back(material);
+		material_lookup.emplace(material, idx);
+		return idx;
+	}
+
+	void add_sphere(glm::vec3 centre, float radius, const Material& material)
+	{
+		Sphere sphere = {};
+		sphere.centre = centre;
+		sphere.radius = radius;
+		sphere.material = add_material(material);
+		spheres.push_back(sphere);
+	}
+
+	// Standalone triangle with a flat normal, meshes share their vertices through add_mesh()
+	void add_triangle(const Material& material, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+	{
+		glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+		uint32_t base = (uint32_t)vertices.size();
+		for (glm::vec3 p : { a, b, c }) {
+			Vertex v = {};
+			v.position = p;
+			v.normal = normal;
+			vertices.push_back(v);
+		}
+		triangles.push_back({ base, base + 1, base + 2, add_material(material) });
+	}
+
+	void print_stats() const
+	{
+		size_t bytes = materials.size() * sizeof(Material) + spheres.size() * sizeof(Sphere)
+			+ vertices.size() * sizeof(Vertex) + triangles.size() * sizeof(Triangle);
+		// Same scene with a Material embedded in every primitive and three positions + normal per triangle
+		size_t embedded_bytes = spheres.size() * (sizeof(Material) + 16) + triangles.size() * (sizeof(Material) + 64);
+		std::clog << std::format("Scene: {} spheres, {} triangles, {} vertices, {} unique materials, {:.1f}KB ({:.1f}KB with per-primitive materials)",
+			spheres.size(), triangles.size(), vertices.size(), materials.size(), bytes / 1024.0, embedded_bytes / 1024.0) << std::endl;
+		if (!instances.empty()) {
+			// What flattening every instance into world-space triangles would have cost instead
+			size_t flat_triangles = 0;
+			for (const MeshInstance& instance : instances)
+				flat_triangles += meshes[instance.mesh].n_triangles;
+			std::clog << std::format("    {} instances of {} meshes, {} triangles if flattened",
+				instances.size(), meshes.size(), flat_triangles) << std::endl;
+		}
+		if (!motions.empty())
+			std::clog << std::format("    {} animated objects", motions.size()) << std::endl;
+	}
+
+private:
+	std::unordered_map<Material, int, MaterialHash> material_lookup;
 };
 
-Material default_material()
+inline Material default_material()
 {
     Material m;
     m.albedo = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -45,11 +181,13 @@ Material default_material()
     m.refraction_chance = 0.0f;
     m.refraction_roughness = 0.0f;
     m.refractive_idx = 1.0f;
+    m.std140padding1 = 0.0f;
+    m.std140padding2 = 0.0f;
 
     return m;
 }
 
-Material refractive(float rough, float chance=1.0f)
+inline Material refractive(float rough, float chance=1.0f)
 {
     Material m;
     m.albedo = glm::vec3(0.9f, 0.25f, 0.25f);
@@ -62,10 +200,12 @@ Material refractive(float rough, float chance=1.0f)
     m.refraction_chance = 1.0f;
     m.refraction_roughness = rough;
     m.refractive_idx = 1.5f;
+    m.std140padding1 = 0.0f;
+    m.std140padding2 = 0.0f;
     return m;
 }
 
-Material reflective(float rough, float prob=1.0f)
+inline Material reflective(float rough, float prob=1.0f)
 {
     Material m;
     m.albedo = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -78,347 +218,91 @@ Material reflective(float rough, float prob=1.0f)
     m.refraction_chance = 0.0f;
     m.refraction_roughness = 0.0f;
     m.refractive_idx = 1.0f;
+    m.std140padding1 = 0.0f;
+    m.std140padding2 = 0.0f;
     return m;
 }
 
-SceneData cornell_box_diffuse() 
+// Appends a mesh to the scene, transformed into world space. Its vertices stay shared between triangles.
+inline void add_mesh(SceneData& scene, const Mesh& mesh, const Material& material, const glm::mat4& transform = glm::mat4(1.0f))
 {
-	const int NUM_SPHERES = 8;
-
-    Sphere* spheres = new Sphere[NUM_SPHERES];
-
-    Sphere sphere0;
-    sphere0.centre = glm::vec3(-0.6f, 1.0f, -1.0f);
-    sphere0.radius = 0.12f;
-    sphere0.material = default_material();
-    sphere0.material.albedo = glm::vec3(1.0f, 0.0f, 0.0);
-
-    Sphere sphere1;
-    sphere1.centre = glm::vec3(-0.3f, 1.0f, -1.0f);
-    sphere1.radius = 0.12f;
-    sphere1.material = default_material();
-    sphere1.material.albedo = glm::vec3(0.0f, 1.0f, 0.0f);
-
-    Sphere sphere2;
-    sphere2.centre = glm::vec3(0.0f, 1.0f, -1.0f);
-    sphere2.radius = 0.12f;
-    sphere2.material = default_material();
-	sphere2.material.albedo = glm::vec3(0.0f, 0.0f, 1.0f);
-
-    Sphere sphere3;
-    sphere3.centre = glm::vec3(0.3f, 1.0f, -1.0f);
-    sphere3.radius = 0.12f;
-    sphere3.material = default_material();
-	sphere3.material.albedo = glm::vec3(0.0f, 1.0f, 0.0f);
-
-    Sphere sphere4;
-    sphere4.centre = glm::vec3(0.6f, 1.0f, -1.0f);
-    sphere4.radius = 0.12f;
-    sphere4.material = default_material();
-	sphere4.material.albedo = glm::vec3(0.0f, 1.0f, 0.0f);
-
-    Sphere sphere5;
-    sphere5.centre = glm::vec3(-0.7f, 0.29f, -0.7f);
-    sphere5.radius = 0.3f;
-    sphere5.material = default_material();
-    sphere5.material.albedo = glm::vec3(1.0f, 1.0f, 0.6f);
-
-    Sphere sphere6;
-    sphere6.centre = glm::vec3(0.0f, 0.3f, -0.7f);
-    sphere6.radius = 0.3f;
-    sphere6.material = default_material();
-    sphere6.material.albedo = glm::vec3(1.0f, 0.6f, 0.6f);
-
-    Sphere sphere7;
-    sphere7.centre = glm::vec3(0.7f, 0.3f, -0.7f);
-    sphere7.radius = 0.3f;
-    sphere7.material = default_material();
-
-    spheres[0] = sphere0;
-    spheres[1] = sphere1;
-    spheres[2] = sphere2;
-    spheres[3] = sphere3;
-    spheres[4] = sphere4;
-    spheres[5] = sphere5;
-    spheres[6] = sphere6;
-    spheres[7] = sphere7;
-
-    SceneData sceneData;
-    sceneData.objects = spheres;
-    sceneData.n_objects = NUM_SPHERES;
-    sceneData.size = sceneData.n_objects * sizeof(Sphere);
-
-	return sceneData;
+    int material_idx = scene.add_material(material);
+    uint32_t base = (uint32_t)scene.vertices.size();
+    glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+    scene.vertices.reserve(scene.vertices.size() + mesh.vertices.size());
+    for (const Vertex& v : mesh.vertices) {
+        Vertex world = v;
+        world.position = glm::vec3(transform * glm::vec4(v.position, 1.0f));
+        glm::vec3 n = normal_matrix * v.normal;
+        float len = glm::length(n);
+        world.normal = len > 0.0f ? n / len : n;
+        scene.vertices.push_back(world);
+    }
+
+    scene.triangles.reserve(scene.triangles.size() + mesh.n_triangles());
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        scene.triangles.push_back({ base + mesh.indices[i], base + mesh.indices[i + 1], base + mesh.indices[i + 2], material_idx });
 }
 
-SceneData cornell_box_metallic() 
+// Stores a mesh once, untransformed, for add_instance() to place any number of times
+inline int add_instanced_mesh(SceneData& scene, const Mesh& mesh)
 {
-	const int NUM_SPHERES = 8;
-
-    Sphere* spheres = new Sphere[NUM_SPHERES];
-
-    Sphere sphere0;
-    sphere0.centre = glm::vec3(-0.6f, 1.0f, -1.0f);
-    sphere0.radius = 0.12f;
-    sphere0.material = reflective(0.0f);
-
-    Sphere sphere1;
-    sphere1.centre = glm::vec3(-0.3f, 1.0f, -1.0f);
-    sphere1.radius = 0.12f;
-    sphere1.material = reflective(0.25f);
-
-    Sphere sphere2;
-    sphere2.centre = glm::vec3(0.0f, 1.0f, -1.0f);
-    sphere2.radius = 0.12f;
-    sphere2.material = reflective(0.5f);
-
-    Sphere sphere3;
-    sphere3.centre = glm::vec3(0.3f, 1.0f, -1.0f);
-    sphere3.radius = 0.12f;
-    sphere3.material = reflective(0.75f);
-
-    Sphere sphere4;
-    sphere4.centre = glm::vec3(0.6f, 1.0f, -1.0f);
-    sphere4.radius = 0.12f;
-    sphere4.material = reflective(1.0f);
-
-    Sphere sphere5;
-    sphere5.centre = glm::vec3(-0.7f, 0.29f, -0.7f);
-    sphere5.radius = 0.3f;
-    sphere5.material = default_material();
-    sphere5.material.albedo = glm::vec3(1.0f, 1.0f, 0.6f);
-    sphere5.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere5.material.emission_strength = 0.0f;
-    sphere5.material.specular_colour = glm::vec3(0.9f, 0.9f, 0.9f);
-    sphere5.material.roughness = 0.2f;
-    sphere5.material.specular_chance = 0.1f;
-
-    Sphere sphere6;
-    sphere6.centre = glm::vec3(0.0f, 0.3f, -0.7f);
-    sphere6.radius = 0.3f;
-    sphere6.material = default_material();
-    sphere6.material.albedo = glm::vec3(1.0f, 0.6f, 0.6f);
-    sphere6.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere6.material.emission_strength = 0.0f;
-    sphere6.material.specular_colour = glm::vec3(0.9f, 0.9f, 0.9f);
-    sphere6.material.roughness = 0.2f;
-    sphere6.material.specular_chance = 0.3f;
-
-    Sphere sphere7;
-    sphere7.centre = glm::vec3(0.7f, 0.3f, -0.7f);
-    sphere7.radius = 0.3f;
-    sphere7.material = default_material();
-    sphere7.material.albedo = glm::vec3(0.0f, 0.0f, 1.0f);
-    sphere7.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere7.material.emission_strength = 0.0f;
-    sphere7.material.specular_colour = glm::vec3(1.0f, 0.0f, 0.0f);
-    sphere7.material.roughness = 0.5f;
-    sphere7.material.specular_chance = 0.5f;
-
-    spheres[0] = sphere0;
-    spheres[1] = sphere1;
-    spheres[2] = sphere2;
-    spheres[3] = sphere3;
-    spheres[4] = sphere4;
-    spheres[5] = sphere5;
-    spheres[6] = sphere6;
-    spheres[7] = sphere7;
-
-    SceneData sceneData;
-    sceneData.objects = spheres;
-    sceneData.n_objects = NUM_SPHERES;
-    sceneData.size = sceneData.n_objects * sizeof(Sphere);
-
-	return sceneData;
+    SceneMesh stored;
+    stored.first_vertex = (uint32_t)scene.vertices.size();
+    stored.n_vertices = (uint32_t)mesh.vertices.size();
+    stored.first_triangle = (uint32_t)scene.triangles.size();
+    stored.n_triangles = (uint32_t)mesh.n_triangles();
+
+    scene.vertices.insert(scene.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    scene.triangles.reserve(scene.triangles.size() + mesh.n_triangles());
+    uint32_t base = stored.first_vertex;
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        scene.triangles.push_back({ base + mesh.indices[i], base + mesh.indices[i + 1], base + mesh.indices[i + 2], -1 });
+
+    scene.meshes.push_back(stored);
+    return (int)scene.meshes.size() - 1;
 }
 
-SceneData cornell_box_glass() 
+// Places a mesh from add_instanced_mesh(). Emissive instances are copied into world space like add_mesh()
+// instead, the light tree only samples the scene's own primitives.
+inline void add_instance(SceneData& scene, int mesh, const Material& material, const glm::mat4& transform)
 {
-	//const int NUM_SPHERES = 1;
-
-	//Sphere* spheres = new Sphere[NUM_SPHERES];
-
-	//Sphere sphere0;
-	//sphere0.centre = glm::vec3(0.0f, 1.0f, -1.0f);
-	//sphere0.radius = 0.5f;
-	//sphere0.material = refractive(0.0f);
-	//sphere0.material.refraction_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-	//spheres[0] = sphere0;
-
-	const int NUM_SPHERES = 8;
-
-    Sphere* spheres = new Sphere[NUM_SPHERES];
-
-    Sphere sphere0;
-    sphere0.centre = glm::vec3(-0.6f, 1.0f, -0.2f);
-    sphere0.radius = 0.12f;
-    sphere0.material = refractive(0.0f);
-
-    Sphere sphere1;
-    sphere1.centre = glm::vec3(-0.3f, 1.0f, -0.2f);
-    sphere1.radius = 0.12f;
-    sphere1.material = refractive(0.25f);
-
-    Sphere sphere2;
-    sphere2.centre = glm::vec3(0.0f, 1.0f, -0.2f);
-    sphere2.radius = 0.12f;
-    sphere2.material = refractive(0.5f);
-
-    Sphere sphere3;
-    sphere3.centre = glm::vec3(0.3f, 1.0f, -0.2f);
-    sphere3.radius = 0.12f;
-    sphere3.material = refractive(0.75f);
-
-    Sphere sphere4;
-    sphere4.centre = glm::vec3(0.6f, 1.0f, -0.2f);
-    sphere4.radius = 0.12f;
-    sphere4.material = refractive(1.0f);
-
-    Sphere sphere5;
-    sphere5.centre = glm::vec3(-0.7f, 0.9f, -1.0f);
-    sphere5.radius = 0.3f;
-    sphere5.material = default_material();
-    sphere5.material.albedo = glm::vec3(1.0f, 1.0f, 0.6f);
-    sphere5.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere5.material.emission_strength = 0.0f;
-    sphere5.material.specular_colour = glm::vec3(0.9f, 0.9f, 0.9f);
-    sphere5.material.roughness = 0.2f;
-    sphere5.material.specular_chance = 0.1f;
-
-    Sphere sphere6;
-    sphere6.centre = glm::vec3(0.0f, 1.0f, -1.0f);
-    sphere6.radius = 0.3f;
-    sphere6.material = default_material();
-    sphere6.material.albedo = glm::vec3(1.0f, 0.6f, 0.6f);
-    sphere6.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere6.material.emission_strength = 0.0f;
-    sphere6.material.specular_colour = glm::vec3(0.9f, 0.9f, 0.9f);
-    sphere6.material.roughness = 0.2f;
-    sphere6.material.specular_chance = 0.3f;
-
-    Sphere sphere7;
-    sphere7.centre = glm::vec3(0.7f, 0.9f, -1.0f);
-    sphere7.radius = 0.3f;
-    sphere7.material = default_material();
-    sphere7.material.albedo = glm::vec3(0.0f, 0.0f, 1.0f);
-    sphere7.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere7.material.emission_strength = 0.0f;
-    sphere7.material.specular_colour = glm::vec3(1.0f, 0.0f, 0.0f);
-    sphere7.material.roughness = 0.5f;
-    sphere7.material.specular_chance = 0.5f;
-
-    spheres[0] = sphere0;
-    spheres[1] = sphere1;
-    spheres[2] = sphere2;
-    spheres[3] = sphere3;
-    spheres[4] = sphere4;
-    spheres[5] = sphere5;
-    spheres[6] = sphere6;
-    spheres[7] = sphere7;
-
-    SceneData sceneData;
-    sceneData.objects = spheres;
-    sceneData.n_objects = NUM_SPHERES;
-    sceneData.size = sceneData.n_objects * sizeof(Sphere);
-
-	return sceneData;
+    const SceneMesh& stored = scene.meshes[mesh];
+    if (material.emission_strength > 0.0f) {
+        Mesh copy;
+        copy.vertices.assign(scene.vertices.begin() + stored.first_vertex, scene.vertices.begin() + stored.first_vertex + stored.n_vertices);
+        for (uint32_t i = 0; i < stored.n_triangles; i++) {
+            const Triangle& tri = scene.triangles[stored.first_triangle + i];
+            copy.indices.insert(copy.indices.end(), { tri.v0 - stored.first_vertex, tri.v1 - stored.first_vertex, tri.v2 - stored.first_vertex });
+        }
+        add_mesh(scene, copy, material, transform);
+        return;
+    }
+
+    MeshInstance instance = {};
+    instance.transform = transform;
+    instance.mesh = mesh;
+    instance.material = scene.add_material(material);
+    scene.instances.push_back(instance);
 }
 
-SceneData default_scene() {
-	const int NUM_SPHERES = 10;
-
-    Sphere* spheres = new Sphere[NUM_SPHERES];
-
-    Sphere sphere0;
-    sphere0.centre = glm::vec3(0.0f, -100.5f, 0.0f);
-    sphere0.radius = 100.0f;
-    sphere0.material.albedo = glm::vec3(0.807f, 0.2588f, 0.2588f);
-    sphere0.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere0.material.emission_strength = 0.0f;
-    sphere0.material.specular_colour = glm::vec3(1.0f, 1.0f, 1.0f);
-    sphere0.material.roughness = 1.0f;
-    sphere0.material.specular_chance = 0.0f;
-
-    Sphere sphere1;
-    sphere1.centre = glm::vec3(0.0f, 13.0f, -2.0f);
-    sphere1.radius = 10.0f;
-    sphere1.material.albedo = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere1.material.emission_colour = glm::vec3(1.0f, 1.0f, 1.0f);
-    sphere1.material.emission_strength = 1.0f;
-    sphere1.material.specular_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere1.material.roughness = 1.0f;
-    sphere1.material.specular_chance = 1.0f;
-
-    Sphere sphere2;
-    sphere2.centre = glm::vec3(-1.0f, 0.5f, -3.0f);
-    sphere2.radius = 0.2f;
-    sphere2.material = reflective(0.0f);
-
-    Sphere sphere3;
-    sphere3.centre = glm::vec3(-0.5f, 0.5f, -3.0f);
-    sphere3.radius = 0.2f;
-    sphere3.material = reflective(0.25f);
-
-    Sphere sphere4;
-    sphere4.centre = glm::vec3(0.0f, 0.5f, -3.0f);
-    sphere4.radius = 0.2f;
-    sphere4.material = reflective(0.5f);
-
-    Sphere sphere5;
-    sphere5.centre = glm::vec3(0.5f, 0.5f, -3.0f);
-    sphere5.radius = 0.2f;
-    sphere5.material = reflective(0.75f);
-
-    Sphere sphere6;
-    sphere6.centre = glm::vec3(1.0f, 0.5f, -3.0f);
-    sphere6.radius = 0.2f;
-    sphere6.material = reflective(1.0f);
-
-    Sphere sphere7;
-    sphere7.centre = glm::vec3(-0.75f, -0.22f, -2.0f);
-    sphere7.radius = 0.3f;
-    sphere7.material.albedo = glm::vec3(1.0f, 1.0f, 0.6f);
-    sphere7.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere7.material.emission_strength = 0.0f;
-    sphere7.material.specular_colour = glm::vec3(0.9f, 0.9f, 0.9f);
-    sphere7.material.roughness = 0.2f;
-    sphere7.material.specular_chance = 0.1f;
-
-    Sphere sphere8;
-    sphere8.centre = glm::vec3(0.0f, -0.22f, -2.0f);
-    sphere8.radius = 0.3f;
-    sphere8.material.albedo = glm::vec3(1.0f, 0.6f, 0.6f);
-    sphere8.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere8.material.emission_strength = 0.0f;
-    sphere8.material.specular_colour = glm::vec3(0.9f, 0.9f, 0.9f);
-    sphere8.material.roughness = 0.2f;
-    sphere8.material.specular_chance = 0.3f;
-
-    Sphere sphere9;
-    sphere9.centre = glm::vec3(0.75f, -0.22f, -2.0f);
-    sphere9.radius = 0.3f;
-    sphere9.material.albedo = glm::vec3(0.0f, 0.0f, 1.0f);
-    sphere9.material.emission_colour = glm::vec3(0.0f, 0.0f, 0.0f);
-    sphere9.material.emission_strength = 0.0f;
-    sphere9.material.specular_colour = glm::vec3(1.0f, 0.0f, 0.0f);
-    sphere9.material.roughness = 0.5f;
-    sphere9.material.specular_chance = 0.5f;
-
-    spheres[0] = sphere0;
-    spheres[1] = sphere1;
-    spheres[2] = sphere2;
-    spheres[3] = sphere3;
-    spheres[4] = sphere4;
-    spheres[5] = sphere5;
-    spheres[6] = sphere6;
-    spheres[7] = sphere7;
-    spheres[8] = sphere8;
-    spheres[9] = sphere9;
-
-    SceneData sceneData;
-    sceneData.objects = spheres;
-    sceneData.n_objects = NUM_SPHERES;
-    sceneData.size = sceneData.n_objects * sizeof(Sphere);
-
-	return sceneData;
+// Transform that scales a mesh uniformly to fit a cube of the given size, resting on base_centre
+inline glm::mat4 fit_mesh_transform(const Mesh& mesh, glm::vec3 base_centre, float size)
+{
+    if (mesh.vertices.empty())
+        return glm::mat4(1.0f);
+
+    glm::vec3 lo = mesh.vertices[0].position, hi = lo;
+    for (const Vertex& v : mesh.vertices) {
+        lo = glm::min(lo, v.position);
+        hi = glm::max(hi, v.position);
+    }
+    glm::vec3 extent = hi - lo;
+    float scale = size / glm::max(extent.x, glm::max(extent.y, glm::max(extent.z, 1e-6f)));
+    glm::vec3 offset = glm::vec3((lo.x + hi.x) * 0.5f, lo.y, (lo.z + hi.z) * 0.5f);
+
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), base_centre);
+    m = glm::scale(m, glm::vec3(scale));
+    return glm::translate(m, -offset);
 }
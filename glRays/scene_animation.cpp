@@ -0,0 +1,139 @@
+#include "scene_animation.h"
+
+#include <imgui.h>
+
+#include <chrono>
+#include <format>
+#include <iostream>
+
+#include <glm/ext/matrix_transform.hpp>
+
+void animate_scene(SceneData& scene, float seconds)
+{
+	for (const SceneMotion& motion : scene.motions) {
+		glm::mat4 orbit = glm::translate(glm::mat4(1.0f), motion.centre);
+		orbit = glm::rotate(orbit, glm::radians(motion.speed * seconds), motion.axis);
+		orbit = glm::translate(orbit, -motion.centre);
+		glm::mat4 placement = orbit * motion.base;
+		if (motion.sphere >= 0)
+			scene.spheres[motion.sphere].centre = glm::vec3(placement[3]);
+		if (motion.instance >= 0)
+			scene.instances[motion.instance].transform = placement;
+	}
+}
+
+bool SceneAnimator::collect_rebuild(const SceneData& scene, BVH& bvh, SceneBuffers& buffers)
+{
+	if (!rebuild.valid() || rebuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return false;
+	BVH top = rebuild.get();
+	stats.rebuilding = false;
+	if (discard_rebuild) {
+		discard_rebuild = false;
+		return false;
+	}
+
+	// Built from where things were when it started, brought up to date before it's used. The top level's
+	// node count can differ, which moves the meshes' trees, so every array goes up whole.
+	stats.rebuild_ms = top.stats.build_ms;
+	TopLevelPrims prims = gather_top_level_prims(scene, bvh);
+	refit_top_level(top, prims);
+	if (top.stats.sah_cost >= bvh.stats.sah_cost) {
+		// The cost grew with how the objects spread out, not with the refits, so drift is measured from here
+		bvh.build_sah_cost = bvh.stats.sah_cost;
+		return false;
+	}
+	float refit_cost = bvh.stats.sah_cost;
+	splice_top_level(bvh, top, prims);
+	reordered_slots = (int)top.prim_indices.size();
+	buffers.bvh_nodes.upload(bvh.nodes);
+	buffers.bvh_prims.upload(bvh.prim_indices);
+	buffers.instances.upload(bvh.instances);
+	stats.bytes += buffers.bvh_nodes.size() + buffers.bvh_prims.size() + buffers.instances.size();
+	stats.rebuilds++;
+	std::clog << std::format("Swapped in a rebuilt BVH top level: SAH cost {:.2f}, was {:.2f} after refits, built in {:.2f}ms",
+		bvh.stats.sah_cost, refit_cost, stats.rebuild_ms) << std::endl;
+	return true;
+}
+
+bool SceneAnimator::update(float dt, SceneData& scene, BVH& bvh, LightBVH& lights, SceneBuffers& buffers)
+{
+	animated = !scene.motions.empty();
+	stats.bytes = 0;
+	moved_spheres.clear();
+	reordered_slots = 0;
+	bool changed = collect_rebuild(scene, bvh, buffers);
+	if (!animated || (!playing && !repose)) {
+		if (changed)
+			buffers.bind();
+		return changed;
+	}
+	if (playing)
+		time += dt;
+	repose = false;
+
+	auto start = std::chrono::steady_clock::now();
+	animate_scene(scene, (float)time);
+	refit_scene_bvh(scene, bvh, false, pool);
+	stats.refit_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	stats.drift = bvh.sah_drift();
+
+	// Motions only move spheres and instances, so only those and the top level's nodes go up
+	bool instances_moved = false, emitters_moved = false;
+	for (const SceneMotion& motion : scene.motions) {
+		if (motion.sphere >= 0) {
+			moved_spheres.push_back(motion.sphere);
+			emitters_moved |= scene.materials[scene.spheres[motion.sphere].material].emission_strength > 0.0f;
+		}
+		instances_moved |= motion.instance >= 0;
+	}
+	if (!moved_spheres.empty()) {
+		buffers.spheres.update(scene.spheres, 0, scene.spheres.size());
+		stats.bytes += buffers.spheres.size();
+	}
+	if (instances_moved) {
+		buffers.instances.update(bvh.instances, 0, bvh.instances.size());
+		stats.bytes += buffers.instances.size();
+	}
+	buffers.bvh_nodes.update(bvh.nodes, 0, bvh.top_level_nodes);
+	stats.bytes += bvh.top_level_nodes * sizeof(BVHNode);
+
+	// The light tree is cheap to rebuild, it follows emitters without a drift of its own
+	if (emitters_moved) {
+		lights = build_light_bvh(scene);
+		buffers.emitters.upload(lights.emitters);
+		buffers.light_nodes.upload(lights.nodes);
+		buffers.emitter_count = (int)lights.emitters.size();
+		stats.bytes += buffers.emitters.size() + buffers.light_nodes.size();
+	}
+	buffers.bind();
+
+	if (!rebuild.valid() && stats.drift > rebuild_drift) {
+		// Only the top level's bounds go along, gathered here, the build needs neither the scene nor the meshes' trees
+		rebuild = std::async(std::launch::async, [prims = gather_top_level_prims(scene, bvh)]() { return build_top_level(prims); });
+		stats.rebuilding = true;
+	}
+	return true;
+}
+
+void SceneAnimator::scene_replaced()
+{
+	if (rebuild.valid())
+		discard_rebuild = true;
+}
+
+void SceneAnimator::render_ui()
+{
+	ImGui::Checkbox("Play", &playing);
+	ImGui::SameLine();
+	if (ImGui::Button("Restart")) {
+		time = 0.0;
+		repose = true;
+	}
+	ImGui::SameLine();
+	ImGui::Text("%.2fs", time);
+	ImGui::SliderFloat("Rebuild at drift", &rebuild_drift, 1.05f, 4.0f, "%.2fx", ImGuiSliderFlags_AlwaysClamp);
+	ImGui::Text("Refit %.2fms, %.1fKB uploaded", stats.refit_ms, stats.bytes / 1024.0);
+	ImGui::Text("SAH cost %.2fx as built%s", stats.drift, stats.rebuilding ? ", rebuilding" : "");
+	ImGui::Text("%d rebuilds, last took %.1fms", stats.rebuilds, stats.rebuild_ms);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <future>
+
+#include "scene.h"
+#include "bvh.h"
+#include "lights.h"
+#include "scene_buffers.h"
+#include "thread_pool.h"
+
+// Places every animated sphere and instance where its motion has it after seconds. Only the scene's
+// own arrays change, the BVH, light tree and GPU buffers are the caller's to bring along.
+void animate_scene(SceneData& scene, float seconds);
+
+struct SceneAnimationStats
+{
+	double refit_ms = 0.0;		// last frame's
+	size_t bytes = 0;			// uploaded last frame
+	float drift = 1.0f;			// BVH::sah_drift() after the last refit
+	int rebuilds = 0;			// swapped in since the viewer started
+	double rebuild_ms = 0.0;	// the last one's build time on its thread
+	bool rebuilding = false;
+};
+
+// Moves the scene's animated objects every frame of the viewer. A frame only refits the BVH's top level,
+// which keeps its structure and slowly gets worse as objects travel. Once its SAH cost has drifted past
+// rebuild_drift a new top level is built on a background thread, from the bounds of its primitives gathered
+// on the main thread. When it's done it's refit to wherever things have moved since and spliced in, so no
+// frame waits for a build. Motions are rigid, the meshes' own trees never need more than the reload's refit.
+class SceneAnimator
+{
+	ThreadPool* pool;				// refits spread across it, not owned
+	std::future<BVH> rebuild;		// a top level from build_top_level()
+	bool discard_rebuild = false;	// the scene was reloaded while it was building
+	bool repose = false;
+	double time = 0.0;
+
+	bool collect_rebuild(const SceneData& scene, BVH& bvh, SceneBuffers& buffers);
+
+public:
+	// Refits run serially without a pool, the viewer lends it the CPU tracer's
+	explicit SceneAnimator(ThreadPool* refit_pool = nullptr) : pool(refit_pool) {}
+
+	bool playing = true;
+	float rebuild_drift = BVH_REBUILD_DRIFT;
+	bool animated = false;		// the scene has motions, set by update()
+	SceneAnimationStats stats;
+
+	// What the last update() changed that CPUTracer::update_scene() has to follow: the spheres that moved,
+	// and how many of the first slots a spliced in top level reordered, 0 if none was
+	std::vector<int> moved_spheres;
+	int reordered_slots = 0;
+
+	// Advances the animation by dt seconds and brings the BVH, light tree and buffers along. True if
+	// anything the renderer sees changed, the image has to start over.
+	bool update(float dt, SceneData& scene, BVH& bvh, LightBVH& lights, SceneBuffers& buffers);
+
+	// Moves a freshly loaded scene to where the animation is now, before it's compared with the live one,
+	// so a save that changes nothing doesn't look like everything that moved since it started
+	void pose(SceneData& scene) const { animate_scene(scene, (float)time); }
+
+	// After a reload changed the scene, a rebuild still running from the old one is thrown away once it finishes
+	void scene_replaced();
+
+	void render_ui();
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "gl_buffer.h"
+#include "scene.h"
+#include "bvh.h"
+#include "lights.h"
+#include "sampler.h"
+#include "scene_cache.h"
+
+// GPU copies of the scene, bound to the SSBO slots compute.glsl reads them from, plus the sampler's blue-noise tile
+class SceneBuffers
+{
+	bool created = false;
+
+public:
+	GLBuffer spheres, triangles, bvh_nodes, bvh_prims, vertices, materials, emitters, light_nodes, instances, blue_noise;
+
+	// Goes into FrameUniforms::emitter_count, GLBuffer never allocates zero bytes so an empty list still binds
+	int emitter_count = 0;
+
+	void create()
+	{
+		if (created)
+			return;
+		for (GLBuffer* buffer : { &spheres, &triangles, &bvh_nodes, &bvh_prims, &vertices, &materials, &emitters, &light_nodes, &instances, &blue_noise })
+			buffer->create_buffer();
+		blue_noise.upload(blue_noise_tile());
+		created = true;
+	}
+
+	void upload(const SceneData& scene, const BVH& bvh, const LightBVH& lights)
+	{
+		create();
+		spheres.upload(scene.spheres);
+		triangles.upload(scene.triangles);
+		bvh_nodes.upload(bvh.nodes);
+		bvh_prims.upload(bvh.prim_indices);
+		vertices.upload(scene.vertices);
+		materials.upload(scene.materials);
+		emitters.upload(lights.emitters);
+		light_nodes.upload(lights.nodes);
+		instances.upload(bvh.instances);
+		emitter_count = (int)lights.emitters.size();
+		bind();
+	}
+
+	// Straight from the cache's mapping, its sections already have the layouts the shaders read
+	void upload(const SceneCache& cache)
+	{
+		create();
+		const std::pair<GLBuffer*, SceneCacheSectionId> sections[] = {
+			{ &spheres, SCENE_SECTION_SPHERES }, { &triangles, SCENE_SECTION_TRIANGLES }, { &bvh_nodes, SCENE_SECTION_BVH_NODES },
+			{ &bvh_prims, SCENE_SECTION_BVH_PRIMS }, { &vertices, SCENE_SECTION_VERTICES }, { &materials, SCENE_SECTION_MATERIALS },
+			{ &emitters, SCENE_SECTION_EMITTERS }, { &light_nodes, SCENE_SECTION_LIGHT_NODES }, { &instances, SCENE_SECTION_BVH_INSTANCES },
+		};
+		for (auto [buffer, id] : sections)
+			buffer->upload(cache.section_data(id), cache.section_bytes(id));
+		emitter_count = (int)cache.section<Emitter>(SCENE_SECTION_EMITTERS).size();
+		bind();
+	}
+
+	void bind()
+	{
+		spheres.bind_base(2);
+		triangles.bind_base(3);
+		bvh_nodes.bind_base(4);
+		bvh_prims.bind_base(5);
+		vertices.bind_base(6);
+		materials.bind_base(7);
+		emitters.bind_base(13);
+		light_nodes.bind_base(15);
+		blue_noise.bind_base(17);
+		instances.bind_base(19);
+	}
+};
@@ -0,0 +1,221 @@
+#include "scene_cache.h"
+
+#include <chrono>
+#include <format>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+#include "cli.h"
+#include "hash.h"
+
+std::string SceneCache::cache_dir = "scene_cache";
+
+static const char SCENE_CACHE_MAGIC[8] = { 'G', 'L', 'R', 'S', 'C', 'E', 'N', 'E' };
+
+// Of each section's elements in SceneCacheSectionId order, a file whose sizes differ was written by a
+// build that laid a struct out differently and can't be read with this one's
+static const uint32_t SCENE_SECTION_ELEMENT_SIZES[SCENE_SECTION_COUNT] = {
+	sizeof(Material), sizeof(Sphere), sizeof(Vertex), sizeof(Triangle), sizeof(BVHNode), sizeof(uint32_t),
+	sizeof(Emitter), sizeof(LightNode), sizeof(SceneMesh), sizeof(MeshInstance), sizeof(BVHInstance), sizeof(SceneMotion),
+};
+
+bool SceneCache::open(const std::string& path, uint64_t key)
+{
+	close();
+	if (!std::filesystem::exists(path) || !file.open(path.c_str()))
+		return false;
+
+	const SceneCacheHeader* h = (const SceneCacheHeader*)file.data();
+	bool valid = file.size() >= sizeof(SceneCacheHeader) && std::memcmp(h->magic, SCENE_CACHE_MAGIC, sizeof(h->magic)) == 0
+		&& h->version == SCENE_CACHE_VERSION && h->n_sections == SCENE_SECTION_COUNT && h->file_size == file.size();
+	for (int i = 0; valid && i < SCENE_SECTION_COUNT; i++) {
+		const SceneCacheSection& s = h->sections[i];
+		valid = s.element_size == SCENE_SECTION_ELEMENT_SIZES[i] && s.offset % SCENE_CACHE_ALIGNMENT == 0 && s.offset <= file.size()
+			&& s.count * s.element_size <= file.size() - s.offset;
+	}
+	if (!valid || h->key != key) {
+		file.close();
+		return false;
+	}
+	header = h;
+	return true;
+}
+
+void SceneCache::close()
+{
+	header = nullptr;
+	file.close();
+}
+
+template <typename T>
+static void extract_section(const SceneCache& cache, SceneCacheSectionId id, std::vector<T>& out)
+{
+	std::span<const T> data = cache.section<T>(id);
+	out.assign(data.begin(), data.end());
+}
+
+void SceneCache::extract(SceneData& scene, BVH& bvh, LightBVH& lights) const
+{
+	// Through add_material so the scene's deduplication knows about them, they're all unique already
+	for (const Material& material : section<Material>(SCENE_SECTION_MATERIALS))
+		scene.add_material(material);
+	extract_section(*this, SCENE_SECTION_SPHERES, scene.spheres);
+	extract_section(*this, SCENE_SECTION_VERTICES, scene.vertices);
+	extract_section(*this, SCENE_SECTION_TRIANGLES, scene.triangles);
+	extract_section(*this, SCENE_SECTION_MESHES, scene.meshes);
+	extract_section(*this, SCENE_SECTION_INSTANCES, scene.instances);
+	extract_section(*this, SCENE_SECTION_MOTIONS, scene.motions);
+	extract_section(*this, SCENE_SECTION_BVH_NODES, bvh.nodes);
+	extract_section(*this, SCENE_SECTION_BVH_PRIMS, bvh.prim_indices);
+	extract_section(*this, SCENE_SECTION_BVH_INSTANCES, bvh.instances);
+	bvh.top_level_nodes = (int)header->bvh_top_level_nodes;
+	// Cached as built, so refits measure their drift from here
+	bvh.stats.sah_cost = bvh.build_sah_cost = bvh.sah_cost();
+	extract_section(*this, SCENE_SECTION_EMITTERS, lights.emitters);
+	extract_section(*this, SCENE_SECTION_LIGHT_NODES, lights.nodes);
+}
+
+bool SceneCache::write(const std::string& path, uint64_t key, const SceneData& scene, const BVH& bvh, const LightBVH& lights)
+{
+	struct Source { const void* data; size_t count; };
+	const Source sources[SCENE_SECTION_COUNT] = {
+		{ scene.materials.data(), scene.materials.size() },
+		{ scene.spheres.data(), scene.spheres.size() },
+		{ scene.vertices.data(), scene.vertices.size() },
+		{ scene.triangles.data(), scene.triangles.size() },
+		{ bvh.nodes.data(), bvh.nodes.size() },
+		{ bvh.prim_indices.data(), bvh.prim_indices.size() },
+		{ lights.emitters.data(), lights.emitters.size() },
+		{ lights.nodes.data(), lights.nodes.size() },
+		{ scene.meshes.data(), scene.meshes.size() },
+		{ scene.instances.data(), scene.instances.size() },
+		{ bvh.instances.data(), bvh.instances.size() },
+		{ scene.motions.data(), scene.motions.size() },
+	};
+
+	SceneCacheHeader header = {};
+	std::memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_CACHE_VERSION;
+	header.n_sections = SCENE_SECTION_COUNT;
+	header.key = key;
+	header.bvh_top_level_nodes = (uint32_t)bvh.top_level_nodes;
+	uint64_t offset = sizeof(SceneCacheHeader);
+	for (int i = 0; i < SCENE_SECTION_COUNT; i++) {
+		offset = (offset + SCENE_CACHE_ALIGNMENT - 1) / SCENE_CACHE_ALIGNMENT * SCENE_CACHE_ALIGNMENT;
+		header.sections[i] = { offset, sources[i].count, SCENE_SECTION_ELEMENT_SIZES[i], 0 };
+		offset += sources[i].count * SCENE_SECTION_ELEMENT_SIZES[i];
+	}
+	header.file_size = offset;
+
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream out(tmp_path, std::ios::binary);
+		if (!out) {
+			std::cerr << std::format("ERROR::SCENE_CACHE::FILE_NOT_WRITABLE '{}'", tmp_path) << std::endl;
+			return false;
+		}
+		out.write((const char*)&header, sizeof(header));
+		const char zeros[SCENE_CACHE_ALIGNMENT] = {};
+		for (int i = 0; i < SCENE_SECTION_COUNT; i++) {
+			out.write(zeros, header.sections[i].offset - (uint64_t)out.tellp());
+			out.write((const char*)sources[i].data, sources[i].count * SCENE_SECTION_ELEMENT_SIZES[i]);
+		}
+		if (!out) {
+			std::cerr << std::format("ERROR::SCENE_CACHE::WRITE_FAILED '{}'", tmp_path) << std::endl;
+			return false;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		std::cerr << std::format("ERROR::SCENE_CACHE::RENAME_FAILED '{}': {}", path, ec.message()) << std::endl;
+		std::filesystem::remove(tmp_path, ec);
+		return false;
+	}
+	return true;
+}
+
+static uint64_t hash_file(const std::string& path, uint64_t hash)
+{
+	MappedFile file;
+	if (file.open(path.c_str()))
+		hash = fnv1a_bytes(file.data(), file.size(), hash);
+	return hash;
+}
+
+bool scene_cache_key(const CLIOptions& opts, uint64_t& key)
+{
+	uint64_t hash = fnv1a_bytes(&SCENE_CACHE_VERSION, sizeof(SCENE_CACHE_VERSION));
+	const int build_parameters[] = { BVH_MAX_DEPTH, BVH_MAX_LEAF_SIZE, BVH_BINS, LIGHT_BVH_MAX_DEPTH, LIGHT_BVH_BINS };
+	const float costs[] = { BVH_TRAVERSAL_COST, BVH_INTERSECT_COST };
+	hash = fnv1a_bytes(build_parameters, sizeof(build_parameters), hash);
+	hash = fnv1a_bytes(costs, sizeof(costs), hash);
+
+	std::string scene_path = scene_file_path(opts.scene);
+	SceneFile file;
+	if (!parse_scene_file(scene_path, file))
+		return false;
+	hash = hash_file(scene_path, hash);
+	for (const std::string& mesh_path : file.mesh_paths)
+		hash = hash_file(mesh_path, hash);
+
+	if (!opts.mesh.empty()) {
+		const float placement[] = { CLI_MESH_BASE.x, CLI_MESH_BASE.y, CLI_MESH_BASE.z, CLI_MESH_SIZE, CLI_MESH_ALBEDO.x, CLI_MESH_ALBEDO.y, CLI_MESH_ALBEDO.z };
+		hash = fnv1a_bytes(placement, sizeof(placement), hash);
+		hash = hash_file(opts.mesh, hash);
+	}
+	key = hash;
+	return true;
+}
+
+// One file per scene and mesh, rebuilt in place when the key changes so stale caches don't pile up. The
+// hash of their full paths keeps files of the same name in different directories from sharing one.
+static std::string scene_cache_path(const CLIOptions& opts)
+{
+	std::filesystem::path scene_path = std::filesystem::absolute(scene_file_path(opts.scene)).lexically_normal();
+	std::string name = scene_path.filename().string();
+	uint64_t hash = fnv1a(scene_path.generic_string());
+	if (!opts.mesh.empty()) {
+		std::filesystem::path mesh_path = std::filesystem::absolute(opts.mesh).lexically_normal();
+		name += "+" + mesh_path.stem().string();
+		hash = fnv1a(mesh_path.generic_string(), hash);
+	}
+	name += std::format("-{:016x}", hash);
+	return (std::filesystem::path(SceneCache::cache_dir) / (name + ".glrscene")).string();
+}
+
+bool load_cli_scene(const CLIOptions& opts, SceneData& scene, BVH& bvh, LightBVH& lights, SceneCache& cache)
+{
+	cache.close();
+	std::string path;
+	uint64_t key = 0;
+	if (!SceneCache::cache_dir.empty()) {
+		auto start = std::chrono::steady_clock::now();
+		if (!scene_cache_key(opts, key))
+			return false;
+		path = scene_cache_path(opts);
+		if (cache.open(path, key)) {
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::clog << std::format("Mapped scene cache '{}': {} spheres, {} triangles, {} BVH nodes, {} emitters in {:.2f}ms",
+				path, cache.section<Sphere>(SCENE_SECTION_SPHERES).size(), cache.section<Triangle>(SCENE_SECTION_TRIANGLES).size(),
+				cache.section<BVHNode>(SCENE_SECTION_BVH_NODES).size(), cache.section<Emitter>(SCENE_SECTION_EMITTERS).size(), ms) << std::endl;
+			return true;
+		}
+	}
+
+	if (!build_cli_scene(opts, scene))
+		return false;
+	scene.print_stats();
+	bvh = build_scene_bvh(scene);
+	bvh.stats.print();
+	lights = build_light_bvh(scene);
+	lights.stats.print();
+
+	if (!path.empty() && SceneCache::write(path, key, scene, bvh, lights))
+		std::clog << std::format("Wrote scene cache '{}'", path) << std::endl;
+	return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <cstdint>
+
+#include "scene.h"
+#include "bvh.h"
+#include "lights.h"
+#include "mapped_file.h"
+
+struct CLIOptions;
+
+// Bumped whenever the container or any of the structs it stores changes layout
+const uint32_t SCENE_CACHE_VERSION = 3;
+// Section offsets are multiples of this, so every section is aligned for its element type in the mapping
+const size_t SCENE_CACHE_ALIGNMENT = 64;
+
+// One array per GPU buffer, stored with the layout SceneBuffers uploads, and the scene's meshes, instances and motions
+enum SceneCacheSectionId
+{
+	SCENE_SECTION_MATERIALS,
+	SCENE_SECTION_SPHERES,
+	SCENE_SECTION_VERTICES,
+	SCENE_SECTION_TRIANGLES,
+	SCENE_SECTION_BVH_NODES,
+	SCENE_SECTION_BVH_PRIMS,
+	SCENE_SECTION_EMITTERS,
+	SCENE_SECTION_LIGHT_NODES,
+	SCENE_SECTION_MESHES,
+	SCENE_SECTION_INSTANCES,
+	SCENE_SECTION_BVH_INSTANCES,
+	SCENE_SECTION_MOTIONS,
+	SCENE_SECTION_COUNT
+};
+
+struct SceneCacheSection
+{
+	uint64_t offset;	// from the start of the file
+	uint64_t count;
+	uint32_t element_size;
+	uint32_t reserved;
+};
+
+// Little-endian, at the start of the file and followed by the sections' data
+struct SceneCacheHeader
+{
+	char magic[8];		// "GLRSCENE"
+	uint32_t version;
+	uint32_t n_sections;
+	uint64_t key;		// of the sources the scene was built from, see scene_cache_key()
+	uint64_t file_size;
+	uint32_t bvh_top_level_nodes;	// the rest of the BVH's nodes are its meshes' trees
+	uint32_t reserved;
+	SceneCacheSection sections[SCENE_SECTION_COUNT];
+};
+
+// A scene, its BVH and its light tree as built, in a versioned file that's memory-mapped back so the GPU
+// buffers are uploaded straight from the mapping. The scenes in scenes/ hardly need it, the point is meshes,
+// which otherwise get parsed and have their BVH built on every launch.
+class SceneCache
+{
+	MappedFile file;
+	const SceneCacheHeader* header = nullptr;
+
+public:
+	// Where load_cli_scene() keeps caches, empty disables them
+	static std::string cache_dir;
+
+	// Maps path if it's a complete cache of this version built from sources with this key
+	bool open(const std::string& path, uint64_t key);
+	void close();
+	bool is_open() const { return header != nullptr; }
+
+	const void* section_data(SceneCacheSectionId id) const { return file.data() + header->sections[id].offset; }
+	size_t section_bytes(SceneCacheSectionId id) const { return header->sections[id].count * header->sections[id].element_size; }
+
+	template <typename T>
+	std::span<const T> section(SceneCacheSectionId id) const
+	{
+		return { (const T*)section_data(id), (size_t)header->sections[id].count };
+	}
+
+	// Copies the mapping into the CPU-side structures, one copy per array, for the CPU tracer
+	void extract(SceneData& scene, BVH& bvh, LightBVH& lights) const;
+
+	// Written next to path and renamed over it, so a reader never sees half a file
+	static bool write(const std::string& path, uint64_t key, const SceneData& scene, const BVH& bvh, const LightBVH& lights);
+};
+
+// Hash of everything the command line's scene is built from: the scene file's bytes and those of every
+// mesh it uses, the mesh file's bytes and where it's placed, and the BVH builders' parameters. False if
+// the scene doesn't exist.
+bool scene_cache_key(const CLIOptions& opts, uint64_t& key);
+
+// Builds the command line's scene with its BVH and light tree and caches them, or maps them from a cache
+// whose key still matches. On a hit scene, bvh and lights are left empty and cache is open, callers upload
+// from it and extract() only if they trace on the CPU. Returns false if the scene can't be built.
+bool load_cli_scene(const CLIOptions& opts, SceneData& scene, BVH& bvh, LightBVH& lights, SceneCache& cache);
@@ -0,0 +1,323 @@
+#include "scene_file.h"
+
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <unordered_map>
+
+#include <glm/ext/matrix_transform.hpp>
+
+#include "obj_loader.h"
+
+namespace
+{
+	bool scene_error(const SceneFile& file, const std::string& what)
+	{
+		std::cerr << std::format("ERROR::SCENE_FILE::INVALID '{}': {}", file.path, what) << std::endl;
+		return false;
+	}
+
+	bool read_float(const SceneFile& file, const JsonValue& value, const std::string& what, float& out)
+	{
+		if (!value.is_number())
+			return scene_error(file, std::format("{} must be a number", what));
+		out = (float)value.number;
+		return true;
+	}
+
+	bool read_vec3(const SceneFile& file, const JsonValue& value, const std::string& what, glm::vec3& out)
+	{
+		if (!value.is_array() || value.array.size() != 3)
+			return scene_error(file, std::format("{} must be an array of 3 numbers", what));
+		for (int i = 0; i < 3; i++)
+			if (!read_float(file, value.array[i], what, out[i]))
+				return false;
+		return true;
+	}
+
+	bool read_material(const SceneFile& file, const JsonValue& value, const std::string& what, Material& m)
+	{
+		if (!value.is_object())
+			return scene_error(file, std::format("{} must be an object", what));
+
+		m = default_material();
+		for (const auto& [key, field] : value.object) {
+			std::string name = std::format("{}.{}", what, key);
+			bool ok;
+			if (key == "albedo") ok = read_vec3(file, field, name, m.albedo);
+			else if (key == "roughness") ok = read_float(file, field, name, m.roughness);
+			else if (key == "emission_colour") ok = read_vec3(file, field, name, m.emission_colour);
+			else if (key == "emission_strength") ok = read_float(file, field, name, m.emission_strength);
+			else if (key == "specular_colour") ok = read_vec3(file, field, name, m.specular_colour);
+			else if (key == "specular_chance") ok = read_float(file, field, name, m.specular_chance);
+			else if (key == "refraction_colour") ok = read_vec3(file, field, name, m.refraction_colour);
+			else if (key == "refraction_chance") ok = read_float(file, field, name, m.refraction_chance);
+			else if (key == "refraction_roughness") ok = read_float(file, field, name, m.refraction_roughness);
+			else if (key == "refractive_idx") ok = read_float(file, field, name, m.refractive_idx);
+			else
+				return scene_error(file, std::format("unknown material field {}", name));
+			if (!ok)
+				return false;
+		}
+		return true;
+	}
+
+	// A primitive's "material", the name of one in the materials table or an inline definition
+	bool resolve_material(const SceneFile& file, const JsonValue& primitive, const std::string& what,
+		const std::unordered_map<std::string, Material>& materials, Material& m)
+	{
+		const JsonValue* value = primitive.find("material");
+		if (!value)
+			return scene_error(file, std::format("{} has no material", what));
+		if (value->is_object())
+			return read_material(file, *value, what + ".material", m);
+		if (!value->is_string())
+			return scene_error(file, std::format("{}.material must be a name or an object", what));
+		auto it = materials.find(value->string);
+		if (it == materials.end())
+			return scene_error(file, std::format("{} uses unknown material '{}'", what, value->string));
+		m = it->second;
+		return true;
+	}
+
+	const JsonValue* require(const SceneFile& file, const JsonValue& object, const char* key, const std::string& what)
+	{
+		const JsonValue* value = object.find(key);
+		if (!value)
+			scene_error(file, std::format("{} has no {}", what, key));
+		return value;
+	}
+
+	bool read_instance_transform(const SceneFile& file, const JsonValue& instance, const std::string& what, const Mesh& mesh, glm::mat4& transform)
+	{
+		if (const JsonValue* fit = instance.find("fit")) {
+			glm::vec3 base;
+			float size;
+			const JsonValue* base_value = require(file, *fit, "base", what + ".fit");
+			const JsonValue* size_value = require(file, *fit, "size", what + ".fit");
+			if (!base_value || !size_value || !read_vec3(file, *base_value, what + ".fit.base", base) || !read_float(file, *size_value, what + ".fit.size", size))
+				return false;
+			transform = fit_mesh_transform(mesh, base, size);
+			return true;
+		}
+
+		glm::vec3 translate = glm::vec3(0.0f), rotate = glm::vec3(0.0f), scale = glm::vec3(1.0f);
+		if (const JsonValue* v = instance.find("translate"); v && !read_vec3(file, *v, what + ".translate", translate))
+			return false;
+		if (const JsonValue* v = instance.find("rotate"); v && !read_vec3(file, *v, what + ".rotate", rotate))
+			return false;
+		if (const JsonValue* v = instance.find("scale")) {
+			if (v->is_number())
+				scale = glm::vec3((float)v->number);
+			else if (!read_vec3(file, *v, what + ".scale", scale))
+				return false;
+		}
+
+		transform = glm::translate(glm::mat4(1.0f), translate);
+		transform = glm::rotate(transform, glm::radians(rotate.z), glm::vec3(0.0f, 0.0f, 1.0f));
+		transform = glm::rotate(transform, glm::radians(rotate.y), glm::vec3(0.0f, 1.0f, 0.0f));
+		transform = glm::rotate(transform, glm::radians(rotate.x), glm::vec3(1.0f, 0.0f, 0.0f));
+		transform = glm::scale(transform, scale);
+		return true;
+	}
+
+	// A primitive's optional "orbit", motion is left alone when there is none
+	bool read_orbit(const SceneFile& file, const JsonValue& primitive, const std::string& what, const glm::mat4& base, SceneMotion& motion, bool& found)
+	{
+		const JsonValue* orbit = primitive.find("orbit");
+		found = orbit != nullptr;
+		if (!orbit)
+			return true;
+		if (!orbit->is_object())
+			return scene_error(file, std::format("{}.orbit must be an object", what));
+
+		motion = {};
+		motion.base = base;
+		motion.centre = glm::vec3(0.0f);
+		motion.sphere = motion.instance = -1;
+		const JsonValue* axis_value = require(file, *orbit, "axis", what + ".orbit");
+		const JsonValue* speed_value = require(file, *orbit, "speed", what + ".orbit");
+		if (!axis_value || !speed_value || !read_vec3(file, *axis_value, what + ".orbit.axis", motion.axis)
+			|| !read_float(file, *speed_value, what + ".orbit.speed", motion.speed))
+			return false;
+		if (const JsonValue* v = orbit->find("centre"); v && !read_vec3(file, *v, what + ".orbit.centre", motion.centre))
+			return false;
+		if (glm::length(motion.axis) == 0.0f)
+			return scene_error(file, std::format("{}.orbit.axis can't be zero", what));
+		motion.axis = glm::normalize(motion.axis);
+		return true;
+	}
+}
+
+bool parse_scene_file(const std::string& path, SceneFile& file)
+{
+	file = SceneFile();
+	file.path = path;
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		std::cerr << std::format("ERROR::SCENE_FILE::OPEN_FAILED '{}'", path) << std::endl;
+		return false;
+	}
+	std::stringstream text;
+	text << in.rdbuf();
+
+	std::string error;
+	if (!parse_json(text.str(), file.root, error)) {
+		std::cerr << std::format("ERROR::SCENE_FILE::PARSE_FAILED '{}' {}", path, error) << std::endl;
+		return false;
+	}
+	if (!file.root.is_object())
+		return scene_error(file, "the document must be an object");
+
+	if (const JsonValue* camera = file.root.find("camera")) {
+		if (const JsonValue* position = camera->find("position")) {
+			if (!read_vec3(file, *position, "camera.position", file.camera_position))
+				return false;
+			file.has_camera_position = true;
+		}
+		if (const JsonValue* fov = camera->find("fov")) {
+			if (!read_float(file, *fov, "camera.fov", file.fov))
+				return false;
+			file.has_fov = true;
+		}
+	}
+
+	if (const JsonValue* meshes = file.root.find("meshes")) {
+		if (!meshes->is_object())
+			return scene_error(file, "meshes must be an object of names and paths");
+		std::filesystem::path dir = std::filesystem::path(path).parent_path();
+		for (const auto& [name, mesh_path] : meshes->object) {
+			if (!mesh_path.is_string())
+				return scene_error(file, std::format("meshes.{} must be a path", name));
+			file.mesh_paths.push_back((dir / mesh_path.string).string());
+		}
+	}
+	return true;
+}
+
+bool build_scene_file(const SceneFile& file, SceneData& scene)
+{
+	const JsonValue& root = file.root;
+
+	std::unordered_map<std::string, Material> materials;
+	if (const JsonValue* table = root.find("materials")) {
+		if (!table->is_object())
+			return scene_error(file, "materials must be an object of names and materials");
+		for (const auto& [name, value] : table->object)
+			if (!read_material(file, value, "materials." + name, materials[name]))
+				return false;
+	}
+
+	if (const JsonValue* spheres = root.find("spheres")) {
+		if (!spheres->is_array())
+			return scene_error(file, "spheres must be an array");
+		for (size_t i = 0; i < spheres->array.size(); i++) {
+			const JsonValue& sphere = spheres->array[i];
+			std::string what = std::format("spheres[{}]", i);
+			glm::vec3 centre;
+			float radius;
+			Material material;
+			const JsonValue* centre_value = require(file, sphere, "centre", what);
+			const JsonValue* radius_value = require(file, sphere, "radius", what);
+			if (!centre_value || !radius_value || !read_vec3(file, *centre_value, what + ".centre", centre)
+				|| !read_float(file, *radius_value, what + ".radius", radius) || !resolve_material(file, sphere, what, materials, material))
+				return false;
+			scene.add_sphere(centre, radius, material);
+
+			SceneMotion motion;
+			bool orbits;
+			if (!read_orbit(file, sphere, what, glm::translate(glm::mat4(1.0f), centre), motion, orbits))
+				return false;
+			if (orbits) {
+				motion.sphere = (int)scene.spheres.size() - 1;
+				scene.motions.push_back(motion);
+			}
+		}
+	}
+
+	if (const JsonValue* triangles = root.find("triangles")) {
+		if (!triangles->is_array())
+			return scene_error(file, "triangles must be an array");
+		for (size_t i = 0; i < triangles->array.size(); i++) {
+			const JsonValue& triangle = triangles->array[i];
+			std::string what = std::format("triangles[{}]", i);
+			const JsonValue* vertices = require(file, triangle, "vertices", what);
+			if (!vertices)
+				return false;
+			if (!vertices->is_array() || vertices->array.size() != 3)
+				return scene_error(file, std::format("{}.vertices must hold 3 positions", what));
+			glm::vec3 p[3];
+			Material material;
+			for (int v = 0; v < 3; v++)
+				if (!read_vec3(file, vertices->array[v], std::format("{}.vertices[{}]", what, v), p[v]))
+					return false;
+			if (!resolve_material(file, triangle, what, materials, material))
+				return false;
+			scene.add_triangle(material, p[0], p[1], p[2]);
+		}
+	}
+
+	if (const JsonValue* instances = root.find("instances")) {
+		if (!instances->is_array())
+			return scene_error(file, "instances must be an array");
+
+		// Each mesh is stored in the scene once, kept here too for "fit" to measure
+		struct LoadedMesh
+		{
+			Mesh mesh;
+			int index;
+		};
+		const JsonValue* meshes = root.find("meshes");
+		std::unordered_map<std::string, LoadedMesh> loaded;
+		for (size_t i = 0; i < instances->array.size(); i++) {
+			const JsonValue& instance = instances->array[i];
+			std::string what = std::format("instances[{}]", i);
+			const JsonValue* mesh_name = require(file, instance, "mesh", what);
+			if (!mesh_name)
+				return false;
+			if (!mesh_name->is_string())
+				return scene_error(file, std::format("{}.mesh must be a name from meshes", what));
+
+			// mesh_paths is in the order of the meshes object
+			auto it = loaded.find(mesh_name->string);
+			if (it == loaded.end()) {
+				size_t index = 0;
+				while (meshes && index < meshes->object.size() && meshes->object[index].first != mesh_name->string)
+					index++;
+				if (!meshes || index == meshes->object.size())
+					return scene_error(file, std::format("{} uses unknown mesh '{}'", what, mesh_name->string));
+
+				const std::string& path = file.mesh_paths[index];
+				Mesh mesh;
+				OBJLoadStats load_stats;
+				if (!load_obj(path.c_str(), mesh, &load_stats))
+					return false;
+				load_stats.print(path.c_str());
+				int mesh_idx = add_instanced_mesh(scene, mesh);
+				it = loaded.emplace(mesh_name->string, LoadedMesh{ std::move(mesh), mesh_idx }).first;
+			}
+
+			Material material;
+			glm::mat4 transform;
+			if (!resolve_material(file, instance, what, materials, material) || !read_instance_transform(file, instance, what, it->second.mesh, transform))
+				return false;
+			size_t n_instances = scene.instances.size();
+			add_instance(scene, it->second.index, material, transform);
+
+			SceneMotion motion;
+			bool orbits;
+			if (!read_orbit(file, instance, what, transform, motion, orbits))
+				return false;
+			if (orbits) {
+				if (scene.instances.size() == n_instances)
+					return scene_error(file, std::format("{} is emissive, it's copied into the scene and can't orbit", what));
+				motion.instance = (int)n_instances;
+				scene.motions.push_back(motion);
+			}
+		}
+	}
+	return true;
+}
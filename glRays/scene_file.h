@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "json.h"
+#include "scene.h"
+
+// A scene description in JSON, see scenes/ for examples:
+//   "camera":    { "position": [x, y, z], "fov": degrees }
+//   "materials": { "name": { "albedo": [r, g, b], "roughness": 0.5, ... } }, unset fields are default_material()'s
+//   "spheres":   [ { "centre": [x, y, z], "radius": r, "material": "name" } ]
+//   "triangles": [ { "vertices": [[x, y, z], [x, y, z], [x, y, z]], "material": "name" } ]
+//   "meshes":    { "name": "path.obj" }, relative to the scene file
+//   "instances": [ { "mesh": "name", "material": "name", "translate": [x, y, z], "rotate": [x, y, z], "scale": s } ]
+//   "orbit":     { "axis": [x, y, z], "speed": degrees per second, "centre": [x, y, z] }, on spheres and instances
+// Materials can also be given inline as objects. An instance is scaled (a number or per axis), rotated in
+// degrees about x, then y, then z, then translated, or with "fit": { "base": [x, y, z], "size": s } scaled
+// to fit a cube of that size resting on base. Primitives are added spheres first, then triangles, then
+// instances, each in file order. Meshes are stored once and instanced, except under an emissive material,
+// which copies the mesh into world space so the light tree can sample it. An orbit turns its sphere or
+// instance about the axis through centre, the origin by default, while the viewer runs; emissive
+// instances can't orbit.
+struct SceneFile
+{
+	std::string path;
+	JsonValue root;
+
+	bool has_camera_position = false;
+	glm::vec3 camera_position = glm::vec3(0.0f);
+	bool has_fov = false;
+	float fov = 45.0f;
+
+	// Every mesh the instances use, resolved against the file's directory
+	std::vector<std::string> mesh_paths;
+};
+
+inline bool is_scene_file(const std::string& scene)
+{
+	return scene.size() > 5 && scene.compare(scene.size() - 5, 5, ".json") == 0;
+}
+
+// --scene takes a path to a scene file or the name of one in scenes/, relative to the working directory
+inline std::string scene_file_path(const std::string& scene)
+{
+	return is_scene_file(scene) ? scene : "scenes/" + scene + ".json";
+}
+
+// Reads the JSON and the camera, cheap enough to call for the camera alone since meshes aren't loaded yet
+bool parse_scene_file(const std::string& path, SceneFile& file);
+
+// Adds everything the file describes to scene, loading each mesh once however often it's instanced
+bool build_scene_file(const SceneFile& file, SceneData& scene);
@@ -0,0 +1,200 @@
+#include "scene_reload.h"
+
+#include <format>
+#include <cstring>
+#include <iostream>
+
+#include "cli.h"
+#include "scene_file.h"
+
+namespace
+{
+	std::chrono::steady_clock::duration watch_interval()
+	{
+		return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(SCENE_WATCH_INTERVAL));
+	}
+
+	template <typename T>
+	bool same_contents(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	// Brings buffer from live's contents to next's, whole if the length changed and otherwise just the span
+	// between the first and last element that differ. One span keeps it to a single call, edits to a scene
+	// file tend to touch one object at a time anyway.
+	template <typename T>
+	void sync_buffer(GLBuffer& buffer, const std::vector<T>& live, const std::vector<T>& next, SceneUpdateStats& stats)
+	{
+		if (live.size() != next.size()) {
+			buffer.upload(next);
+			stats.ranges++;
+			stats.bytes += next.size() * sizeof(T);
+			return;
+		}
+
+		size_t first = 0, last = next.size();
+		while (first < last && std::memcmp(&live[first], &next[first], sizeof(T)) == 0)
+			first++;
+		while (last > first && std::memcmp(&live[last - 1], &next[last - 1], sizeof(T)) == 0)
+			last--;
+		if (first == last)
+			return;
+		buffer.update(next, first, last - first);
+		stats.ranges++;
+		stats.bytes += (last - first) * sizeof(T);
+	}
+
+	// Same primitives built from the same vertices and instances of the same meshes, so the BVH's structure
+	// is still valid for next
+	bool same_prims(const SceneData& live, const SceneData& next)
+	{
+		if (live.spheres.size() != next.spheres.size() || live.triangles.size() != next.triangles.size()
+			|| live.vertices.size() != next.vertices.size() || !same_contents(live.meshes, next.meshes)
+			|| live.instances.size() != next.instances.size())
+			return false;
+		for (size_t i = 0; i < next.instances.size(); i++)
+			if (live.instances[i].mesh != next.instances[i].mesh)
+				return false;
+		for (size_t i = 0; i < next.triangles.size(); i++) {
+			const Triangle& a = live.triangles[i];
+			const Triangle& b = next.triangles[i];
+			if (a.v0 != b.v0 || a.v1 != b.v1 || a.v2 != b.v2 || (a.material < 0) != (b.material < 0))
+				return false;
+		}
+		return true;
+	}
+
+	// Vertices of the instanced meshes, whose trees only need refitting when these moved
+	bool mesh_vertices_moved(const SceneData& live, const SceneData& next)
+	{
+		for (const SceneMesh& mesh : next.meshes)
+			for (uint32_t i = mesh.first_vertex; i < mesh.first_vertex + mesh.n_vertices; i++)
+				if (live.vertices[i].position != next.vertices[i].position)
+					return true;
+		return false;
+	}
+
+	bool prims_moved(const SceneData& live, const SceneData& next)
+	{
+		for (size_t i = 0; i < next.spheres.size(); i++)
+			if (live.spheres[i].centre != next.spheres[i].centre || live.spheres[i].radius != next.spheres[i].radius)
+				return true;
+		for (size_t i = 0; i < next.vertices.size(); i++)
+			if (live.vertices[i].position != next.vertices[i].position)
+				return true;
+		for (size_t i = 0; i < next.instances.size(); i++)
+			if (live.instances[i].transform != next.instances[i].transform)
+				return true;
+		return false;
+	}
+}
+
+void FileWatcher::watch(const std::vector<std::string>& paths)
+{
+	files.clear();
+	for (const std::string& path : paths) {
+		std::error_code ec;
+		files.push_back({ path, std::filesystem::last_write_time(path, ec) });
+	}
+	next_poll = std::chrono::steady_clock::now() + watch_interval();
+}
+
+bool FileWatcher::poll()
+{
+	auto now = std::chrono::steady_clock::now();
+	if (files.empty() || now < next_poll)
+		return false;
+	next_poll = now + watch_interval();
+
+	// Editors that save by renaming leave the file missing for a moment, that's not a change yet
+	bool changed = false;
+	for (WatchedFile& file : files) {
+		std::error_code ec;
+		auto time = std::filesystem::last_write_time(file.path, ec);
+		if (!ec && time != file.time) {
+			file.time = time;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+std::vector<std::string> cli_scene_sources(const CLIOptions& opts)
+{
+	std::vector<std::string> paths;
+	paths.push_back(scene_file_path(opts.scene));
+	SceneFile file;
+	if (parse_scene_file(paths.back(), file))
+		paths.insert(paths.end(), file.mesh_paths.begin(), file.mesh_paths.end());
+	if (!opts.mesh.empty())
+		paths.push_back(opts.mesh);
+	return paths;
+}
+
+void SceneUpdateStats::print() const
+{
+	if (!changed) {
+		std::clog << "Scene reloaded, nothing visible changed" << std::endl;
+		return;
+	}
+	const char* bvh = bvh_rebuilt ? "rebuilt" : bvh_refit ? "refit" : "kept";
+	std::clog << std::format("Scene reloaded in {:.2f}ms: uploaded {:.1f}KB of {:.1f}KB in {} ranges, BVH {}{}",
+		ms, bytes / 1024.0, total_bytes / 1024.0, ranges, bvh, lights_changed ? ", light tree changed" : "") << std::endl;
+}
+
+SceneUpdateStats apply_scene_update(SceneData& scene, BVH& bvh, LightBVH& lights, SceneBuffers& buffers, SceneData& next)
+{
+	auto start = std::chrono::steady_clock::now();
+	SceneUpdateStats stats;
+
+	// A comment, whitespace or an unused material changes nothing, the image keeps converging
+	stats.changed = !same_contents(scene.materials, next.materials) || !same_contents(scene.spheres, next.spheres)
+		|| !same_contents(scene.vertices, next.vertices) || !same_contents(scene.triangles, next.triangles)
+		|| !same_contents(scene.meshes, next.meshes) || !same_contents(scene.instances, next.instances)
+		|| !same_contents(scene.motions, next.motions);
+	if (!stats.changed)
+		return stats;
+
+	sync_buffer(buffers.materials, scene.materials, next.materials, stats);
+	sync_buffer(buffers.spheres, scene.spheres, next.spheres, stats);
+	sync_buffer(buffers.vertices, scene.vertices, next.vertices, stats);
+	sync_buffer(buffers.triangles, scene.triangles, next.triangles, stats);
+
+	// Material edits keep the tree as it is
+	if (!same_prims(scene, next)) {
+		BVH next_bvh = build_scene_bvh(next);
+		sync_buffer(buffers.bvh_nodes, bvh.nodes, next_bvh.nodes, stats);
+		sync_buffer(buffers.bvh_prims, bvh.prim_indices, next_bvh.prim_indices, stats);
+		sync_buffer(buffers.instances, bvh.instances, next_bvh.instances, stats);
+		bvh = std::move(next_bvh);
+		stats.bvh_rebuilt = true;
+	}
+	else if (prims_moved(scene, next)) {
+		std::vector<BVHNode> live_nodes = bvh.nodes;
+		std::vector<BVHInstance> live_instances = bvh.instances;
+		refit_scene_bvh(next, bvh, mesh_vertices_moved(scene, next));
+		sync_buffer(buffers.bvh_nodes, live_nodes, bvh.nodes, stats);
+		sync_buffer(buffers.instances, live_instances, bvh.instances, stats);
+		stats.bvh_refit = true;
+	}
+
+	// Emitters' power depends on both their geometry and their material, the tree is cheap to rebuild
+	LightBVH next_lights = build_light_bvh(next);
+	stats.lights_changed = !same_contents(lights.emitters, next_lights.emitters) || !same_contents(lights.nodes, next_lights.nodes);
+	sync_buffer(buffers.emitters, lights.emitters, next_lights.emitters, stats);
+	sync_buffer(buffers.light_nodes, lights.nodes, next_lights.nodes, stats);
+	lights = std::move(next_lights);
+	buffers.emitter_count = (int)lights.emitters.size();
+
+	scene = std::move(next);
+	buffers.bind();
+
+	for (const GLBuffer* buffer : { &buffers.spheres, &buffers.triangles, &buffers.bvh_nodes, &buffers.bvh_prims, &buffers.vertices,
+		&buffers.materials, &buffers.emitters, &buffers.light_nodes, &buffers.instances })
+		stats.total_bytes += buffer->size();
+
+	auto end = std::chrono::steady_clock::now();
+	stats.ms = std::chrono::duration<double, std::milli>(end - start).count();
+	return stats;
+}
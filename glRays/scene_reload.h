@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+
+#include "scene.h"
+#include "bvh.h"
+#include "lights.h"
+#include "scene_buffers.h"
+
+struct CLIOptions;
+
+// How often the viewer checks the scene's files for changes, also how long it blocks for input when idle
+const double SCENE_WATCH_INTERVAL = 0.5;
+
+// Notices when any of a set of files is written, by polling their modification times. Stats of a few files
+// twice a second cost nothing and work the same with every editor and filesystem.
+class FileWatcher
+{
+	struct WatchedFile
+	{
+		std::string path;
+		std::filesystem::file_time_type time;
+	};
+
+	std::vector<WatchedFile> files;
+	std::chrono::steady_clock::time_point next_poll;
+
+public:
+	// Replaces the watched set, their current times are the baseline
+	void watch(const std::vector<std::string>& paths);
+	bool empty() const { return files.empty(); }
+
+	// True once for each round of changes, checks at most every SCENE_WATCH_INTERVAL
+	bool poll();
+};
+
+// Every file the command line's scene is built from: the scene file, its meshes and the optional mesh
+std::vector<std::string> cli_scene_sources(const CLIOptions& opts);
+
+struct SceneUpdateStats
+{
+	bool changed = false;		// anything the renderer sees, the image has to start over
+	bool bvh_rebuilt = false;	// primitives were added or removed
+	bool bvh_refit = false;		// only positions moved
+	bool lights_changed = false;
+	int ranges = 0;				// glBufferSubData calls
+	size_t bytes = 0;			// uploaded, out of total_bytes
+	size_t total_bytes = 0;
+	double ms = 0.0;
+
+	void print() const;
+};
+
+// Makes the live scene, its BVH, light tree and GPU buffers match next, which is consumed. Each array is
+// compared with what's on the GPU and only the span between its first and last changed element is uploaded,
+// so moving an instance or editing a material sends a fraction of the scene. The BVH is refit when the
+// primitives are the same ones in the same order, and rebuilt otherwise. Moving a mesh instance only
+// changes its record and the top level, the mesh itself stays as it is on the GPU.
+SceneUpdateStats apply_scene_update(SceneData& scene, BVH& bvh, LightBVH& lights, SceneBuffers& buffers, SceneData& next);
@@ -0,0 +1,117 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Weight of the newest measurement in the smoothed dispatch time
+const double DISPATCH_TIME_SMOOTHING = 0.2;
+// A displayed frame this many times over budget overshot it, this many the timer queries can't account for
+// means they can't be trusted
+const double OVERSHOOT_FACTOR = 2.0;
+const int OVERSHOOTS_BEFORE_WALL_CLOCK = 3;
+
+DispatchScheduler::DispatchScheduler()
+{
+	glGenQueries(QUERY_RING, queries);
+}
+
+DispatchScheduler::~DispatchScheduler()
+{
+	glDeleteQueries(QUERY_RING, queries);
+}
+
+void DispatchScheduler::record(double ms, int dispatches, int tag)
+{
+	if (dispatches <= 0)
+		return;
+	batch_ms = ms;
+	batch_tag = tag;
+	double per_dispatch = ms / dispatches;
+	if (dispatch_ms < 0.0)
+		dispatch_ms = per_dispatch;
+	else
+		dispatch_ms += (per_dispatch - dispatch_ms) * DISPATCH_TIME_SMOOTHING;
+}
+
+void DispatchScheduler::collect_results()
+{
+	for (int i = 0; i < QUERY_RING; i++) {
+		if (!query_pending[i])
+			continue;
+		GLint available = 0;
+		glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+		query_pending[i] = false;
+		if (ns == 0 && query_dispatches[i] > 0)
+			use_wall_clock("report zero");
+		else if (!wall_clock)
+			record(ns / 1e6, query_dispatches[i], query_tags[i]);
+	}
+}
+
+void DispatchScheduler::use_wall_clock(const char* reason)
+{
+	if (wall_clock)
+		return;
+	std::clog << "Timer queries " << reason << ", timing dispatches with the wall clock instead" << std::endl;
+	wall_clock = true;
+	dispatch_ms = -1.0;
+}
+
+int DispatchScheduler::begin_frame(float budget_ms, int max_dispatches, bool interactive)
+{
+	auto now = std::chrono::steady_clock::now();
+	double interval_ms = std::chrono::duration<double, std::milli>(now - last_begin).count();
+	// Only frames that dispatched more than one could have fit fewer, an idle frame's interval is its wait
+	bool overshot = last_dispatched > 1 && budget_ms > 0.0f && interval_ms > budget_ms * OVERSHOOT_FACTOR;
+	last_begin = now;
+
+	// Some drivers time compute dispatches as next to nothing, frames running long while the queries say
+	// they should have fit easily give them away. A long frame the queries do account for is just a long frame.
+	if (overshot && !wall_clock)
+		overshoots = dispatch_ms * last_dispatched < budget_ms / OVERSHOOT_FACTOR ? overshoots + 1 : 0;
+	if (overshoots >= OVERSHOOTS_BEFORE_WALL_CLOCK)
+		use_wall_clock("disagree with the frame time");
+	collect_results();
+
+	if (budget_ms <= 0.0f || interactive || dispatch_ms <= 0.0)
+		planned = 1;
+	else if (overshot)
+		planned = std::max(last_dispatched / 2, 1);
+	else {
+		// Grows by at most double per frame, one low early measurement shouldn't blow a whole frame
+		int fit = (int)(budget_ms / dispatch_ms);
+		planned = std::clamp(fit, 1, std::min(std::max(max_dispatches, 1), planned * 2));
+	}
+
+	if (wall_clock) {
+		glFinish();
+		wall_start = std::chrono::steady_clock::now();
+	}
+	else if (!query_pending[next_query]) {
+		glBeginQuery(GL_TIME_ELAPSED, queries[next_query]);
+		active_query = next_query;
+	}
+	return planned;
+}
+
+void DispatchScheduler::end_frame(int dispatches, int tag)
+{
+	last_dispatched = dispatches;
+	if (wall_clock) {
+		glFinish();
+		record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count(), dispatches, tag);
+	}
+	else if (active_query >= 0) {
+		glEndQuery(GL_TIME_ELAPSED);
+		query_dispatches[active_query] = dispatches;
+		query_tags[active_query] = tag;
+		query_pending[active_query] = true;
+		next_query = (next_query + 1) % QUERY_RING;
+		active_query = -1;
+	}
+}
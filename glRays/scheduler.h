@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <chrono>
+
+// How many path tracing dispatches fit into one displayed frame. Each dispatch is a whole accumulation
+// frame at the "Samples/pixel" count, so a still camera gets as many as the frame time budget allows
+// instead of exactly one per vsync, and a moving camera gets one so navigation stays responsive.
+// Dispatch cost comes from GL_TIME_ELAPSED queries read back a few frames late, so it never stalls.
+class DispatchScheduler
+{
+	static const int QUERY_RING = 4;
+
+	GLuint queries[QUERY_RING] = {};
+	int query_dispatches[QUERY_RING] = {};
+	int query_tags[QUERY_RING] = {};
+	bool query_pending[QUERY_RING] = {};
+	int next_query = 0;
+	int active_query = -1;
+
+	// Timer queries some drivers report as zero or close to it, this falls back to wall clock around a glFinish
+	bool wall_clock = false;
+	std::chrono::steady_clock::time_point wall_start;
+	std::chrono::steady_clock::time_point last_begin;
+	int overshoots = 0;
+
+	double dispatch_ms = -1.0;	// smoothed cost of one dispatch, negative until the first measurement
+	double batch_ms = -1.0;		// latest measured batch, negative once taken
+	int batch_tag = 0;			// end_frame()'s tag for it
+	int planned = 1;
+	int last_dispatched = 0;
+
+	void collect_results();
+	void record(double ms, int dispatches, int tag);
+	void use_wall_clock(const char* reason);
+
+public:
+	DispatchScheduler();
+	~DispatchScheduler();
+
+	DispatchScheduler(const DispatchScheduler&) = delete;
+	DispatchScheduler& operator=(const DispatchScheduler&) = delete;
+
+	// Dispatches to issue this frame, at most max_dispatches. A budget of zero or less, or interactive
+	// navigation, gives one. Starts timing them.
+	int begin_frame(float budget_ms, int max_dispatches, bool interactive);
+
+	// Stops timing, dispatches is how many were actually issued. The tag comes back with the batch's time.
+	void end_frame(int dispatches, int tag = 0);
+
+	// Smoothed GPU time of one dispatch, negative until measured
+	double dispatch_time_ms() const { return dispatch_ms; }
+	int planned_dispatches() const { return planned; }
+
+	// Time of the whole batch measured since the last call, if any, for the GPUProfiler. It already holds
+	// the one GL_TIME_ELAPSED query allowed around the dispatches. It's usually from a few frames back,
+	// tag is what that frame passed to end_frame().
+	bool take_batch_ms(double& ms, int& tag)
+	{
+		if (batch_ms < 0.0)
+			return false;
+		ms = batch_ms;
+		tag = batch_tag;
+		batch_ms = -1.0;
+		return true;
+	}
+};
@@ -1,13 +1,17 @@
 #include "shader.h"
+#include "hash.h"
 
 ShaderProgram::ShaderProgram()
 {
 	this->id = glCreateProgram();
 }
 
-void ShaderProgram::attach(const char* path, GLenum type)
+const int MAX_INCLUDE_DEPTH = 16;
+
+// Reads a GLSL file and expands its #include "file" lines, resolved relative to the including file.
+// Each file gets its own source string number in #line, so errors read as "<file number>:<line>"
+static std::string read_glsl(const std::filesystem::path& path, int& n_files, int depth = 0)
 {
-	// Read GLSL file
 	std::string shader_src;
 	std::ifstream file;
 	file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -20,34 +24,160 @@ void ShaderProgram::attach(const char* path, GLenum type)
 		shader_src = stream.str();
 	}
 	catch (std::ifstream::failure e) {
-		std::cerr << std::format("ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ '{}'\n{}", path, e.what()) << std::endl;
+		std::cerr << std::format("ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ '{}'\n{}", path.string(), e.what()) << std::endl;
+		return "";
 	}
-	const char* shader_str = shader_src.c_str();
+	if (shader_src.find("#include") == std::string::npos)
+		return shader_src;
 
-	// Compile the shader
-	unsigned int shader;
-	int success;
-	char infoLog[512];
+	int file_idx = n_files - 1;
+	std::string expanded;
+	std::istringstream lines(shader_src);
+	std::string line;
+	for (int line_no = 1; std::getline(lines, line); line_no++) {
+		size_t directive = line.find_first_not_of(" \t");
+		if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0) {
+			expanded += line + '\n';
+			continue;
+		}
 
-	shader = glCreateShader(type);
-	glShaderSource(shader, 1, &shader_str, NULL);
-	glCompileShader(shader);
+		size_t open = line.find('"', directive), close = line.find('"', open + 1);
+		if (open == std::string::npos || close == std::string::npos || depth >= MAX_INCLUDE_DEPTH) {
+			std::cerr << std::format("ERROR::SHADER::INVALID_INCLUDE '{}' line {}", path.string(), line_no) << std::endl;
+			continue;
+		}
+		std::filesystem::path include_path = path.parent_path() / line.substr(open + 1, close - open - 1);
+		int include_idx = n_files++;
+		expanded += std::format("#line 1 {}\n", include_idx);
+		expanded += read_glsl(include_path, n_files, depth + 1);
+		expanded += std::format("\n#line {} {}\n", line_no + 1, file_idx);
+	}
+	return expanded;
+}
 
-	// Check for errors
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-	if (!success) {
-		glGetShaderInfoLog(shader, 512, NULL, infoLog);
-		std::cerr << "ERROR::SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
+void ShaderProgram::attach(const char* path, GLenum type, const std::string& defines)
+{
+	// Read GLSL file, pulling in any #includes
+	int n_files = 1;
+	std::string shader_src = read_glsl(path, n_files);
+
+	// #version has to stay the first line, #line keeps error line numbers matching the file
+	if (!defines.empty()) {
+		size_t version_end = shader_src.find('\n', shader_src.find("#version"));
+		if (version_end != std::string::npos)
+			shader_src.insert(version_end + 1, defines + "#line 2\n");
 	}
-	this->shaders.push_back(shader);
 
-	glAttachShader(this->id, shader);
+	// Compiled in link(), where a cached binary can skip compilation entirely
+	this->sources.push_back({ type, std::move(shader_src) });
+}
+
+std::string ShaderProgram::binary_cache_dir = "shader_cache";
+
+std::string ShaderProgram::binary_cache_path() const
+{
+	if (binary_cache_dir.empty())
+		return "";
+	GLint n_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+	if (n_formats == 0)
+		return "";
+
+	// Binaries are only valid for the driver that made them, so it's part of the key along with the
+	// sources, which already contain any injected defines
+	uint64_t hash = FNV1A_OFFSET;
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		hash = fnv1a((const char*)glGetString(name), hash);
+	for (const auto& [type, source] : this->sources) {
+		hash = fnv1a(std::to_string(type), hash);
+		hash = fnv1a(source, hash);
+	}
+	return std::format("{}/{:016x}.bin", binary_cache_dir, hash);
+}
+
+bool ShaderProgram::load_binary(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	GLenum format;
+	if (!file.read((char*)&format, sizeof(format)))
+		return false;
+	std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (binary.empty())
+		return false;
+
+	// Drivers reject binaries after an update even when the version string matches, so check
+	glProgramBinary(this->id, format, binary.data(), (GLsizei)binary.size());
+	GLint success;
+	glGetProgramiv(this->id, GL_LINK_STATUS, &success);
+	return success;
+}
+
+void ShaderProgram::save_binary(const std::string& path) const
+{
+	GLint length = 0;
+	glGetProgramiv(this->id, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format;
+	glGetProgramBinary(this->id, length, nullptr, &format, binary.data());
+
+	std::error_code ec;
+	std::filesystem::create_directories(binary_cache_dir, ec);
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << std::format("ERROR::SHADER::CACHE_NOT_WRITABLE '{}'", path) << std::endl;
+		return;
+	}
+	file.write((const char*)&format, sizeof(format));
+	file.write(binary.data(), binary.size());
+}
+
+void ShaderProgram::compile_sources()
+{
+	for (const auto& [type, source] : this->sources) {
+		const char* shader_str = source.c_str();
+
+		// Compile the shader
+		unsigned int shader;
+		int success;
+		char infoLog[512];
+
+		shader = glCreateShader(type);
+		glShaderSource(shader, 1, &shader_str, NULL);
+		glCompileShader(shader);
+
+		// Check for errors
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success) {
+			glGetShaderInfoLog(shader, 512, NULL, infoLog);
+			std::cerr << "ERROR::SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
+		}
+		this->shaders.push_back(shader);
+
+		glAttachShader(this->id, shader);
+	}
 }
 
 void ShaderProgram::link()
 {
+	std::string cache_path = binary_cache_path();
+	if (!cache_path.empty() && load_binary(cache_path)) {
+		this->sources.clear();
+		cache_uniform_locations();
+		return;
+	}
+
+	compile_sources();
+
 	int success;
 	char infoLog[512];
+	if (!cache_path.empty())
+		glProgramParameteri(this->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(this->id);
 	glGetProgramiv(this->id, GL_LINK_STATUS, &success);
 	if (!success) {
@@ -57,8 +187,17 @@ void ShaderProgram::link()
 
 	// Delete the shaders as they're now linked into the program
 	for(GLuint shader : this->shaders) {
+		glDetachShader(this->id, shader);
 		glDeleteShader(shader);
 	}
+	this->shaders.clear();
+	this->sources.clear();
+
+	if (success) {
+		if (!cache_path.empty())
+			save_binary(cache_path);
+		cache_uniform_locations();
+	}
 }
 
 void ShaderProgram::use()
@@ -66,35 +205,66 @@ void ShaderProgram::use()
 	glUseProgram(this->id);
 }
 
-void ShaderProgram::setBool(const std::string& name, bool value) const
+void ShaderProgram::cache_uniform_locations()
+{
+	this->uniform_locations.clear();
+
+	GLint n_uniforms = 0, max_name_length = 0;
+	glGetProgramiv(this->id, GL_ACTIVE_UNIFORMS, &n_uniforms);
+	glGetProgramiv(this->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+	std::vector<char> name_buf(max_name_length + 1);
+	for (GLint i = 0; i < n_uniforms; i++) {
+		GLsizei length;
+		GLint array_size;
+		GLenum type;
+		glGetActiveUniform(this->id, (GLuint)i, (GLsizei)name_buf.size(), &length, &array_size, &type, name_buf.data());
+
+		// Members of uniform blocks have no location, they're set through the block's buffer
+		std::string name(name_buf.data(), length);
+		GLint location = glGetUniformLocation(this->id, name.c_str());
+		if (location < 0)
+			continue;
+
+		// Arrays are reported as "name[0]", accept the bare name too
+		if (name.ends_with("[0]"))
+			this->uniform_locations[name.substr(0, name.size() - 3)] = location;
+		this->uniform_locations[std::move(name)] = location;
+	}
+}
+
+GLint ShaderProgram::uniform_location(std::string_view name) const
 {
-	glUniform1i(glGetUniformLocation(this->id, name.c_str()), (int)value);
+	auto it = this->uniform_locations.find(name);
+	return it != this->uniform_locations.end() ? it->second : -1;
 }
 
-void ShaderProgram::setInt(const std::string& name, int value) const
+void ShaderProgram::setBool(std::string_view name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(this->id, name.c_str()), value);
+	glProgramUniform1i(this->id, uniform_location(name), (int)value);
 }
 
-void ShaderProgram::setFloat(const std::string& name, float value) const
+void ShaderProgram::setInt(std::string_view name, int value) const
 {
-	glUniform1f(glGetUniformLocation(this->id, name.c_str()), value);
+	glProgramUniform1i(this->id, uniform_location(name), value);
 }
 
-void ShaderProgram::setVec3(const std::string& name, glm::vec3 value) const
+void ShaderProgram::setFloat(std::string_view name, float value) const
 {
-	glUseProgram(this->id);
-	glUniform3fv(glGetUniformLocation(this->id, name.c_str()), 1, glm::value_ptr(value));
+	glProgramUniform1f(this->id, uniform_location(name), value);
 }
 
-void ShaderProgram::setVec2(const std::string& name, glm::vec2 value) const
+void ShaderProgram::setVec3(std::string_view name, glm::vec3 value) const
 {
-	glUseProgram(this->id);
-	glUniform2fv(glGetUniformLocation(this->id, name.c_str()), 1, glm::value_ptr(value));
+	glProgramUniform3fv(this->id, uniform_location(name), 1, glm::value_ptr(value));
 }
 
-void ShaderProgram::setMat4(const std::string& name, glm::mat4x4 value) const
+void ShaderProgram::setVec2(std::string_view name, glm::vec2 value) const
 {
-	glUseProgram(this->id);
-	glUniformMatrix4fv(glGetUniformLocation(this->id, name.c_str()), 1, false, glm::value_ptr(value));
+	glProgramUniform2fv(this->id, uniform_location(name), 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::setMat4(std::string_view name, glm::mat4x4 value) const
+{
+	glProgramUniformMatrix4fv(this->id, uniform_location(name), 1, false, glm::value_ptr(value));
 }
@@ -8,29 +8,57 @@
 
 #include <string>
 #include <format>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <fstream>
+#include <filesystem>
 #include <sstream>
 #include <iostream>
 
+// Lets the uniform map be searched with a string_view, no std::string built per lookup
+struct UniformNameHash
+{
+	using is_transparent = void;
+	size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+};
+
 class ShaderProgram
 {
 	std::vector<GLuint> shaders;
+	std::vector<std::pair<GLenum, std::string>> sources;
+	std::unordered_map<std::string, GLint, UniformNameHash, std::equal_to<>> uniform_locations;
+
+	void cache_uniform_locations();
+	void compile_sources();
+
+	std::string binary_cache_path() const;
+	bool load_binary(const std::string& path);
+	void save_binary(const std::string& path) const;
 
 public:
 	unsigned int id;
 
+	// Linked programs are stored here keyed by driver and source, empty disables the cache
+	static std::string binary_cache_dir;
+
 	ShaderProgram();
 
-	void attach(const char* path, GLenum type);
+	// defines are extra "#define NAME value" lines inserted straight after the #version directive
+	void attach(const char* path, GLenum type, const std::string& defines = "");
+	// Reuses a cached binary of the same sources when the driver accepts it, compiles otherwise
 	void link();
 
 	void use();
 
-	void setBool(const std::string& name, bool value) const;
-	void setInt(const std::string& name, int value) const;
-	void setFloat(const std::string& name, float value) const;
-	void setVec3(const std::string& name, glm::vec3 value) const;
-	void setVec2(const std::string& name, glm::vec2 value) const;
-	void setMat4(const std::string& name, glm::mat4x4 value) const;
+	// Location resolved once after link(), -1 for names that aren't active uniforms (setters then do nothing)
+	GLint uniform_location(std::string_view name) const;
+
+	// Setters write straight into the program, it doesn't need to be in use
+	void setBool(std::string_view name, bool value) const;
+	void setInt(std::string_view name, int value) const;
+	void setFloat(std::string_view name, float value) const;
+	void setVec3(std::string_view name, glm::vec3 value) const;
+	void setVec2(std::string_view name, glm::vec2 value) const;
+	void setMat4(std::string_view name, glm::mat4x4 value) const;
 };
@@ -0,0 +1,407 @@
+#include "simd.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(GLRAYS_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+const char* simd_level_name(SIMDLevel level)
+{
+	switch (level) {
+	case SIMDLevel::SSE: return "SSE";
+	case SIMDLevel::AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+SIMDLevel detect_simd_level()
+{
+#ifdef GLRAYS_SIMD_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+	if (max_leaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	// The OS also has to save the YMM registers on context switches
+	bool ymm_enabled = osxsave && (_xgetbv(0) & 6) == 6;
+	if (avx && avx2 && fma && ymm_enabled)
+		return SIMDLevel::AVX2;
+	if (sse2)
+		return SIMDLevel::SSE;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SIMDLevel::AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SIMDLevel::SSE;
+#endif
+#endif
+	return SIMDLevel::Scalar;
+}
+
+SIMDKernels simd_kernels(SIMDLevel level)
+{
+	level = std::min(level, detect_simd_level());
+
+	SIMDKernels kernels = { SIMDLevel::Scalar, intersect_prims_scalar, intersect_packet_aabb_scalar };
+#ifdef GLRAYS_SIMD_X86
+	if (level == SIMDLevel::SSE)
+		kernels = { SIMDLevel::SSE, intersect_prims_sse, intersect_packet_aabb_sse };
+	else if (level == SIMDLevel::AVX2)
+		kernels = { SIMDLevel::AVX2, intersect_prims_avx2, intersect_packet_aabb_avx2 };
+#endif
+	return kernels;
+}
+
+const int SOA_STREAMS = 16;
+
+void PrimitiveSoA::build(const SceneData& scene, const BVH& bvh)
+{
+	n_prims = (int)bvh.prim_indices.size();
+	padded = n_prims + PACKET_SIZE;
+	storage.assign(SOA_STREAMS * padded, std::numeric_limits<float>::quiet_NaN());
+	sphere_slots.assign(scene.spheres.size(), -1);
+
+	const float* streams[SOA_STREAMS];
+	for (int s = 0; s < SOA_STREAMS; s++)
+		streams[s] = storage.data() + s * padded;
+	sphere_x = streams[0]; sphere_y = streams[1]; sphere_z = streams[2]; sphere_r2 = streams[3];
+	v0_x = streams[4]; v0_y = streams[5]; v0_z = streams[6];
+	e1_x = streams[7]; e1_y = streams[8]; e1_z = streams[9];
+	e2_x = streams[10]; e2_y = streams[11]; e2_z = streams[12];
+	n_x = streams[13]; n_y = streams[14]; n_z = streams[15];
+	repack(scene, bvh, 0, n_prims);
+}
+
+void PrimitiveSoA::repack(const SceneData& scene, const BVH& bvh, int first, int end)
+{
+	float* streams[SOA_STREAMS];
+	for (int s = 0; s < SOA_STREAMS; s++)
+		streams[s] = storage.data() + s * padded;
+	float* s_x = streams[0], * s_y = streams[1], * s_z = streams[2], * s_r2 = streams[3];
+	float* a_x = streams[4], * a_y = streams[5], * a_z = streams[6];
+	float* ab_x = streams[7], * ab_y = streams[8], * ab_z = streams[9];
+	float* ac_x = streams[10], * ac_y = streams[11], * ac_z = streams[12];
+	float* nrm_x = streams[13], * nrm_y = streams[14], * nrm_z = streams[15];
+
+	// A slot that changed kind keeps none of what it held, the unused half has to be NaN again
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	for (int i = first; i < end; i++) {
+		for (int s = 0; s < SOA_STREAMS; s++)
+			streams[s][i] = nan;
+		uint32_t prim = bvh.prim_indices[i];
+		if (is_instance_ref(prim))
+			continue;
+		if (prim & BVH_TRIANGLE_BIT) {
+			const Triangle& tri = scene.triangles[prim & ~BVH_TRIANGLE_BIT];
+			glm::vec3 A = scene.vertices[tri.v0].position;
+			glm::vec3 AB = scene.vertices[tri.v1].position - A;
+			glm::vec3 AC = scene.vertices[tri.v2].position - A;
+			glm::vec3 normal = glm::cross(AB, AC);
+			a_x[i] = A.x; a_y[i] = A.y; a_z[i] = A.z;
+			ab_x[i] = AB.x; ab_y[i] = AB.y; ab_z[i] = AB.z;
+			ac_x[i] = AC.x; ac_y[i] = AC.y; ac_z[i] = AC.z;
+			nrm_x[i] = normal.x; nrm_y[i] = normal.y; nrm_z[i] = normal.z;
+		}
+		else {
+			const Sphere& sphere = scene.spheres[prim];
+			s_x[i] = sphere.centre.x;
+			s_y[i] = sphere.centre.y;
+			s_z[i] = sphere.centre.z;
+			s_r2[i] = sphere.radius * sphere.radius;
+			sphere_slots[prim] = i;
+		}
+	}
+}
+
+void PrimitiveSoA::update_spheres(const SceneData& scene, const std::vector<int>& spheres)
+{
+	float* s_x = storage.data(), * s_y = s_x + padded, * s_z = s_y + padded, * s_r2 = s_z + padded;
+	for (int sphere : spheres) {
+		int i = sphere_slots[sphere];
+		s_x[i] = scene.spheres[sphere].centre.x;
+		s_y[i] = scene.spheres[sphere].centre.y;
+		s_z[i] = scene.spheres[sphere].centre.z;
+		s_r2[i] = scene.spheres[sphere].radius * scene.spheres[sphere].radius;
+	}
+}
+
+void RayPacket::set_ray(int lane, glm::vec3 origin, glm::vec3 direction)
+{
+	origin_x[lane] = origin.x;
+	origin_y[lane] = origin.y;
+	origin_z[lane] = origin.z;
+	dir_x[lane] = direction.x;
+	dir_y[lane] = direction.y;
+	dir_z[lane] = direction.z;
+	inv_dir_x[lane] = 1.0f / direction.x;
+	inv_dir_y[lane] = 1.0f / direction.y;
+	inv_dir_z[lane] = 1.0f / direction.z;
+	t[lane] = INFINITY;
+	slot[lane] = -1;
+	instance[lane] = -1;
+	active |= 1 << lane;
+}
+
+// Reference kernels, the same tests as hit_sphere() and hit_triangle() one slot at a time
+
+int intersect_prims_scalar(const PrimitiveSoA& prims, int first, int count, glm::vec3 origin, glm::vec3 direction, float& t)
+{
+	int closest = -1;
+	float a = glm::dot(direction, direction);
+	for (int i = first; i < first + count; i++) {
+		glm::vec3 oc = glm::vec3(prims.sphere_x[i], prims.sphere_y[i], prims.sphere_z[i]) - origin;
+		float h = glm::dot(direction, oc);
+		float c = glm::dot(oc, oc) - prims.sphere_r2[i];
+		float discriminant = h * h - a * c;
+		if (discriminant >= 0.0f) {
+			float root = (h - std::sqrt(discriminant)) / a;
+			if (root <= 0.001f || t <= root)
+				root = (h + std::sqrt(discriminant)) / a;
+			if (root > 0.001f && root < t) {
+				t = root;
+				closest = i;
+			}
+		}
+
+		glm::vec3 normal = glm::vec3(prims.n_x[i], prims.n_y[i], prims.n_z[i]);
+		glm::vec3 AB = glm::vec3(prims.e1_x[i], prims.e1_y[i], prims.e1_z[i]);
+		glm::vec3 AC = glm::vec3(prims.e2_x[i], prims.e2_y[i], prims.e2_z[i]);
+		float det = -glm::dot(direction, normal);
+		float invdet = 1.0f / det;
+		glm::vec3 AO = origin - glm::vec3(prims.v0_x[i], prims.v0_y[i], prims.v0_z[i]);
+		glm::vec3 DAO = glm::cross(AO, direction);
+		float u = glm::dot(AC, DAO) * invdet;
+		float v = -glm::dot(AB, DAO) * invdet;
+		float dist = glm::dot(AO, normal) * invdet;
+		if (det >= 1e-6f && dist >= 0.0f && u >= 0.0f && v >= 0.0f && (u + v) <= 1.0f && dist < t) {
+			t = dist;
+			closest = i;
+		}
+	}
+	return closest;
+}
+
+int intersect_packet_aabb_scalar(const RayPacket& packet, const BVHNode& node, float* t_near)
+{
+	int mask = 0;
+	for (int lane = 0; lane < PACKET_SIZE; lane++) {
+		if (!(packet.active & (1 << lane)))
+			continue;
+
+		glm::vec3 origin = glm::vec3(packet.origin_x[lane], packet.origin_y[lane], packet.origin_z[lane]);
+		glm::vec3 inv_dir = glm::vec3(packet.inv_dir_x[lane], packet.inv_dir_y[lane], packet.inv_dir_z[lane]);
+		glm::vec3 t0 = (node.bounds_min - origin) * inv_dir;
+		glm::vec3 t1 = (node.bounds_max - origin) * inv_dir;
+		glm::vec3 t_small = glm::min(t0, t1);
+		glm::vec3 t_big = glm::max(t0, t1);
+		float t_enter = glm::max(glm::max(t_small.x, t_small.y), glm::max(t_small.z, 0.0f));
+		float t_exit = glm::min(glm::min(t_big.x, t_big.y), glm::min(t_big.z, packet.t[lane]));
+		t_near[lane] = t_enter;
+		if (t_enter <= t_exit)
+			mask |= 1 << lane;
+	}
+	return mask;
+}
+
+// Slab test for a single ray, returns the entry distance or INFINITY on a miss
+static float hit_aabb(glm::vec3 bounds_min, glm::vec3 bounds_max, glm::vec3 origin, glm::vec3 inv_dir, float t_max)
+{
+	glm::vec3 t0 = (bounds_min - origin) * inv_dir;
+	glm::vec3 t1 = (bounds_max - origin) * inv_dir;
+	glm::vec3 t_small = glm::min(t0, t1);
+	glm::vec3 t_big = glm::max(t0, t1);
+	float t_near = glm::max(glm::max(t_small.x, t_small.y), glm::max(t_small.z, 0.0f));
+	float t_far = glm::min(glm::min(t_big.x, t_big.y), glm::min(t_big.z, t_max));
+	return t_near <= t_far ? t_near : INFINITY;
+}
+
+static int traverse(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, int root, glm::vec3 origin, glm::vec3 direction, float& t, int* instance);
+
+// The instances among slots [first, first + count) of a top-level leaf, each traced through its mesh's tree
+// with the ray in object space. It isn't renormalised, so t carries over unchanged.
+static int intersect_instances(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, int first, int count,
+	glm::vec3 origin, glm::vec3 direction, float& t, int& instance)
+{
+	int closest = -1;
+	for (int i = first; i < first + count; i++) {
+		uint32_t prim = bvh.prim_indices[i];
+		if (!is_instance_ref(prim))
+			continue;
+		int idx = (int)(prim & ~BVH_INSTANCE_BIT);
+		const BVHInstance& inst = bvh.instances[idx];
+		glm::vec4 o = glm::vec4(origin, 1.0f), d = glm::vec4(direction, 0.0f);
+		glm::vec3 object_origin = glm::vec3(glm::dot(inst.world_to_object[0], o), glm::dot(inst.world_to_object[1], o), glm::dot(inst.world_to_object[2], o));
+		glm::vec3 object_direction = glm::vec3(glm::dot(inst.world_to_object[0], d), glm::dot(inst.world_to_object[1], d), glm::dot(inst.world_to_object[2], d));
+		int slot = traverse(kernels, prims, bvh, inst.root, object_origin, object_direction, t, nullptr);
+		if (slot >= 0) {
+			closest = slot;
+			instance = idx;
+		}
+	}
+	return closest;
+}
+
+// From nodes[root], instance is null inside a mesh's tree where there are no instances to follow
+static int traverse(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, int root, glm::vec3 origin, glm::vec3 direction, float& t, int* instance)
+{
+	const std::vector<BVHNode>& nodes = bvh.nodes;
+	glm::vec3 inv_dir = 1.0f / direction;
+	if (is_empty_node(nodes[root], root) || hit_aabb(nodes[root].bounds_min, nodes[root].bounds_max, origin, inv_dir, t) == INFINITY)
+		return -1;
+
+	// Only the leaves go wide here, one box at a time has nothing to fill the lanes with
+	int closest = -1;
+	int stack[BVH_MAX_DEPTH];
+	int stack_ptr = 0;
+	int node_idx = root;
+	while (true) {
+		const BVHNode& node = nodes[node_idx];
+
+		if (node.count > 0) {
+			int slot = kernels.intersect_prims(prims, node.left_first, node.count, origin, direction, t);
+			if (slot >= 0) {
+				closest = slot;
+				if (instance)
+					*instance = -1;
+			}
+			if (instance && !bvh.instances.empty()) {
+				slot = intersect_instances(kernels, prims, bvh, node.left_first, node.count, origin, direction, t, *instance);
+				if (slot >= 0)
+					closest = slot;
+			}
+
+			if (stack_ptr == 0)
+				break;
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		int near_idx = node.left_first;
+		int far_idx = node.left_first + 1;
+		float near_dist = hit_aabb(nodes[near_idx].bounds_min, nodes[near_idx].bounds_max, origin, inv_dir, t);
+		float far_dist = hit_aabb(nodes[far_idx].bounds_min, nodes[far_idx].bounds_max, origin, inv_dir, t);
+		if (far_dist < near_dist) {
+			std::swap(near_idx, far_idx);
+			std::swap(near_dist, far_dist);
+		}
+
+		if (near_dist == INFINITY) {
+			if (stack_ptr == 0)
+				break;
+			node_idx = stack[--stack_ptr];
+		}
+		else {
+			node_idx = near_idx;
+			if (far_dist != INFINITY)
+				stack[stack_ptr++] = far_idx;
+		}
+	}
+
+	return closest;
+}
+
+int intersect_ray(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, glm::vec3 origin, glm::vec3 direction, float& t, int* instance)
+{
+	int ignored = -1;
+	if (!instance)
+		instance = &ignored;
+	*instance = -1;
+	return traverse(kernels, prims, bvh, 0, origin, direction, t, instance);
+}
+
+void intersect_packet(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, RayPacket& packet)
+{
+	float t_near[PACKET_SIZE];
+	const std::vector<BVHNode>& nodes = bvh.nodes;
+	if (is_empty_node(nodes[0], 0))
+		return;
+	int root_mask = kernels.intersect_packet_aabb(packet, nodes[0], t_near);
+	if (!root_mask)
+		return;
+
+	// Each stack entry remembers which lanes reached it, lanes that have since found
+	// a closer hit are culled again by the box tests further down
+	int node_stack[BVH_MAX_DEPTH];
+	int mask_stack[BVH_MAX_DEPTH];
+	int stack_ptr = 0;
+	int node_idx = 0;
+	int mask = root_mask;
+	while (true) {
+		const BVHNode& node = nodes[node_idx];
+
+		if (node.count > 0) {
+			for (int lane = 0; lane < PACKET_SIZE; lane++) {
+				if (!(mask & (1 << lane)))
+					continue;
+				glm::vec3 origin = glm::vec3(packet.origin_x[lane], packet.origin_y[lane], packet.origin_z[lane]);
+				glm::vec3 direction = glm::vec3(packet.dir_x[lane], packet.dir_y[lane], packet.dir_z[lane]);
+				int slot = kernels.intersect_prims(prims, node.left_first, node.count, origin, direction, packet.t[lane]);
+				if (slot >= 0) {
+					packet.slot[lane] = slot;
+					packet.instance[lane] = -1;
+				}
+				if (!bvh.instances.empty()) {
+					slot = intersect_instances(kernels, prims, bvh, node.left_first, node.count, origin, direction, packet.t[lane], packet.instance[lane]);
+					if (slot >= 0)
+						packet.slot[lane] = slot;
+				}
+			}
+
+			if (stack_ptr == 0)
+				break;
+			stack_ptr--;
+			node_idx = node_stack[stack_ptr];
+			mask = mask_stack[stack_ptr];
+			continue;
+		}
+
+		// Visit first the child that some lane enters earliest
+		int near_idx = node.left_first;
+		int far_idx = node.left_first + 1;
+		int near_mask = kernels.intersect_packet_aabb(packet, nodes[near_idx], t_near) & mask;
+		float near_dist = INFINITY;
+		for (int lane = 0; lane < PACKET_SIZE; lane++)
+			if (near_mask & (1 << lane))
+				near_dist = std::min(near_dist, t_near[lane]);
+		int far_mask = kernels.intersect_packet_aabb(packet, nodes[far_idx], t_near) & mask;
+		float far_dist = INFINITY;
+		for (int lane = 0; lane < PACKET_SIZE; lane++)
+			if (far_mask & (1 << lane))
+				far_dist = std::min(far_dist, t_near[lane]);
+		if (far_dist < near_dist) {
+			std::swap(near_idx, far_idx);
+			std::swap(near_mask, far_mask);
+		}
+
+		if (!near_mask) {
+			if (stack_ptr == 0)
+				break;
+			stack_ptr--;
+			node_idx = node_stack[stack_ptr];
+			mask = mask_stack[stack_ptr];
+		}
+		else {
+			node_idx = near_idx;
+			mask = near_mask;
+			if (far_mask) {
+				node_stack[stack_ptr] = far_idx;
+				mask_stack[stack_ptr] = far_mask;
+				stack_ptr++;
+			}
+		}
+	}
+}
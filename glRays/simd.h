@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene.h"
+#include "bvh.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GLRAYS_SIMD_X86 1
+#endif
+
+enum class SIMDLevel
+{
+	Scalar,
+	SSE,   // 4-wide
+	AVX2   // 8-wide
+};
+
+const char* simd_level_name(SIMDLevel level);
+
+// Widest instruction set both compiled in and supported by the CPU we're running on
+SIMDLevel detect_simd_level();
+
+const int PACKET_SIZE = 8;
+
+// Primitives in BVH leaf order, slot i holds the primitive referenced by prim_indices[i].
+// Every slot carries both a sphere and a triangle, the unused one is filled with NaN so its
+// test can never pass, which lets a leaf with mixed primitives run as one branch-free batch.
+// Instance slots are all NaN, the traversal follows them into their mesh's tree instead.
+struct PrimitiveSoA
+{
+	// Each stream is one run of floats inside storage, plain pointers so the kernels need no std::vector code
+	const float* sphere_x = nullptr, * sphere_y = nullptr, * sphere_z = nullptr, * sphere_r2 = nullptr;
+	const float* v0_x = nullptr, * v0_y = nullptr, * v0_z = nullptr;
+	const float* e1_x = nullptr, * e1_y = nullptr, * e1_z = nullptr;
+	const float* e2_x = nullptr, * e2_y = nullptr, * e2_z = nullptr;
+	const float* n_x = nullptr, * n_y = nullptr, * n_z = nullptr;   // unnormalised face normal, cross(e1, e2)
+	int n_prims = 0;
+
+	PrimitiveSoA() = default;
+	PrimitiveSoA(const PrimitiveSoA&) = delete;
+	PrimitiveSoA& operator=(const PrimitiveSoA&) = delete;
+
+	// Pads past the last slot so a full-width load at any leaf start stays in bounds
+	void build(const SceneData& scene, const BVH& bvh);
+
+	// Packs slots [first, end) again after the BVH reordered them, it must still have as many slots
+	void repack(const SceneData& scene, const BVH& bvh, int first, int end);
+	// Refreshes the given spheres after they moved, without touching any other slot
+	void update_spheres(const SceneData& scene, const std::vector<int>& spheres);
+
+private:
+	std::vector<float> storage;
+	size_t padded = 0;				// floats per stream
+	std::vector<int> sphere_slots;	// slot of each scene sphere
+};
+
+// Coherent rays traced together through the BVH, each lane keeps its own closest hit
+struct RayPacket
+{
+	// Wide kernels still compute the inactive lanes, zeroed so they never read garbage
+	float origin_x[PACKET_SIZE] = {}, origin_y[PACKET_SIZE] = {}, origin_z[PACKET_SIZE] = {};
+	float dir_x[PACKET_SIZE] = {}, dir_y[PACKET_SIZE] = {}, dir_z[PACKET_SIZE] = {};
+	float inv_dir_x[PACKET_SIZE] = {}, inv_dir_y[PACKET_SIZE] = {}, inv_dir_z[PACKET_SIZE] = {};
+	float t[PACKET_SIZE] = {};
+	int slot[PACKET_SIZE] = {};   // PrimitiveSoA slot of the closest hit, -1 on a miss
+	int instance[PACKET_SIZE] = {};   // BVH::instances entry the slot was hit through, -1 if none
+	int active = 0;          // bitmask of lanes holding a ray
+
+	void set_ray(int lane, glm::vec3 origin, glm::vec3 direction);
+};
+
+// One ray against slots [first, first + count), narrows t and returns the closest slot or -1
+typedef int (*IntersectPrimsFn)(const PrimitiveSoA& prims, int first, int count, glm::vec3 origin, glm::vec3 direction, float& t);
+// Every active lane of a packet against one box, returns the bitmask of lanes that hit and their entry distances
+typedef int (*IntersectPacketAABBFn)(const RayPacket& packet, const BVHNode& node, float* t_near);
+
+struct SIMDKernels
+{
+	SIMDLevel level;
+	IntersectPrimsFn intersect_prims;
+	IntersectPacketAABBFn intersect_packet_aabb;
+};
+
+// Falls back to the widest available level below the one asked for
+SIMDKernels simd_kernels(SIMDLevel level);
+
+int intersect_prims_scalar(const PrimitiveSoA& prims, int first, int count, glm::vec3 origin, glm::vec3 direction, float& t);
+int intersect_packet_aabb_scalar(const RayPacket& packet, const BVHNode& node, float* t_near);
+#ifdef GLRAYS_SIMD_X86
+int intersect_prims_sse(const PrimitiveSoA& prims, int first, int count, glm::vec3 origin, glm::vec3 direction, float& t);
+int intersect_packet_aabb_sse(const RayPacket& packet, const BVHNode& node, float* t_near);
+int intersect_prims_avx2(const PrimitiveSoA& prims, int first, int count, glm::vec3 origin, glm::vec3 direction, float& t);
+int intersect_packet_aabb_avx2(const RayPacket& packet, const BVHNode& node, float* t_near);
+#endif
+
+// Closest hit of a single ray through the BVH, same traversal order as compute.glsl. A slot hit through an
+// instance is in its mesh's space, instance then says which one, otherwise it's -1.
+int intersect_ray(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, glm::vec3 origin, glm::vec3 direction, float& t, int* instance = nullptr);
+// Closest hit of every active lane, fills packet.t, packet.slot and packet.instance
+void intersect_packet(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, RayPacket& packet);
@@ -0,0 +1,122 @@
+#include "simd.h"
+
+#ifdef GLRAYS_SIMD_X86
+
+#include <immintrin.h>
+
+// 8-wide kernels, this file alone is built with AVX2 and FMA enabled.
+// Stay clear of glm functions and other inline header code in here, the linker may keep
+// this file's copy of an inline function and run AVX2 instructions on CPUs without them.
+
+static inline __m256 select(__m256 mask, __m256 a, __m256 b)
+{
+	return _mm256_blendv_ps(b, a, mask);
+}
+
+static inline __m256 dot(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+{
+	return _mm256_fmadd_ps(az, bz, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(ax, bx)));
+}
+
+int intersect_prims_avx2(const PrimitiveSoA& prims, int first, int count, glm::vec3 origin, glm::vec3 direction, float& t)
+{
+	const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+	const __m256 dx = _mm256_set1_ps(direction.x), dy = _mm256_set1_ps(direction.y), dz = _mm256_set1_ps(direction.z);
+	const __m256 a = dot(dx, dy, dz, dx, dy, dz);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 t_min = _mm256_set1_ps(0.001f);
+	const __m256 det_min = _mm256_set1_ps(1e-6f);
+	const __m256 inf = _mm256_set1_ps(INFINITY);
+	const __m256i lane_offsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i end = _mm256_set1_epi32(first + count);
+
+	// Each lane keeps its own closest hit, reduced across lanes at the end
+	__m256 best_t = _mm256_set1_ps(t);
+	__m256i best_slot = _mm256_set1_epi32(-1);
+
+	for (int i = first; i < first + count; i += 8) {
+		__m256i slot = _mm256_add_epi32(_mm256_set1_epi32(i), lane_offsets);
+		__m256 in_range = _mm256_castsi256_ps(_mm256_cmpgt_epi32(end, slot));
+
+		// Sphere, a negative discriminant gives a NaN root which fails every compare
+		__m256 ocx = _mm256_sub_ps(_mm256_loadu_ps(&prims.sphere_x[i]), ox);
+		__m256 ocy = _mm256_sub_ps(_mm256_loadu_ps(&prims.sphere_y[i]), oy);
+		__m256 ocz = _mm256_sub_ps(_mm256_loadu_ps(&prims.sphere_z[i]), oz);
+		__m256 h = dot(dx, dy, dz, ocx, ocy, ocz);
+		__m256 c = _mm256_sub_ps(dot(ocx, ocy, ocz, ocx, ocy, ocz), _mm256_loadu_ps(&prims.sphere_r2[i]));
+		__m256 sq = _mm256_sqrt_ps(_mm256_fmsub_ps(h, h, _mm256_mul_ps(a, c)));
+		__m256 root_near = _mm256_div_ps(_mm256_sub_ps(h, sq), a);
+		__m256 root_far = _mm256_div_ps(_mm256_add_ps(h, sq), a);
+		__m256 near_ok = _mm256_and_ps(_mm256_cmp_ps(root_near, t_min, _CMP_GT_OQ), _mm256_cmp_ps(root_near, best_t, _CMP_LT_OQ));
+		__m256 far_ok = _mm256_and_ps(_mm256_cmp_ps(root_far, t_min, _CMP_GT_OQ), _mm256_cmp_ps(root_far, best_t, _CMP_LT_OQ));
+		__m256 hit_t = select(near_ok, root_near, select(far_ok, root_far, inf));
+
+		// Triangle
+		__m256 nx = _mm256_loadu_ps(&prims.n_x[i]), ny = _mm256_loadu_ps(&prims.n_y[i]), nz = _mm256_loadu_ps(&prims.n_z[i]);
+		__m256 det = _mm256_sub_ps(zero, dot(dx, dy, dz, nx, ny, nz));
+		__m256 invdet = _mm256_div_ps(one, det);
+		__m256 aox = _mm256_sub_ps(ox, _mm256_loadu_ps(&prims.v0_x[i]));
+		__m256 aoy = _mm256_sub_ps(oy, _mm256_loadu_ps(&prims.v0_y[i]));
+		__m256 aoz = _mm256_sub_ps(oz, _mm256_loadu_ps(&prims.v0_z[i]));
+		__m256 daox = _mm256_fmsub_ps(aoy, dz, _mm256_mul_ps(aoz, dy));
+		__m256 daoy = _mm256_fmsub_ps(aoz, dx, _mm256_mul_ps(aox, dz));
+		__m256 daoz = _mm256_fmsub_ps(aox, dy, _mm256_mul_ps(aoy, dx));
+		__m256 u = _mm256_mul_ps(dot(_mm256_loadu_ps(&prims.e2_x[i]), _mm256_loadu_ps(&prims.e2_y[i]), _mm256_loadu_ps(&prims.e2_z[i]),
+			daox, daoy, daoz), invdet);
+		__m256 v = _mm256_sub_ps(zero, _mm256_mul_ps(dot(_mm256_loadu_ps(&prims.e1_x[i]), _mm256_loadu_ps(&prims.e1_y[i]), _mm256_loadu_ps(&prims.e1_z[i]),
+			daox, daoy, daoz), invdet));
+		__m256 dist = _mm256_mul_ps(dot(aox, aoy, aoz, nx, ny, nz), invdet);
+		__m256 tri_ok = _mm256_and_ps(
+			_mm256_and_ps(_mm256_cmp_ps(det, det_min, _CMP_GE_OQ), _mm256_cmp_ps(dist, zero, _CMP_GE_OQ)),
+			_mm256_and_ps(
+				_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, zero, _CMP_GE_OQ)),
+				_mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+		hit_t = select(tri_ok, dist, hit_t);
+
+		__m256 hit = _mm256_and_ps(_mm256_cmp_ps(hit_t, best_t, _CMP_LT_OQ), in_range);
+		best_t = select(hit, hit_t, best_t);
+		best_slot = _mm256_castps_si256(select(hit, _mm256_castsi256_ps(slot), _mm256_castsi256_ps(best_slot)));
+	}
+
+	// Ties go to the lowest slot, same as testing them one at a time
+	alignas(32) float lane_t[8];
+	alignas(32) int lane_slot[8];
+	_mm256_store_ps(lane_t, best_t);
+	_mm256_store_si256((__m256i*)lane_slot, best_slot);
+	int closest = -1;
+	for (int k = 0; k < 8; k++) {
+		if (lane_slot[k] >= 0 && (lane_t[k] < t || (lane_t[k] == t && lane_slot[k] < closest))) {
+			t = lane_t[k];
+			closest = lane_slot[k];
+		}
+	}
+	return closest;
+}
+
+int intersect_packet_aabb_avx2(const RayPacket& packet, const BVHNode& node, float* t_near)
+{
+	__m256 ox = _mm256_loadu_ps(packet.origin_x);
+	__m256 oy = _mm256_loadu_ps(packet.origin_y);
+	__m256 oz = _mm256_loadu_ps(packet.origin_z);
+	__m256 ix = _mm256_loadu_ps(packet.inv_dir_x);
+	__m256 iy = _mm256_loadu_ps(packet.inv_dir_y);
+	__m256 iz = _mm256_loadu_ps(packet.inv_dir_z);
+
+	__m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds_min.x), ox), ix);
+	__m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds_min.y), oy), iy);
+	__m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds_min.z), oz), iz);
+	__m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds_max.x), ox), ix);
+	__m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds_max.y), oy), iy);
+	__m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds_max.z), oz), iz);
+
+	// Operands are swapped so a NaN (0 * inf on a slab plane) resolves the same way as glm::min/max
+	__m256 t_enter = _mm256_max_ps(_mm256_max_ps(_mm256_setzero_ps(), _mm256_min_ps(t1z, t0z)),
+		_mm256_max_ps(_mm256_min_ps(t1y, t0y), _mm256_min_ps(t1x, t0x)));
+	__m256 t_exit = _mm256_min_ps(_mm256_min_ps(_mm256_loadu_ps(packet.t), _mm256_max_ps(t1z, t0z)),
+		_mm256_min_ps(_mm256_max_ps(t1y, t0y), _mm256_max_ps(t1x, t0x)));
+	_mm256_storeu_ps(t_near, t_enter);
+	return _mm256_movemask_ps(_mm256_cmp_ps(t_enter, t_exit, _CMP_LE_OQ)) & packet.active;
+}
+
+#endif
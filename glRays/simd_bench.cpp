@@ -0,0 +1,162 @@
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "scene.h"
+#include "scene_file.h"
+#include "bvh.h"
+#include "simd.h"
+#include "obj_loader.h"
+
+// Micro-benchmark for the CPU intersection kernels: rays/second of single rays and
+// 8-ray packets through the BVH at every SIMD level the machine supports.
+// Usage: glRays_simd_bench [mesh.obj], run from the directory holding scenes/
+
+struct BenchRays
+{
+	const char* name;
+	std::vector<glm::vec3> origins;
+	std::vector<glm::vec3> directions;
+};
+
+// Pinhole camera in front of the box, rows of 8 neighbouring pixels make up a packet
+static BenchRays camera_rays(int w, int h)
+{
+	BenchRays rays = { "camera", {}, {} };
+	glm::vec3 origin = glm::vec3(0.0f, 1.0f, 1.5f);
+	float tan_half_fov = std::tan(glm::radians(45.0f) / 2);
+	float aspect_ratio = float(w) / float(h);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			glm::vec3 pixel_camera = glm::vec3(
+				(2 * ((x + 0.5f) / w) - 1) * tan_half_fov * aspect_ratio,
+				(2 * ((y + 0.5f) / h) - 1) * tan_half_fov,
+				-1.0f
+			);
+			rays.origins.push_back(origin);
+			rays.directions.push_back(glm::normalize(pixel_camera));
+		}
+	}
+	return rays;
+}
+
+// Uniformly random directions leaving the first hits, the incoherent case packets are bad at
+static BenchRays bounce_rays(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, const BenchRays& camera)
+{
+	BenchRays rays = { "bounce", {}, {} };
+	std::mt19937 rng(1234);
+	std::normal_distribution<float> gauss;
+	for (size_t i = 0; i < camera.origins.size(); i++) {
+		float t = INFINITY;
+		if (intersect_ray(kernels, prims, bvh, camera.origins[i], camera.directions[i], t) < 0)
+			continue;
+		float x = gauss(rng);
+		float y = gauss(rng);
+		float z = gauss(rng);
+		rays.origins.push_back(camera.origins[i] + camera.directions[i] * t * 0.999f);
+		rays.directions.push_back(glm::normalize(glm::vec3(x, y, z)));
+	}
+	return rays;
+}
+
+// Best of a few runs, so one unlucky context switch doesn't decide the result
+template <typename F>
+static double best_ms(F&& run)
+{
+	double best = INFINITY;
+	for (int i = 0; i < 5; i++) {
+		auto start = std::chrono::steady_clock::now();
+		run();
+		auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+static void trace_single(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, const BenchRays& rays, std::vector<int>& slots)
+{
+	for (size_t i = 0; i < rays.origins.size(); i++) {
+		float t = INFINITY;
+		slots[i] = intersect_ray(kernels, prims, bvh, rays.origins[i], rays.directions[i], t);
+	}
+}
+
+static void trace_packets(const SIMDKernels& kernels, const PrimitiveSoA& prims, const BVH& bvh, const BenchRays& rays, std::vector<int>& slots)
+{
+	size_t n_rays = rays.origins.size();
+	for (size_t first = 0; first < n_rays; first += PACKET_SIZE) {
+		RayPacket packet;
+		int n_lanes = (int)std::min<size_t>(PACKET_SIZE, n_rays - first);
+		for (int lane = 0; lane < n_lanes; lane++)
+			packet.set_ray(lane, rays.origins[first + lane], rays.directions[first + lane]);
+		intersect_packet(kernels, prims, bvh, packet);
+		for (int lane = 0; lane < n_lanes; lane++)
+			slots[first + lane] = packet.slot[lane];
+	}
+}
+
+static void run_scene(const char* name, const char* mesh_path)
+{
+	SceneData scene;
+	SceneFile file;
+	if (!parse_scene_file(scene_file_path(name), file) || !build_scene_file(file, scene))
+		return;
+	if (mesh_path) {
+		Mesh mesh;
+		if (load_obj(mesh_path, mesh))
+			add_mesh(scene, mesh, default_material(), fit_mesh_transform(mesh, glm::vec3(0.0f, 0.0f, -1.2f), 0.8f));
+	}
+
+	BVH bvh = build_scene_bvh(scene);
+	PrimitiveSoA prims;
+	prims.build(scene, bvh);
+
+	SIMDKernels scalar = simd_kernels(SIMDLevel::Scalar);
+	BenchRays camera = camera_rays(1024, 576);
+	BenchRays bounce = bounce_rays(scalar, prims, bvh, camera);
+
+	std::clog << std::format("{}: {} prims, {} BVH nodes", name, prims.n_prims, bvh.nodes.size()) << std::endl;
+	for (const BenchRays* rays : { &camera, &bounce }) {
+		size_t n_rays = rays->origins.size();
+		std::vector<int> reference(n_rays), slots(n_rays);
+		trace_single(scalar, prims, bvh, *rays, reference);
+
+		double scalar_mrays = 0.0;
+		for (SIMDLevel level : { SIMDLevel::Scalar, SIMDLevel::SSE, SIMDLevel::AVX2 }) {
+			SIMDKernels kernels = simd_kernels(level);
+			if (kernels.level != level)
+				continue;
+
+			// Count rays whose closest hit disagrees with the scalar kernel, expected to be
+			// near zero since the wide kernels only differ in rounding (FMA on AVX2)
+			int mismatches = 0;
+			double single_ms = best_ms([&] { trace_single(kernels, prims, bvh, *rays, slots); });
+			for (size_t i = 0; i < n_rays; i++)
+				mismatches += slots[i] != reference[i];
+			double packet_ms = best_ms([&] { trace_packets(kernels, prims, bvh, *rays, slots); });
+			for (size_t i = 0; i < n_rays; i++)
+				mismatches += slots[i] != reference[i];
+
+			double single_mrays = n_rays / (single_ms * 1000.0);
+			double packet_mrays = n_rays / (packet_ms * 1000.0);
+			if (level == SIMDLevel::Scalar)
+				scalar_mrays = single_mrays;
+			std::clog << std::format("    {:>6} rays, {:>6}: single {:.2f} Mrays/s ({:.2f}x), packets {:.2f} Mrays/s ({:.2f}x), {} mismatches",
+				rays->name, simd_level_name(level), single_mrays, single_mrays / scalar_mrays,
+				packet_mrays, packet_mrays / scalar_mrays, mismatches) << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* mesh_path = argc > 1 ? argv[1] : nullptr;
+	std::clog << std::format("Widest supported SIMD level: {}", simd_level_name(detect_simd_level())) << std::endl;
+
+	run_scene("cornell_box_diffuse", mesh_path);
+	run_scene("cornell_box_metallic", mesh_path);
+	run_scene("cornell_box_glass", mesh_path);
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include "simd.h"
+
+#ifdef GLRAYS_SIMD_X86
+
+#include <emmintrin.h>
+
+// 4-wide kernels, SSE2 only since every x86-64 CPU has it
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+int intersect_prims_sse(const PrimitiveSoA& prims, int first, int count, glm::vec3 origin, glm::vec3 direction, float& t)
+{
+	const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+	const __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+	const __m128 a = _mm_set1_ps(glm::dot(direction, direction));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 t_min = _mm_set1_ps(0.001f);
+	const __m128 det_min = _mm_set1_ps(1e-6f);
+	const __m128 inf = _mm_set1_ps(INFINITY);
+	const __m128i lane_offsets = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i end = _mm_set1_epi32(first + count);
+
+	// Each lane keeps its own closest hit, reduced across lanes at the end
+	__m128 best_t = _mm_set1_ps(t);
+	__m128i best_slot = _mm_set1_epi32(-1);
+
+	for (int i = first; i < first + count; i += 4) {
+		__m128i slot = _mm_add_epi32(_mm_set1_epi32(i), lane_offsets);
+		__m128 in_range = _mm_castsi128_ps(_mm_cmplt_epi32(slot, end));
+
+		// Sphere, a negative discriminant gives a NaN root which fails every compare
+		__m128 ocx = _mm_sub_ps(_mm_loadu_ps(&prims.sphere_x[i]), ox);
+		__m128 ocy = _mm_sub_ps(_mm_loadu_ps(&prims.sphere_y[i]), oy);
+		__m128 ocz = _mm_sub_ps(_mm_loadu_ps(&prims.sphere_z[i]), oz);
+		__m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ocx), _mm_mul_ps(dy, ocy)), _mm_mul_ps(dz, ocz));
+		__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+			_mm_loadu_ps(&prims.sphere_r2[i]));
+		__m128 sq = _mm_sqrt_ps(_mm_sub_ps(_mm_mul_ps(h, h), _mm_mul_ps(a, c)));
+		__m128 root_near = _mm_div_ps(_mm_sub_ps(h, sq), a);
+		__m128 root_far = _mm_div_ps(_mm_add_ps(h, sq), a);
+		__m128 near_ok = _mm_and_ps(_mm_cmpgt_ps(root_near, t_min), _mm_cmplt_ps(root_near, best_t));
+		__m128 far_ok = _mm_and_ps(_mm_cmpgt_ps(root_far, t_min), _mm_cmplt_ps(root_far, best_t));
+		__m128 hit_t = select(near_ok, root_near, select(far_ok, root_far, inf));
+
+		// Triangle
+		__m128 nx = _mm_loadu_ps(&prims.n_x[i]), ny = _mm_loadu_ps(&prims.n_y[i]), nz = _mm_loadu_ps(&prims.n_z[i]);
+		__m128 det = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz)));
+		__m128 invdet = _mm_div_ps(one, det);
+		__m128 aox = _mm_sub_ps(ox, _mm_loadu_ps(&prims.v0_x[i]));
+		__m128 aoy = _mm_sub_ps(oy, _mm_loadu_ps(&prims.v0_y[i]));
+		__m128 aoz = _mm_sub_ps(oz, _mm_loadu_ps(&prims.v0_z[i]));
+		__m128 daox = _mm_sub_ps(_mm_mul_ps(aoy, dz), _mm_mul_ps(aoz, dy));
+		__m128 daoy = _mm_sub_ps(_mm_mul_ps(aoz, dx), _mm_mul_ps(aox, dz));
+		__m128 daoz = _mm_sub_ps(_mm_mul_ps(aox, dy), _mm_mul_ps(aoy, dx));
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_loadu_ps(&prims.e2_x[i]), daox),
+			_mm_mul_ps(_mm_loadu_ps(&prims.e2_y[i]), daoy)),
+			_mm_mul_ps(_mm_loadu_ps(&prims.e2_z[i]), daoz)), invdet);
+		__m128 v = _mm_sub_ps(zero, _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_loadu_ps(&prims.e1_x[i]), daox),
+			_mm_mul_ps(_mm_loadu_ps(&prims.e1_y[i]), daoy)),
+			_mm_mul_ps(_mm_loadu_ps(&prims.e1_z[i]), daoz)), invdet));
+		__m128 dist = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(aox, nx), _mm_mul_ps(aoy, ny)), _mm_mul_ps(aoz, nz)), invdet);
+		__m128 tri_ok = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(det, det_min), _mm_cmpge_ps(dist, zero)),
+			_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+		hit_t = select(tri_ok, dist, hit_t);
+
+		__m128 hit = _mm_and_ps(_mm_cmplt_ps(hit_t, best_t), in_range);
+		best_t = select(hit, hit_t, best_t);
+		best_slot = select(_mm_castps_si128(hit), slot, best_slot);
+	}
+
+	// Ties go to the lowest slot, same as testing them one at a time
+	alignas(16) float lane_t[4];
+	alignas(16) int lane_slot[4];
+	_mm_store_ps(lane_t, best_t);
+	_mm_store_si128((__m128i*)lane_slot, best_slot);
+	int closest = -1;
+	for (int k = 0; k < 4; k++) {
+		if (lane_slot[k] >= 0 && (lane_t[k] < t || (lane_t[k] == t && lane_slot[k] < closest))) {
+			t = lane_t[k];
+			closest = lane_slot[k];
+		}
+	}
+	return closest;
+}
+
+int intersect_packet_aabb_sse(const RayPacket& packet, const BVHNode& node, float* t_near)
+{
+	const __m128 zero = _mm_setzero_ps();
+	int mask = 0;
+	for (int half = 0; half < PACKET_SIZE; half += 4) {
+		__m128 ox = _mm_loadu_ps(packet.origin_x + half);
+		__m128 oy = _mm_loadu_ps(packet.origin_y + half);
+		__m128 oz = _mm_loadu_ps(packet.origin_z + half);
+		__m128 ix = _mm_loadu_ps(packet.inv_dir_x + half);
+		__m128 iy = _mm_loadu_ps(packet.inv_dir_y + half);
+		__m128 iz = _mm_loadu_ps(packet.inv_dir_z + half);
+
+		__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds_min.x), ox), ix);
+		__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds_min.y), oy), iy);
+		__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds_min.z), oz), iz);
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds_max.x), ox), ix);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds_max.y), oy), iy);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds_max.z), oz), iz);
+
+		// Operands are swapped so a NaN (0 * inf on a slab plane) resolves the same way as glm::min/max
+		__m128 t_enter = _mm_max_ps(_mm_max_ps(zero, _mm_min_ps(t1z, t0z)), _mm_max_ps(_mm_min_ps(t1y, t0y), _mm_min_ps(t1x, t0x)));
+		__m128 t_exit = _mm_min_ps(_mm_min_ps(_mm_loadu_ps(packet.t + half), _mm_max_ps(t1z, t0z)), _mm_min_ps(_mm_max_ps(t1y, t0y), _mm_max_ps(t1x, t0x)));
+		_mm_storeu_ps(t_near + half, t_enter);
+		mask |= _mm_movemask_ps(_mm_cmple_ps(t_enter, t_exit)) << half;
+	}
+	return mask & packet.active;
+}
+
+#endif
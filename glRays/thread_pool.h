@@ -0,0 +1,143 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+// Fixed set of worker threads with one task deque each. Workers take from the
+// front of their own deque and steal from the back of others once it runs dry,
+// so uneven tiles (e.g. sky vs. glass) still keep every core busy.
+class ThreadPool
+{
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<int> tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	const std::function<void(int)>* job = nullptr;
+
+	std::mutex mutex;
+	std::condition_variable start_cv;
+	std::condition_variable done_cv;
+	int generation = 0;
+	int active_workers = 0;
+	bool stopping = false;
+
+	bool pop_task(int queue_idx, int& task)
+	{
+		{
+			WorkQueue& own = *queues[queue_idx];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty()) {
+				task = own.tasks.front();
+				own.tasks.pop_front();
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < queues.size(); i++) {
+			WorkQueue& victim = *queues[(queue_idx + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				task = victim.tasks.back();
+				victim.tasks.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run_tasks(int queue_idx)
+	{
+		int task;
+		while (pop_task(queue_idx, task))
+			(*job)(task);
+	}
+
+	void worker_loop(int queue_idx)
+	{
+		int seen_generation = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start_cv.wait(lock, [&] { return stopping || generation != seen_generation; });
+				if (stopping)
+					return;
+				seen_generation = generation;
+			}
+
+			run_tasks(queue_idx);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--active_workers == 0)
+				done_cv.notify_all();
+		}
+	}
+
+public:
+	// n_threads <= 0 uses every hardware thread, the calling thread counts as one of them
+	ThreadPool(int n_threads = 0)
+	{
+		if (n_threads <= 0)
+			n_threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+		for (int i = 0; i < n_threads; i++)
+			queues.push_back(std::make_unique<WorkQueue>());
+		for (int i = 1; i < n_threads; i++)
+			workers.emplace_back(&ThreadPool::worker_loop, this, i);
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		start_cv.notify_all();
+		for (std::thread& t : workers)
+			t.join();
+	}
+
+	int size() const { return (int)queues.size(); }
+
+	// Runs fn(i) for every i in [0, n_tasks) and blocks until all of them are done
+	void parallel_for(int n_tasks, const std::function<void(int)>& fn)
+	{
+		if (n_tasks <= 0)
+			return;
+
+		// Contiguous ranges per queue keep neighbouring tiles on the same core until stolen
+		job = &fn;
+		int n_queues = (int)queues.size();
+		for (int q = 0; q < n_queues; q++) {
+			std::lock_guard<std::mutex> lock(queues[q]->mutex);
+			for (int i = n_tasks * q / n_queues; i < n_tasks * (q + 1) / n_queues; i++)
+				queues[q]->tasks.push_back(i);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			active_workers = (int)workers.size();
+			generation++;
+		}
+		start_cv.notify_all();
+
+		run_tasks(0);
+
+		// Wait for every worker to go idle, so none is left holding the job when it goes out of scope
+		std::unique_lock<std::mutex> lock(mutex);
+		done_cv.wait(lock, [&] { return active_workers == 0; });
+		job = nullptr;
+	}
+};
@@ -0,0 +1,91 @@
+#include "wavefront.h"
+
+// std430 sizes of PathState, PathHit, QueuedShadowRay and the counters block in wavefront.glsl
+const size_t PATH_STATE_SIZE = 64;
+const size_t PATH_HIT_SIZE = 32;
+const size_t SHADOW_RAY_SIZE = 48;
+const size_t QUEUE_COUNTERS_SIZE = 32;
+const GLintptr DISPATCH_ARGS_OFFSET = 8;
+
+WavefrontTracer::WavefrontTracer(int width, int height, WorkgroupSize pixel_workgroup, const std::string& trace_defines)
+	: w(width), h(height)
+{
+	std::string defines = pixel_workgroup.defines() + std::format("#define WAVEFRONT_GROUP_SIZE {}\n", WAVEFRONT_GROUP_SIZE);
+	const std::tuple<ShaderProgram*, const char*, bool> stages[] = {
+		{ &generate, "wavefront_generate.glsl", false },
+		{ &extend, "wavefront_extend.glsl", true },
+		{ &shade, "wavefront_shade.glsl", true },
+		{ &shadow, "wavefront_shadow.glsl", true },
+		{ &prepare, "wavefront_prepare.glsl", false },
+		{ &accumulate, "wavefront_accumulate.glsl", false },
+	};
+	for (auto [program, path, traces] : stages) {
+		program->attach(path, GL_COMPUTE_SHADER, traces ? defines + trace_defines : defines);
+		program->link();
+		program->setInt("u_path_count", w * h);
+		program->setInt("u_image_width", w);
+	}
+
+	size_t n_paths = (size_t)w * h;
+	for (GLBuffer* buffer : { &paths, &hits, &queues, &shadow_queue, &counters })
+		buffer->create_buffer();
+	paths.allocate(n_paths * PATH_STATE_SIZE);
+	hits.allocate(n_paths * PATH_HIT_SIZE);
+	queues.allocate(n_paths * sizeof(GLuint) * 2);
+	shadow_queue.allocate(n_paths * SHADOW_RAY_SIZE);
+	counters.allocate(QUEUE_COUNTERS_SIZE);
+}
+
+void WavefrontTracer::render_frame(int rays_per_pixel, int max_bounces, const AdaptiveSampler& sampler)
+{
+	paths.bind_base(8);
+	hits.bind_base(10);
+	queues.bind_base(11);
+	counters.bind_base(12);
+	shadow_queue.bind_base(14);
+
+	for (int sample = 0; sample < rays_per_pixel; sample++) {
+		// Generation appends to queue 0, so it has to start empty
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, counters.get_id());
+		glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint) * 2, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		generate.use();
+		generate.setInt("u_sample", sample);
+		sampler.dispatch();
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// The bounces are sized by the queue counters instead of the tile list
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counters.get_id());
+
+		// trace() intersects max_bounces + 1 times, paths that end early just leave the queues shorter
+		for (int bounce = 0; bounce <= max_bounces; bounce++) {
+			int queue = bounce % 2;
+
+			prepare.use();
+			prepare.setInt("u_queue_index", queue);
+			glDispatchCompute(1, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+			extend.use();
+			extend.setInt("u_queue_index", queue);
+			glDispatchComputeIndirect(DISPATCH_ARGS_OFFSET);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			shade.use();
+			shade.setInt("u_queue_index", queue);
+			shade.setInt("u_sample", sample);
+			glDispatchComputeIndirect(DISPATCH_ARGS_OFFSET);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			shadow.use();
+			glDispatchComputeIndirect(DISPATCH_ARGS_OFFSET);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+	}
+
+	accumulate.use();
+	sampler.dispatch();
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,88 @@
+// Path state and ray queues shared by the wavefront stages, mirrored by WavefrontTracer in wavefront.h.
+// Every pixel owns one path slot; a queue lists the slots whose ray still has to be traced
+
+#ifndef WAVEFRONT_GROUP_SIZE
+#define WAVEFRONT_GROUP_SIZE 64
+#endif
+
+struct PathState
+{
+	vec3 origin;
+	uint rng;
+	vec3 direction;
+	int bounce;
+	vec3 throughput;
+	float bsdf_pdf;
+	vec3 radiance;	// summed over the frame's samples so far
+	float std430padding;
+};
+
+// Hit point isn't stored, origin + direction * dist reproduces it exactly
+struct PathHit
+{
+	vec3 normal;
+	float dist;
+	int material;	// -1 on a miss
+	uint from_inside;
+	uint prim;
+};
+
+layout (std430, binding = 8) buffer path_state_buffer
+{
+	PathState u_paths[];
+};
+
+layout (std430, binding = 10) buffer path_hit_buffer
+{
+	PathHit u_path_hits[];
+};
+
+// Two queues of u_path_count slots each, bounces alternate between them
+layout (std430, binding = 11) buffer ray_queue_buffer
+{
+	uint u_ray_queue[];
+};
+
+// Also bound as the GL_DISPATCH_INDIRECT_BUFFER, u_dispatch is at byte offset 8
+layout (std430, binding = 12) buffer queue_counter_buffer
+{
+	uint u_queue_count[2];
+	uint u_dispatch[3];
+	uint u_shadow_count;
+};
+
+// Light samples from this bounce's shading, at most one per path
+struct QueuedShadowRay
+{
+	vec3 origin;
+	uint path;
+	vec3 direction;
+	uint prim;
+	vec3 contribution;
+	float std430padding;
+};
+
+layout (std430, binding = 14) buffer shadow_queue_buffer
+{
+	QueuedShadowRay u_shadow_queue[];
+};
+
+uniform int u_path_count;
+uniform int u_image_width;
+uniform int u_queue_index;	// queue the current bounce reads from
+uniform int u_sample;	// which of the frame's samples per pixel the paths are tracing
+
+// Every pixel owns the path slot at its row-major index
+ivec2 path_pixel(int path)
+{
+	return ivec2(path % u_image_width, path / u_image_width);
+}
+
+// Slot of the path for this invocation in the current queue, or -1 past the end of it
+int queued_path()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= u_queue_count[u_queue_index])
+		return -1;
+	return int(u_ray_queue[uint(u_queue_index * u_path_count) + i]);
+}
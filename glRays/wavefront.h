@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include "shader.h"
+#include "gl_buffer.h"
+#include "workgroup.h"
+#include "adaptive.h"
+
+const int WAVEFRONT_GROUP_SIZE = 64;
+
+// Path tracer split into small kernels instead of the compute.glsl megakernel: generate starts a camera
+// path per pixel, then each bounce runs extend (closest hit only), shade (material, next ray, light sample)
+// and shadow (light sample visibility) over a queue of live paths, and accumulate blends the frame into
+// the image. Queues and counters stay on the GPU, every bounce is an indirect dispatch sized by the
+// previous one. Layouts are in wavefront.glsl.
+class WavefrontTracer
+{
+	int w;
+	int h;
+
+	ShaderProgram generate, extend, shade, shadow, prepare, accumulate;
+	GLBuffer paths, hits, queues, shadow_queue, counters;
+
+public:
+	// pixel_workgroup sizes the per-pixel generate and accumulate kernels, the queue kernels are 1D.
+	// trace_defines only go to the kernels that trace rays, RayStats::defines() would push the others over
+	// the storage block limit.
+	WavefrontTracer(int width, int height, WorkgroupSize pixel_workgroup, const std::string& trace_defines = "");
+
+	// Same inputs and output as a megakernel dispatch: FrameUniforms, scene buffers, the accumulation images
+	// and the tile list sampler.prepare() built, only the active tiles start paths
+	void render_frame(int rays_per_pixel, int max_bounces, const AdaptiveSampler& sampler);
+};
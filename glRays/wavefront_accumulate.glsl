@@ -0,0 +1,24 @@
+#version 430 core
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 8
+#endif
+#ifndef LOCAL_SIZE_Y
+#define LOCAL_SIZE_Y 8
+#endif
+layout(local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y, local_size_z = 1) in;
+
+#include "path_tracing.glsl"
+#include "accumulation.glsl"
+#include "wavefront.glsl"
+
+// Blends this frame's samples into the running average, exactly as the end of the megakernel does
+void main()
+{
+	ivec2 pix_coords = tile_pixel();
+	if (pix_coords.x < 0)
+		return;
+
+	uint path = uint(pix_coords.y * imageSize(img_output).x + pix_coords.x);
+	accumulate(pix_coords, u_paths[path].radiance / u_rays_per_pixel);
+}
@@ -0,0 +1,19 @@
+#version 430 core
+
+#include "path_tracing.glsl"
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+// Finds the closest hit of every queued ray, nothing but BVH traversal so the whole group stays in step
+void main()
+{
+	int path = queued_path();
+	if (path < 0)
+		return;
+
+	Ray ray = Ray(u_paths[path].origin, u_paths[path].direction);
+	HitInfo hit = ray_collision(ray);
+	RAY_STATS_TRACED(min(u_paths[path].bounce, RAY_KIND_BOUNCE));
+	u_path_hits[path] = PathHit(hit.normal, hit.dist, hit.collided ? hit.material : -1, uint(hit.from_inside), hit.prim);
+}
@@ -0,0 +1,35 @@
+#version 430 core
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 8
+#endif
+#ifndef LOCAL_SIZE_Y
+#define LOCAL_SIZE_Y 8
+#endif
+layout(local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y, local_size_z = 1) in;
+
+#include "path_tracing.glsl"
+#include "accumulation.glsl"
+#include "wavefront.glsl"
+
+// Starts one camera path per pixel of the active tiles and queues it for extension
+void main()
+{
+	ivec2 pix_coords = tile_pixel();
+	if (pix_coords.x < 0)
+		return;
+	ivec2 dims = imageSize(img_output);
+
+	// Same samples as the megakernel, a PCG stream carries on from the frame's previous sample
+	uint path = uint(pix_coords.y * dims.x + pix_coords.x);
+	vec3 radiance = vec3(0.0);
+	if (u_sample > 0) {
+		rng_state = u_paths[path].rng;
+		radiance = u_paths[path].radiance;
+	}
+	sampler_begin(pix_coords, dims, uint(u_frame_count * u_rays_per_pixel + u_sample));
+
+	Ray r = camera_ray(pix_coords, dims);
+	u_paths[path] = PathState(r.origin, rng_state, r.direction, 0, vec3(1.0), 0.0, radiance, 0.0);
+	u_ray_queue[atomicAdd(u_queue_count[0], 1u)] = path;
+}
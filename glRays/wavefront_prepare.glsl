@@ -0,0 +1,15 @@
+#version 430 core
+
+#include "wavefront.glsl"
+
+layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+// Sizes the indirect dispatch of the next stages from the queue they read, and empties the queues they fill
+void main()
+{
+	u_dispatch[0] = (u_queue_count[u_queue_index] + WAVEFRONT_GROUP_SIZE - 1) / WAVEFRONT_GROUP_SIZE;
+	u_dispatch[1] = 1u;
+	u_dispatch[2] = 1u;
+	u_queue_count[1 - u_queue_index] = 0u;
+	u_shadow_count = 0u;
+}
@@ -0,0 +1,57 @@
+#version 430 core
+
+#include "path_tracing.glsl"
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+// Shades the hits from the extension stage, queues light samples for the shadow stage and the paths
+// that survive for the next bounce
+void main()
+{
+	int path = queued_path();
+	if (path < 0)
+		return;
+
+	// Missed everything, environment lighting is disabled as in trace()
+	PathHit path_hit = u_path_hits[path];
+	if (path_hit.material < 0) {
+		RAY_STATS_PATH_END(u_paths[path].bounce);
+		return;
+	}
+
+	PathState state = u_paths[path];
+	Ray ray = Ray(state.origin, state.direction);
+	HitInfo hit;
+	hit.material = path_hit.material;
+	hit.prim = path_hit.prim;
+	hit.point = ray.origin + ray.direction * path_hit.dist;
+	hit.normal = path_hit.normal;
+	hit.dist = path_hit.dist;
+	hit.collided = true;
+	hit.from_inside = path_hit.from_inside != 0u;
+
+	rng_state = state.rng;
+	sampler_resume(path_pixel(path), uint(u_frame_count * u_rays_per_pixel + u_sample));
+	sampler_bounce(state.bounce);
+	ShadowRay shadow;
+	bool alive = scatter(hit, ray, state.throughput, state.radiance, state.bsdf_pdf, state.bounce < u_max_bounces, shadow);
+
+	// Occlusion is left to the shadow stage, which adds the contribution if the light is visible
+	if (shadow.contribution != vec3(0.0))
+		u_shadow_queue[atomicAdd(u_shadow_count, 1u)] = QueuedShadowRay(shadow.ray.origin, uint(path), shadow.ray.direction, shadow.prim, shadow.contribution, 0.0);
+
+	state.origin = ray.origin;
+	state.direction = ray.direction;
+	state.rng = rng_state;
+	state.bounce++;
+	u_paths[path] = state;
+
+	// trace() intersects u_max_bounces + 1 times, the last bounce only collects emission
+	if (alive && state.bounce <= u_max_bounces) {
+		int next = 1 - u_queue_index;
+		u_ray_queue[uint(next * u_path_count) + atomicAdd(u_queue_count[next], 1u)] = uint(path);
+	}
+	else
+		RAY_STATS_PATH_END(state.bounce);
+}
@@ -0,0 +1,19 @@
+#version 430 core
+
+#include "path_tracing.glsl"
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+// Traces the light samples queued by shading, dispatched with the shade stage's size since there are never more
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= u_shadow_count)
+		return;
+
+	QueuedShadowRay queued = u_shadow_queue[i];
+	ShadowRay shadow = ShadowRay(Ray(queued.origin, queued.direction), queued.prim, queued.contribution);
+	if (shadow_visible(shadow))
+		u_paths[queued.path].radiance += shadow.contribution;
+}
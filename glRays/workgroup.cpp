@@ -0,0 +1,67 @@
+#include "workgroup.h"
+
+#include <chrono>
+#include <iostream>
+
+// Warp/wavefront friendly shapes, wide ones favour coherent camera rays along rows
+const WorkgroupSize WORKGROUP_CANDIDATES[] = {
+	{ 8, 8 }, { 16, 8 }, { 8, 16 }, { 16, 16 }, { 32, 4 }, { 32, 8 }, { 64, 1 }, { 4, 4 }
+};
+const int AUTOTUNE_WARMUP_DISPATCHES = 1;
+const int AUTOTUNE_TIMED_DISPATCHES = 3;
+
+WorkgroupSize autotune_workgroup_size(const char* path, int width, int height)
+{
+	GLint max_invocations, max_x, max_y;
+	glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &max_invocations);
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &max_x);
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 1, &max_y);
+
+	WorkgroupSize best;
+	double best_ms = -1.0;
+	for (const WorkgroupSize& candidate : WORKGROUP_CANDIDATES) {
+		if (candidate.x * candidate.y > max_invocations || candidate.x > max_x || candidate.y > max_y)
+			continue;
+
+		ShaderProgram program = ShaderProgram();
+		// Every pixel, without the adaptive tile list the real kernel is dispatched over
+		program.attach(path, GL_COMPUTE_SHADER, candidate.defines() + "#define FULL_DISPATCH\n");
+		program.link();
+		GLint linked;
+		glGetProgramiv(program.id, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			glDeleteProgram(program.id);
+			continue;
+		}
+
+		program.use();
+		for (int i = 0; i < AUTOTUNE_WARMUP_DISPATCHES; i++) {
+			candidate.dispatch(width, height);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+
+		// Wall clock around glFinish rather than timer queries, which some drivers report as zero
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < AUTOTUNE_TIMED_DISPATCHES; i++) {
+			candidate.dispatch(width, height);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+		glFinish();
+		auto end = std::chrono::steady_clock::now();
+		double ms = std::chrono::duration<double, std::milli>(end - start).count() / AUTOTUNE_TIMED_DISPATCHES;
+		std::clog << std::format("Workgroup {}x{}: {:.2f} ms per frame", candidate.x, candidate.y, ms) << std::endl;
+
+		if (best_ms < 0.0 || ms < best_ms) {
+			best = candidate;
+			best_ms = ms;
+		}
+		glDeleteProgram(program.id);
+	}
+
+	if (best_ms < 0.0)
+		std::cerr << "ERROR::WORKGROUP::NO_CANDIDATE_COMPILED" << std::endl;
+	else
+		std::clog << std::format("Using {}x{} workgroups for {}x{}", best.x, best.y, width, height) << std::endl;
+	return best;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <format>
+#include <string>
+
+#include "shader.h"
+
+// Local size of the path tracing kernel, compiled into compute.glsl as LOCAL_SIZE_X/LOCAL_SIZE_Y
+struct WorkgroupSize
+{
+	int x = 8;
+	int y = 8;
+
+	std::string defines() const
+	{
+		return std::format("#define LOCAL_SIZE_X {}\n#define LOCAL_SIZE_Y {}\n", x, y);
+	}
+
+	// Rounds up to whole workgroups so edge pixels are covered, the shader skips the overhang
+	void dispatch(int width, int height) const
+	{
+		glDispatchCompute((GLuint)((width + x - 1) / x), (GLuint)((height + y - 1) / y), 1);
+	}
+};
+
+// Compiles the compute shader at path once per candidate size the device supports, times a few
+// dispatches over a width x height image and returns the fastest. The scene buffers and a
+// representative frame's uniforms must already be bound.
+WorkgroupSize autotune_workgroup_size(const char* path, int width, int height);